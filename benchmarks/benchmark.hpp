@@ -0,0 +1,59 @@
+#ifndef NDARRAY_BENCHMARK_H
+#define NDARRAY_BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+
+// Helpers shared by the benchmarks. Each benchmark takes its size as an
+// optional command line argument, runs every case a few times, and reports
+// the best time, which is the least disturbed by the rest of the system.
+
+// Returns the best time in seconds of repeats calls of f()
+template <class F>
+double best_time(size_t repeats, F f) {
+  double best = std::numeric_limits<double>::max();
+  for (size_t r = 0; r < repeats; r++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto stop = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(stop - start).count());
+  }
+  return best;
+}
+
+// Makes the compiler assume that the memory at p is read, so that the
+// computation of its contents is not removed
+template <class T>
+void keep(const T* p) {
+#if defined(__GNUC__)
+  asm volatile("" : : "g"(p) : "memory");
+#else
+  static const T* volatile sink;
+  sink = p;
+#endif
+}
+
+// Returns argument i of the command line as a number, or def if not given
+inline size_t size_argument(int argc, char** argv, int i, size_t def) {
+  if (argc <= i) return def;
+  return static_cast<size_t>(std::strtoull(argv[i], nullptr, 10));
+}
+
+// Prints a line of results, with the name of the case left aligned
+inline void report(const std::string& name, double seconds,
+                   const std::string& rate) {
+  std::printf("  %-40s %12.3f us  %s\n", name.c_str(), seconds * 1e6,
+              rate.c_str());
+}
+
+inline std::string format_rate(double value, const char* unit) {
+  char buffer[64];
+  std::snprintf(buffer, sizeof(buffer), "%8.2f %s", value, unit);
+  return buffer;
+}
+
+#endif  // NDARRAY_BENCHMARK_H
@@ -0,0 +1,82 @@
+#include <ndarray.hpp>
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "benchmark.hpp"
+
+// GFLOP/s of matmul for square matrices, compared with a naive loop in the
+// i, k, j order, which the compiler vectorizes along the rows of b and c.
+// matmul is run on one thread, and on every hardware thread. The naive loop
+// is skipped for the largest sizes, where it takes too long.
+//
+// Usage: gemm_benchmark [largest size = 2048]
+
+template <class T>
+static void naive(size_t n, const T* a, const T* b, T* c) {
+  for (size_t i = 0; i < n; i++) {
+    T* c_row = c + i * n;
+    for (size_t j = 0; j < n; j++) c_row[j] = T();
+    for (size_t p = 0; p < n; p++) {
+      const T a_ip = a[i * n + p];
+      const T* b_row = b + p * n;
+      for (size_t j = 0; j < n; j++) c_row[j] += a_ip * b_row[j];
+    }
+  }
+}
+
+template <class T>
+static void run(const char* type, size_t largest) {
+  const size_t n_threads =
+      std::max<size_t>(1, std::thread::hardware_concurrency());
+
+  for (size_t n = 64; n <= largest; n *= 2) {
+    std::printf("%s, %zu x %zu\n", type, n, n);
+    NDArray<T> a({n, n});
+    NDArray<T> b({n, n});
+    for (size_t i = 0; i < a.size(); i++) {
+      a[i] = static_cast<T>(i % 7) - T(3);
+      b[i] = static_cast<T>(i % 5) - T(2);
+    }
+    const double flops = 2. * n * n * n;
+    const size_t reps = std::max<size_t>(1, (size_t(1) << 27) / (n * n * n));
+
+    if (n <= 1024) {
+      NDArray<T> c({n, n});
+      double t = best_time(3, [&]() {
+        for (size_t r = 0; r < reps; r++) {
+          naive(n, a.data(), b.data(), c.data());
+        }
+        keep(c.data());
+      });
+      t /= reps;
+      report("naive loop", t, format_rate(flops / t * 1e-9, "GFLOP/s"));
+    }
+
+    for (size_t threads : {size_t(1), n_threads}) {
+      execution_settings().n_threads = threads;
+      double t = best_time(3, [&]() {
+        for (size_t r = 0; r < reps; r++) {
+          NDArray<T> c = matmul(a, b);
+          keep(c.data());
+        }
+      });
+      t /= reps;
+      report("matmul, " + std::to_string(threads) + " thread(s)", t,
+             format_rate(flops / t * 1e-9, "GFLOP/s"));
+      if (n_threads == 1) break;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  const size_t largest = size_argument(argc, argv, 1, 2048);
+  ExecutionSettings saved = execution_settings();
+
+  run<float>("float", largest);
+  run<double>("double", largest);
+
+  execution_settings() = saved;
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include <ndarray.hpp>
+
+#include <cstdio>
+#include <string>
+
+#include "benchmark.hpp"
+
+// Throughput of saving and loading a large .npy file with the serial path,
+// and with the chunked path of npy_io_settings() for several thread counts
+// and chunk sizes. Loads are from the page cache, which is what a read of a
+// fast device approaches; saves with sync include the flush to the device.
+//
+// Usage: npy_io_benchmark [MiB = 512] [directory = .]
+
+int main(int argc, char** argv) {
+  const size_t mib = size_argument(argc, argv, 1, 512);
+  const std::string dir = argc > 2 ? argv[2] : ".";
+  const std::string fname = dir + "/npy_io_benchmark.npy";
+  const size_t n_bytes = mib << 20;
+  const double gib = static_cast<double>(n_bytes) / (1 << 30);
+
+  NDArray<double> a({n_bytes / sizeof(double)});
+  for (size_t i = 0; i < a.size(); i++) a[i] = static_cast<double>(i);
+
+  struct Config {
+    size_t n_threads;
+    size_t chunk_mib;
+  };
+  const Config configs[] = {{1, 64}, {2, 16}, {4, 4},  {4, 16},
+                            {4, 64}, {8, 4},  {8, 16}, {16, 16}};
+
+  std::printf("%zu MiB of doubles in %s\n", mib, fname.c_str());
+  NpyIOSettings saved = npy_io_settings();
+  for (const Config& c : configs) {
+    npy_io_settings() = NpyIOSettings{c.n_threads, c.chunk_mib << 20};
+    std::printf("%zu thread(s), chunks of %zu MiB%s\n", c.n_threads,
+                c.chunk_mib, c.n_threads == 1 ? " (serial)" : "");
+
+    double t = best_time(3, [&]() { a.save(fname); });
+    report("save", t, format_rate(gib / t, "GiB/s"));
+
+    t = best_time(3, [&]() { a.save(fname, NpyWriteOptions(true)); });
+    report("save with sync", t, format_rate(gib / t, "GiB/s"));
+
+    t = best_time(3, [&]() {
+      NDArray<double> b = NDArray<double>::load(fname);
+      keep(b.data());
+    });
+    report("load", t, format_rate(gib / t, "GiB/s"));
+  }
+  npy_io_settings() = saved;
+
+  std::remove(fname.c_str());
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include <ndarray.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "benchmark.hpp"
+
+// Throughput of NDArray::load compared with reading the same file into a
+// buffer, which is the most any load can reach. All read from the page
+// cache. Reading into a new buffer also pays for the page faults of fresh
+// memory, as every load does. With std::allocator, load also zeroes the
+// storage before reading into it, which UninitializedAllocator avoids.
+// Mapping the file and reading every element is shown for comparison.
+//
+// Usage: npy_load_benchmark [MiB = 512] [directory = .]
+
+static void read_file(const std::string& fname, char* buffer, size_t n) {
+  std::ifstream file(fname, std::ios::binary);
+  file.read(buffer, static_cast<std::streamsize>(n));
+}
+
+template <class T>
+static void run(const std::string& fname, size_t n_bytes, const char* type) {
+  const double gib = static_cast<double>(n_bytes) / (1 << 30);
+  NDArray<T> a({n_bytes / sizeof(T)});
+  for (size_t i = 0; i < a.size(); i++) a[i] = static_cast<T>(i % 1000);
+  a.save(fname);
+
+  std::printf("%s\n", type);
+
+  const size_t file_bytes = n_bytes + 4096;
+  std::unique_ptr<char[]> buffer(new char[file_bytes]);
+  read_file(fname, buffer.get(), file_bytes);
+  double t = best_time(5, [&]() {
+    read_file(fname, buffer.get(), file_bytes);
+    keep(buffer.get());
+  });
+  report("read into the same buffer", t, format_rate(gib / t, "GiB/s"));
+
+  t = best_time(5, [&]() {
+    std::unique_ptr<char[]> fresh(new char[file_bytes]);
+    read_file(fname, fresh.get(), file_bytes);
+    keep(fresh.get());
+  });
+  report("read into a new buffer", t, format_rate(gib / t, "GiB/s"));
+
+  t = best_time(5, [&]() {
+    NDArray<T> b = NDArray<T>::load(fname);
+    keep(b.data());
+  });
+  report("NDArray::load", t, format_rate(gib / t, "GiB/s"));
+
+  using Uninitialized = NDArray<T, UninitializedAllocator<T>>;
+  t = best_time(5, [&]() {
+    Uninitialized b = Uninitialized::load(fname);
+    keep(b.data());
+  });
+  report("NDArray::load, UninitializedAllocator", t,
+         format_rate(gib / t, "GiB/s"));
+
+  t = best_time(5, [&]() {
+    MappedNDArray<const T> m = NDArray<T>::map(fname);
+    T sum = T();
+    for (size_t i = 0; i < m.size(); i++) sum += m[i];
+    keep(&sum);
+  });
+  report("map and read every element", t, format_rate(gib / t, "GiB/s"));
+}
+
+int main(int argc, char** argv) {
+  const size_t mib = size_argument(argc, argv, 1, 512);
+  const std::string dir = argc > 2 ? argv[2] : ".";
+  const std::string fname = dir + "/npy_load_benchmark.npy";
+
+  std::printf("%zu MiB in %s\n", mib, fname.c_str());
+  run<double>(fname, mib << 20, "double");
+  run<int32_t>(fname, mib << 20, "int32");
+
+  std::remove(fname.c_str());
+  return 0;
+}
@@ -0,0 +1,53 @@
+#include <ndarray.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "benchmark.hpp"
+
+// Random updates of a large array, whose cost is dominated by TLB misses,
+// with the memory of std::allocator and of PageAllocator with ordinary
+// pages, transparent huge pages, and huge pages interleaved over the NUMA
+// nodes. The gain of huge pages depends on the transparent huge page mode of
+// the system (/sys/kernel/mm/transparent_hugepage/enabled), which must be
+// madvise or always.
+//
+// Usage: page_benchmark [MiB = 1024] [updates = 20000000]
+
+template <class Alloc>
+static void run(const std::string& name, size_t n, size_t n_updates,
+                const Alloc& alloc) {
+  NDArray<double, Alloc> a({n}, true, alloc);
+  double t = best_time(3, [&]() {
+    uint64_t x = 88172645463325252ull;
+    double* data = a.data();
+    for (size_t i = 0; i < n_updates; i++) {
+      // xorshift64
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      data[x % n] += 1.;
+    }
+    keep(data);
+  });
+  report(name, t, format_rate(t / n_updates * 1e9, "ns/update"));
+}
+
+int main(int argc, char** argv) {
+  const size_t mib = size_argument(argc, argv, 1, 1024);
+  const size_t n_updates = size_argument(argc, argv, 2, 20000000);
+  const size_t n = (mib << 20) / sizeof(double);
+
+  std::printf("%zu random updates of %zu MiB of doubles\n", n_updates, mib);
+  run("std::allocator", n, n_updates, std::allocator<double>());
+  run("PageAllocator, ordinary pages", n, n_updates,
+      PageAllocator<double>(PageOptions(false)));
+  run("PageAllocator, transparent huge pages", n, n_updates,
+      PageAllocator<double>(PageOptions(true)));
+  run("PageAllocator, huge pages, interleave", n, n_updates,
+      PageAllocator<double>(PageOptions(true, false, NumaPolicy::INTERLEAVE)));
+  run("PageAllocator, hugetlb", n, n_updates,
+      PageAllocator<double>(PageOptions(true, true)));
+  return 0;
+}
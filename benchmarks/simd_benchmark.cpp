@@ -0,0 +1,134 @@
+#include <ndarray.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+
+// Throughput of the elementwise kernels for arrays which fit in the L1
+// cache, in the L2 cache, and only in memory. The plain loop is what the
+// compiler makes of a[i] += b[i] for the baseline instruction set, which
+// the kernel of each instruction set the CPU supports, and simd_apply with
+// its runtime dispatch, are compared against. All run on one thread.
+//
+// Usage: simd_benchmark [elements of the largest arrays = 16777216]
+
+template <class T>
+static std::vector<T, AlignedAllocator<T>> values(size_t n) {
+  std::vector<T, AlignedAllocator<T>> v(n);
+  for (size_t i = 0; i < n; i++) v[i] = static_cast<T>(i % 100 + 1);
+  return v;
+}
+
+// Reports the time of f(), which processes n elements, repeated so that
+// about 2^28 elements are processed in total
+template <class F>
+static void run(const std::string& name, size_t n, F f) {
+  size_t reps = std::max<size_t>(1, (size_t(1) << 28) / n);
+  double t = best_time(3, [&]() {
+    for (size_t r = 0; r < reps; r++) f();
+  });
+  report(name, t / reps,
+         format_rate(static_cast<double>(n) * reps / t * 1e-9, "G elem/s"));
+}
+
+// a += b, with the elements of b converted to those of a if they differ
+template <class T, class C>
+static void bench_add(const char* types, size_t n) {
+  std::printf("a += b, %s, %zu elements\n", types, n);
+  auto a = values<T>(n);
+  auto b = values<C>(n);
+  T* pa = a.data();
+  const C* pb = b.data();
+
+  run("plain loop", n, [&]() {
+    for (size_t i = 0; i < n; i++) pa[i] += pb[i];
+    keep(pa);
+  });
+#if defined(NDARRAY_X86_DISPATCH)
+  if (cpu_supports_sse2()) {
+    run("sse2", n, [&]() {
+      size_t i = simd_kernel_sse2<ExprAdd>(pa, pb, n);
+      for (; i < n; i++) pa[i] += pb[i];
+      keep(pa);
+    });
+  }
+  if (cpu_supports_avx2()) {
+    run("avx2", n, [&]() {
+      size_t i = simd_kernel_avx2<ExprAdd>(pa, pb, n);
+      for (; i < n; i++) pa[i] += pb[i];
+      keep(pa);
+    });
+  }
+  if (cpu_supports_avx512f()) {
+    run("avx512", n, [&]() {
+      size_t i = simd_kernel_avx512<ExprAdd>(pa, pb, n);
+      for (; i < n; i++) pa[i] += pb[i];
+      keep(pa);
+    });
+  }
+#endif
+  run("simd_apply", n, [&]() {
+    simd_apply<ExprAdd>(pa, pb, n);
+    keep(pa);
+  });
+}
+
+// a *= c, for a scalar c
+template <class T>
+static void bench_scale(const char* type, size_t n) {
+  std::printf("a *= c, %s, %zu elements\n", type, n);
+  auto a = values<T>(n);
+  T* pa = a.data();
+  const T c = static_cast<T>(1.0000001);
+
+  run("plain loop", n, [&]() {
+    for (size_t i = 0; i < n; i++) pa[i] *= c;
+    keep(pa);
+  });
+  run("simd_apply_scalar", n, [&]() {
+    simd_apply_scalar<ExprMultiply>(pa, c, n);
+    keep(pa);
+  });
+}
+
+// a = b, converting the elements of b
+template <class T, class C>
+static void bench_convert(const char* types, size_t n) {
+  std::printf("a = b, %s, %zu elements\n", types, n);
+  auto a = values<T>(n);
+  auto b = values<C>(n);
+  T* pa = a.data();
+  const C* pb = b.data();
+
+  run("plain loop", n, [&]() {
+    for (size_t i = 0; i < n; i++) pa[i] = static_cast<T>(pb[i]);
+    keep(pa);
+  });
+  run("simd_convert", n, [&]() {
+    simd_convert(pa, pb, n);
+    keep(pa);
+  });
+}
+
+int main(int argc, char** argv) {
+  const size_t largest = size_argument(argc, argv, 1, size_t(1) << 24);
+  ExecutionSettings saved = execution_settings();
+  execution_settings() = ExecutionSettings{1, 1};
+
+  for (size_t n : {size_t(1) << 10, size_t(1) << 14, largest}) {
+    bench_add<float, float>("float += float", n);
+    bench_add<double, double>("double += double", n);
+    bench_add<float, int32_t>("float += int32", n);
+    bench_add<double, float>("double += float", n);
+    bench_scale<float>("float", n);
+    bench_scale<double>("double", n);
+    bench_convert<double, float>("double = float", n);
+    bench_convert<float, int32_t>("float = int32", n);
+  }
+
+  execution_settings() = saved;
+  return 0;
+}
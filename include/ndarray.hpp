@@ -38,15 +38,58 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
 #include <complex>
+#include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <random>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <typeinfo>
+#include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define NDARRAY_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+// Macros to compile functions for specific x86 instruction sets, which are
+// selected at run time based on the features of the CPU.
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define NDARRAY_X86_DISPATCH
+#define NDARRAY_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#endif
+
 // Macro to force function to be inlined. This is done for speed and to try and
 // force the compiler to vectorize operatrions.
 #if defined(_MSC_VER)
@@ -57,30 +100,490 @@
 #define NDARRAY_INLINE inline
 #endif
 
+// Indexing an array with operator() checks the number of indices, and that
+// each index is within the shape, throwing an exception if not. Defining
+// NDARRAY_NO_BOUNDS_CHECK before including this file removes these checks,
+// for release builds where indexing must be as cheap as possible. The
+// at_unchecked methods never check their indices.
+
+// Enum of the ways in which a .npy file may be memory mapped.
+// READ_ONLY mappings are shared between all processes mapping the same file,
+// and the data may not be modified, so the elements must be const.
+// COPY_ON_WRITE mappings may be modified, but changes are private to the
+// mapping and are never written to the file.
+enum class MapMode { READ_ONLY, COPY_ON_WRITE };
+
+// Options controlling how the data of a .npy file is written to disk.
+//   sync   : The data is flushed to the storage device with fsync before
+//            returning, so that it survives a crash or power loss.
+//   direct : The page cache is bypassed (O_DIRECT), where supported, so that
+//            writing large files does not evict other cached data.
+//   atomic : The file is written to a temporary file in the same directory,
+//            which is renamed to the final name once complete. A partially
+//            written (torn) file is therefore never visible. This is only
+//            atomic on POSIX systems. Elsewhere, sync and direct are
+//            ignored, and an existing file is removed before the rename, so
+//            that a crash between the two may leave no file at all.
+struct NpyWriteOptions {
+  NpyWriteOptions(bool sync = false, bool direct = false, bool atomic = false)
+      : sync{sync}, direct{direct}, atomic{atomic} {}
+
+  bool sync;
+  bool direct;
+  bool atomic;
+};
+
+// Allocator which aligns every allocation to Alignment bytes, which must be a
+// power of two. With the default of 64 bytes, allocations begin on a cache
+// line, and SIMD loads and stores of any width are aligned. It may be used
+// as the allocator of a std::vector.
+template <class T, size_t Alignment = 64>
+class AlignedAllocator {
+ public:
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() noexcept {}
+  template <class U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+  T* allocate(size_t n);
+  void deallocate(T* p, size_t n) noexcept;
+};
+
+template <class T, class U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&,
+                const AlignedAllocator<U, Alignment>&) {
+  return true;
+}
+
+template <class T, class U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&,
+                const AlignedAllocator<U, Alignment>&) {
+  return false;
+}
+
+// Allocator which caches freed blocks in thread-local free lists, so that
+// the repeated creation of temporary arrays of similar sizes does not go
+// through malloc each time. Requests are rounded up to a power of two size
+// class, and only a few blocks of each class are kept; blocks larger than
+// the largest class are allocated and freed directly. Every block is aligned
+// to 64 bytes. A block may be freed on a different thread than the one which
+// allocated it, in which case it is cached by the freeing thread. Cached
+// blocks are released when their thread exits.
+template <class T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = PoolAllocator<U>;
+  };
+
+  PoolAllocator() noexcept {}
+  template <class U>
+  PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+  T* allocate(size_t n);
+  void deallocate(T* p, size_t n) noexcept;
+};
+
+template <class T, class U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) {
+  return false;
+}
+
+// Region of memory from which allocations are made by bumping a pointer.
+// Memory is obtained in blocks of block_size bytes (or larger, for larger
+// requests), and is only given back when reset() is called or the arena is
+// destroyed. Every allocation is aligned to 64 bytes. An arena must only be
+// used by one thread at a time.
+class MonotonicArena {
+ public:
+  explicit MonotonicArena(size_t block_size = 1 << 20);
+  ~MonotonicArena();
+
+  MonotonicArena(const MonotonicArena&) = delete;
+  MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+  void* allocate(size_t n_bytes);
+
+  // Releases all allocations at once, keeping the largest block for reuse.
+  // Anything still using memory from the arena is left dangling.
+  void reset();
+
+  // Total number of bytes of the blocks currently held by the arena
+  size_t capacity() const;
+
+  // Arena used by default constructed MonotonicAllocators on this thread
+  static MonotonicArena& thread_default();
+
+ private:
+  size_t block_size_;
+  std::vector<std::pair<char*, size_t>> blocks_;
+  char* ptr_;
+  char* end_;
+};
+
+// Allocator which takes memory from a MonotonicArena, making allocation
+// almost free. Deallocation does nothing, so the memory of an array is only
+// reclaimed when its arena is reset or destroyed. This suits temporary
+// arrays with a clear lifetime, such as those made in each iteration of a
+// loop, followed by a reset of the arena. A default constructed allocator
+// uses the arena of the calling thread.
+template <class T>
+class MonotonicAllocator {
+ public:
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = MonotonicAllocator<U>;
+  };
+
+  MonotonicAllocator() noexcept;
+  explicit MonotonicAllocator(MonotonicArena& arena) noexcept;
+  template <class U>
+  MonotonicAllocator(const MonotonicAllocator<U>& other) noexcept;
+
+  T* allocate(size_t n);
+  void deallocate(T*, size_t) noexcept {}
+
+  MonotonicArena* arena() const noexcept;
+
+ private:
+  MonotonicArena* arena_;
+};
+
+template <class T, class U>
+bool operator==(const MonotonicAllocator<T>& a,
+                const MonotonicAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <class T, class U>
+bool operator!=(const MonotonicAllocator<T>& a,
+                const MonotonicAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+// Allocator adaptor which takes memory from the allocator Base, but leaves
+// the elements it constructs without arguments default initialized, where
+// Base would value initialize them. A std::vector of arithmetic types can
+// then be resized without writing to its memory. The constructors and
+// reallocate of NDArray zero the new elements on the threads set by
+// execution_settings(), so that under a first touch NUMA policy each page is
+// placed on the node of the thread which processes it in elementwise
+// operations. NDArray::uninitialized leaves the elements untouched.
+template <class T, class Base = std::allocator<T>>
+class UninitializedAllocator : public Base {
+ public:
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = UninitializedAllocator<
+        U, typename std::allocator_traits<Base>::template rebind_alloc<U>>;
+  };
+
+  UninitializedAllocator() = default;
+  UninitializedAllocator(const Base& base) noexcept;
+  template <class U, class B>
+  UninitializedAllocator(const UninitializedAllocator<U, B>& other) noexcept;
+
+  template <class U>
+  void construct(U* p);
+  template <class U, class... Args>
+  void construct(U* p, Args&&... args);
+};
+
+template <class T, class B, class U, class C>
+bool operator==(const UninitializedAllocator<T, B>& a,
+                const UninitializedAllocator<U, C>& b) {
+  return static_cast<const B&>(a) == static_cast<const C&>(b);
+}
+
+template <class T, class B, class U, class C>
+bool operator!=(const UninitializedAllocator<T, B>& a,
+                const UninitializedAllocator<U, C>& b) {
+  return !(a == b);
+}
+
+// Ways in which the pages of a PageAllocator are placed on the NUMA nodes of
+// the machine.
+//   DEFAULT    : The policy of the calling thread, normally that each page is
+//                placed on the node of the thread which first touches it.
+//   INTERLEAVE : Pages are spread round robin over the nodes.
+//   BIND       : Pages are only taken from the nodes.
+enum class NumaPolicy { DEFAULT, INTERLEAVE, BIND };
+
+// Options controlling the memory obtained by a PageAllocator.
+//   huge_pages : Transparent huge pages are requested for the memory with
+//                madvise(MADV_HUGEPAGE).
+//   hugetlb    : The memory is mapped from the explicit huge pages reserved
+//                by the administrator (MAP_HUGETLB). If none are available,
+//                ordinary pages are used, as selected by huge_pages.
+//   numa       : The placement of the pages on NUMA nodes.
+//   node_mask  : Bit mask of the nodes used by numa, where 0 means all of
+//                the nodes of the machine.
+// Each option is only applied where supported by the system, and is
+// otherwise silently ignored.
+struct PageOptions {
+  PageOptions(bool huge_pages = true, bool hugetlb = false,
+              NumaPolicy numa = NumaPolicy::DEFAULT, uint64_t node_mask = 0)
+      : huge_pages{huge_pages},
+        hugetlb{hugetlb},
+        numa{numa},
+        node_mask{node_mask} {}
+
+  bool huge_pages;
+  bool hugetlb;
+  NumaPolicy numa;
+  uint64_t node_mask;
+};
+
+// Allocator which maps memory directly from the operating system, for very
+// large arrays whose accesses are limited by TLB misses, or which must be
+// placed on particular NUMA nodes. Every allocation is rounded up to a whole
+// number of huge pages, and is aligned to a huge page boundary. Memory from
+// any PageAllocator may be freed by any other. On systems without mmap,
+// page aligned memory is taken from the heap instead.
+template <class T>
+class PageAllocator {
+ public:
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = PageAllocator<U>;
+  };
+
+  PageAllocator(const PageOptions& options = PageOptions()) noexcept;
+  template <class U>
+  PageAllocator(const PageAllocator<U>& other) noexcept;
+
+  T* allocate(size_t n);
+  void deallocate(T* p, size_t n) noexcept;
+
+  const PageOptions& options() const noexcept;
+
+ private:
+  PageOptions options_;
+};
+
+template <class T, class U>
+bool operator==(const PageAllocator<T>&, const PageAllocator<U>&) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const PageAllocator<T>&, const PageAllocator<U>&) {
+  return false;
+}
+
+template <class Alloc>
+struct is_uninitialized_allocator : std::false_type {};
+
+template <class T, class B>
+struct is_uninitialized_allocator<UninitializedAllocator<T, B>>
+    : std::true_type {};
+
+// Describes which elements of an axis are taken when slicing an array.
+struct Range {
+  // The entire axis
+  Range();
+
+  // The single element index of the axis. The axis is removed from the
+  // resulting view.
+  Range(size_t index);
+
+  // The elements [start, stop) of the axis, taking every step'th element.
+  // stop is clamped to the length of the axis.
+  Range(size_t start, size_t stop, size_t step = 1);
+
+  size_t start;
+  size_t stop;
+  size_t step;
+  bool single;
+};
+
+// Trait which is true if any of the types is a Range. This is used to pick
+// the slicing overloads of the variadic indexing operators.
+template <typename... INDS>
+struct contains_range;
+
+template <>
+struct contains_range<> : std::false_type {};
+
+template <typename I, typename... INDS>
+struct contains_range<I, INDS...>
+    : std::integral_constant<
+          bool, std::is_same<typename std::decay<I>::type, Range>::value ||
+                    contains_range<INDS...>::value> {};
+
+template <class R, typename... INDS>
+using if_indices =
+    typename std::enable_if<!contains_range<INDS...>::value, R>::type;
+
+template <class R, typename... INDS>
+using if_ranges =
+    typename std::enable_if<contains_range<INDS...>::value, R>::type;
+
+template <class T, class Alloc = std::allocator<T>>
+class NDArray;
+
+template <class T>
+class NDArrayView;
+
+template <class T>
+class NDIter;
+
+template <class T, size_t N, class Alloc = std::allocator<T>>
+class FixedNDArray;
+
+template <class T>
+class ExprTerm;
+
+template <class C>
+class ExprScalar;
+
+template <class Op, class E>
+class ExprUnary;
+
+template <class Op, class L, class R>
+class ExprBinary;
+
+// Trait which is true for the types which may be used as the operand of an
+// array expression: arrays, views, and other expressions.
+template <class E>
+struct is_array_operand : std::false_type {};
+
+template <class T, class Alloc>
+struct is_array_operand<NDArray<T, Alloc>> : std::true_type {};
+
+template <class T>
+struct is_array_operand<NDArrayView<T>> : std::true_type {};
+
+template <class T, size_t N, class Alloc>
+struct is_array_operand<FixedNDArray<T, N, Alloc>> : std::true_type {};
+
+template <class Op, class E>
+struct is_array_operand<ExprUnary<Op, E>> : std::true_type {};
+
+template <class Op, class L, class R>
+struct is_array_operand<ExprBinary<Op, L, R>> : std::true_type {};
+
+// Trait which is true for array operands which are evaluated lazily, which is
+// every array operand other than an NDArray.
+template <class E>
+struct is_array_expression : is_array_operand<E> {};
+
+template <class T, class Alloc>
+struct is_array_expression<NDArray<T, Alloc>> : std::false_type {};
+
+template <class R, class E>
+using if_array_expression =
+    typename std::enable_if<is_array_expression<E>::value, R>::type;
+
+template <class R, class E>
+using if_array_operand =
+    typename std::enable_if<is_array_operand<E>::value, R>::type;
+
+template <class R, class C>
+using if_not_array_operand =
+    typename std::enable_if<!is_array_operand<C>::value, R>::type;
+
+template <class T>
+class MappedNDArray;
+
 //==============================================================================
 // Template Class NDArray
-template <class T>
+// The elements are stored in a std::vector<T, Alloc>. Arrays with different
+// allocators may be used together in all operators and conversions.
+template <class T, class Alloc>
 class NDArray {
  public:
+  using allocator_type = Alloc;
+
   //==========================================================================
   // Constructors and Destructors
   NDArray();
-  NDArray(const std::vector<size_t>& init_shape, bool c_continuous = true);
-  NDArray(const std::vector<T>& data, const std::vector<size_t>& init_shape,
-          bool c_continuous = true);
-  NDArray(std::vector<T>&& data, const std::vector<size_t>& init_shape,
+  NDArray(const std::vector<size_t>& init_shape, bool c_continuous = true,
+          const Alloc& alloc = Alloc());
+  NDArray(const std::vector<T, Alloc>& data,
+          const std::vector<size_t>& init_shape, bool c_continuous = true);
+  NDArray(std::vector<T, Alloc>&& data, const std::vector<size_t>& init_shape,
           bool c_continuous = true);
   ~NDArray() = default;
   NDArray(const NDArray&) = default;
   NDArray(NDArray&&) = default;
 
+  // Constructs an array from an array expression or view, evaluating all of
+  // its elements in a single pass. The array is fortran continuous only if
+  // all arrays of the expression are.
+  template <class E, class = if_array_expression<void, E>>
+  NDArray(const E& expr);
+
   // Assignment Operator
   NDArray& operator=(const NDArray&) = default;
   NDArray& operator=(NDArray&&) = default;
 
+  // Assigns the elements of an array expression or view to the array. If
+  // the shape differs, the array is reallocated. If the expression reads
+  // this array through a transposed or shifted view, it is first evaluated
+  // into a temporary, so that no element is read after it is assigned.
+  template <class E>
+  if_array_expression<NDArray&, E> operator=(const E& expr);
+
+  // Returns an array of the given shape whose elements are left
+  // uninitialized if Alloc is an UninitializedAllocator, and are zero
+  // otherwise. Every element should be written before it is read.
+  static NDArray uninitialized(const std::vector<size_t>& shape,
+                               bool c_continuous = true,
+                               const Alloc& alloc = Alloc());
+
   // Static load function
   static NDArray load(const std::string& fname);
 
+  // Static load functions for the contents of a .npy file held in a stream,
+  // or in a buffer of n_bytes bytes.
+  static NDArray load(std::istream& stream);
+  static NDArray load(const void* buffer, size_t n_bytes);
+
+  // Static map functions. The file is memory mapped instead of read, so only
+  // the pages which are accessed are ever read from disk. map gives a
+  // READ_ONLY mapping, whose elements are const, and map_cow a COPY_ON_WRITE
+  // mapping, whose elements may be modified without changing the file.
+  static MappedNDArray<const T> map(const std::string& fname);
+  static MappedNDArray<T> map_cow(const std::string& fname);
+
+  // Static map function for the contents of a .npy file held in a buffer of
+  // n_bytes bytes. The returned array points directly into the buffer, which
+  // must outlive it, unless the data is misaligned or must be byte swapped.
+  // As the buffer is const, so are the elements of the returned array.
+  static MappedNDArray<const T> map(const void* buffer, size_t n_bytes);
+
+  // Static partial load functions. Only the bytes of the requested block are
+  // read from the file. ranges holds a [begin, end) pair for the leading
+  // axes, and any axes without a range are loaded in full.
+  static NDArray load_slice(
+      const std::string& fname,
+      const std::vector<std::pair<size_t, size_t>>& ranges);
+
+  // Loads the rows [begin, end) of the first axis
+  static NDArray load_rows(const std::string& fname, size_t begin,
+                           size_t end);
+
   //==========================================================================
   // Indexing
 
@@ -91,28 +594,99 @@ class NDArray {
   // Variadic indexing operators
   // Access data with array indices.
   template <typename... INDS>
-  T& operator()(INDS... inds);
+  if_indices<T&, INDS...> operator()(INDS... inds);
   template <typename... INDS>
-  const T& operator()(INDS... inds) const;
+  if_indices<const T&, INDS...> operator()(INDS... inds) const;
+
+  // Variadic slicing operators
+  // When any of the arguments is a Range, a view of the array is returned.
+  template <typename... INDS>
+  if_ranges<NDArrayView<T>, INDS...> operator()(INDS... inds);
+  template <typename... INDS>
+  if_ranges<NDArrayView<const T>, INDS...> operator()(INDS... inds) const;
 
   // Linear Indexing operators
   T& operator[](size_t i);
   const T& operator[](size_t i) const;
 
+  // Indexing without any checks of the indices, regardless of
+  // NDARRAY_NO_BOUNDS_CHECK. Exactly one index must be given per axis.
+  template <typename... INDS>
+  T& at_unchecked(INDS... inds);
+  template <typename... INDS>
+  const T& at_unchecked(INDS... inds) const;
+
+  //==========================================================================
+  // Views
+  // Views borrow the data of the array. They must not be used once the array
+  // has been reallocated, moved, or destroyed.
+
+  // Returns a view of the entire array
+  NDArrayView<T> view();
+  NDArrayView<const T> view() const;
+
+  // Returns a view of the elements selected by a Range for each of the
+  // leading axes. Axes without a Range are taken in full. Integer arguments
+  // select a single index, and remove the axis from the view.
+  NDArrayView<T> slice(const std::vector<Range>& ranges);
+  NDArrayView<const T> slice(const std::vector<Range>& ranges) const;
+
+  template <typename... INDS>
+  NDArrayView<T> slice(INDS... inds);
+  template <typename... INDS>
+  NDArrayView<const T> slice(INDS... inds) const;
+
+  // Returns a view with the order of the axes reversed
+  NDArrayView<T> transpose();
+  NDArrayView<const T> transpose() const;
+
+  // Returns a view where axis i is axis axes[i] of the array
+  NDArrayView<T> permute(const std::vector<size_t>& axes);
+  NDArrayView<const T> permute(const std::vector<size_t>& axes) const;
+
+  // Returns a copy of the array stored in c continuous or fortran continuous
+  // order
+  NDArray as_c_contiguous() const;
+  NDArray as_fortran_contiguous() const;
+
   //==========================================================================
   // Constant Methods
 
   // Return underlying data vector
-  std::vector<T>& data_vector();
-  const std::vector<T>& data_vector() const;
+  std::vector<T, Alloc>& data_vector();
+  const std::vector<T, Alloc>& data_vector() const;
+
+  // Return a copy of the allocator used for the data
+  Alloc get_allocator() const;
 
   // Return pointer to beginning of data
   T* data();
   const T* data() const;
 
+  // Iterators over the elements in memory order, for use with the algorithms
+  // of the standard library
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  iterator begin();
+  iterator end();
+  const_iterator begin() const;
+  const_iterator end() const;
+  const_iterator cbegin() const;
+  const_iterator cend() const;
+
+  // Returns an iterator over the elements in memory order, which keeps track
+  // of the index of each element
+  NDIter<T> nditer();
+  NDIter<const T> nditer() const;
+
   // Return vector describing shape of array
   const std::vector<size_t>& shape() const;
 
+  // Return vector of the distance between consecutive elements along each
+  // axis, in elements
+  const std::vector<size_t>& strides() const;
+
   // Return number of elements in array
   size_t size() const;
 
@@ -125,8 +699,56 @@ class NDArray {
   // and false if fortran continuous (column-major order)
   bool c_continuous() const;
 
-  // Save array to the file fname.npy
-  void save(const std::string& fname) const;
+  // Save array to the file fname
+  void save(const std::string& fname,
+            const NpyWriteOptions& options = NpyWriteOptions()) const;
+
+  // Write array to a stream, in the .npy format
+  void save(std::ostream& stream) const;
+
+  // Save array to the file fname on a background thread. The writes of all
+  // arrays are run one after another by a single thread, in the order of
+  // the calls. The returned future becomes ready once the file is written,
+  // and rethrows any error from get(). It does not wait for the write when
+  // destroyed, so it may be discarded, and writes still queued are finished
+  // before the program exits normally. If snapshot is true, the data is
+  // first copied, and the array may be modified or destroyed immediately.
+  // If snapshot is false, the data is borrowed, and the array must not be
+  // modified, reshaped, reallocated, moved, or destroyed until the future
+  // is ready.
+  std::future<void> save_async(
+      const std::string& fname, bool snapshot = true,
+      const NpyWriteOptions& options = NpyWriteOptions()) const;
+
+  //==========================================================================
+  // Reductions
+  // The elements are visited in memory order, for either layout, so that
+  // each reduction is a single streaming pass. Sums are computed by pairwise
+  // summation, and large arrays are split among threads as set by
+  // execution_settings().
+
+  // Return the sum, mean, minimum, or maximum of all elements. As in NumPy,
+  // the minimum and maximum are NaN if any element is NaN.
+  T sum() const;
+  T mean() const;
+  T min() const;
+  T max() const;
+
+  // Return the linear index of the smallest or largest element. If several
+  // elements are equal, the index of the first in memory is returned. If any
+  // element is NaN, the index of the first NaN is returned, as in NumPy.
+  size_t argmin() const;
+  size_t argmax() const;
+
+  // Reductions along a single axis, which is removed from the shape of the
+  // returned array. The returned array has the same layout as this one. NaN
+  // is handled in each lane of the axis as it is for the whole array.
+  NDArray sum(size_t axis) const;
+  NDArray mean(size_t axis) const;
+  NDArray min(size_t axis) const;
+  NDArray max(size_t axis) const;
+  NDArray<size_t> argmin(size_t axis) const;
+  NDArray<size_t> argmax(size_t axis) const;
 
   //==========================================================================
   // Non-Constant Methods
@@ -143,1234 +765,7879 @@ class NDArray {
 
   //==========================================================================
   // Operators for Any Type (Same or Different)
-  template <class C>
-  NDArray& operator+=(const NDArray<C>& a);
-  template <class C>
-  NDArray& operator-=(const NDArray<C>& a);
-  template <class C>
-  NDArray& operator*=(const NDArray<C>& a);
-  template <class C>
-  NDArray& operator/=(const NDArray<C>& a);
+  template <class C, class A>
+  NDArray& operator+=(const NDArray<C, A>& a);
+  template <class C, class A>
+  NDArray& operator-=(const NDArray<C, A>& a);
+  template <class C, class A>
+  NDArray& operator*=(const NDArray<C, A>& a);
+  template <class C, class A>
+  NDArray& operator/=(const NDArray<C, A>& a);
+
+  //==========================================================================
+  // Operators for Array Expressions and Views
+  template <class E>
+  if_array_expression<NDArray&, E> operator+=(const E& expr);
+  template <class E>
+  if_array_expression<NDArray&, E> operator-=(const E& expr);
+  template <class E>
+  if_array_expression<NDArray&, E> operator*=(const E& expr);
+  template <class E>
+  if_array_expression<NDArray&, E> operator/=(const E& expr);
 
   //==========================================================================
   // Operators for Constants
   template <class C>
-  NDArray& operator+=(const C& c);
+  if_not_array_operand<NDArray&, C> operator+=(const C& c);
   template <class C>
-  NDArray& operator-=(const C& c);
+  if_not_array_operand<NDArray&, C> operator-=(const C& c);
   template <class C>
-  NDArray& operator*=(const C& c);
+  if_not_array_operand<NDArray&, C> operator*=(const C& c);
   template <class C>
-  NDArray& operator/=(const C& c);
+  if_not_array_operand<NDArray&, C> operator/=(const C& c);
 
   //==========================================================================
   // Conversion Operator
-  template <class C>
-  operator NDArray<C>() const;
+  template <class C, class A>
+  operator NDArray<C, A>() const;
 
  private:
-  std::vector<T> data_;
+  std::vector<T, Alloc> data_;
   std::vector<size_t> shape_;
+  std::vector<size_t> strides_;
   bool c_continuous_;
   size_t dimensions_;
 
-  template <class C>
+  template <class C, class A>
   friend class NDArray;
 
-  size_t c_continuous_index(const std::vector<size_t>& indices) const;
-
-  size_t fortran_continuous_index(const std::vector<size_t>& indices) const;
-
-  template <size_t D>
-  inline size_t c_continuous_index(const std::array<size_t, D>& indices) const;
-
-  template <size_t D>
-  inline size_t fortran_continuous_index(
-      const std::array<size_t, D>& indices) const;
+  // Constructs an array whose elements are constructed by the allocator
+  // without arguments, as for uninitialized
+  struct UninitializedTag {};
+  NDArray(const std::vector<size_t>& init_shape, bool c_continuous,
+          const Alloc& alloc, UninitializedTag);
+
+  // Computes strides_ from shape_ and the layout. This must be called
+  // whenever either changes.
+  void compute_strides();
+
+  // Returns the linear index of the element at indices, checking them unless
+  // NDARRAY_NO_BOUNDS_CHECK is defined
+  template <class IndexContainer>
+  size_t strided_index(const IndexContainer& indices) const;
+
+  template <class IndexContainer>
+  size_t unchecked_index(const IndexContainer& indices) const;
+
+  // Returns the shape of this array without axis, after checking that the
+  // axis exists
+  std::vector<size_t> reduced_shape(size_t axis) const;
+
+  // Returns an uninitialized array with the shape of this one without axis,
+  // after checking that the axis exists
+  NDArray reduced_array(size_t axis) const;
+
+  // Returns the index of the first smallest element if Compare is std::less,
+  // or of the first largest element if it is std::greater, where NaN is
+  // more extreme than any number, as for more_extreme
+  template <class Compare>
+  size_t extreme_index() const;
+
+  // Returns the smallest or largest element, as extreme_index, without
+  // keeping track of its index
+  template <class Compare>
+  T extreme_value() const;
+
+  // Writes the value and index along axis of the first smallest (or largest)
+  // element of every lane of the axis to values and indices. Either may be
+  // null if it is not wanted.
+  template <class Compare>
+  void extreme_axis(size_t axis, T* values, size_t* indices) const;
 };
 
 //==============================================================================
-// Declarations for NPY functions
+// Template Class NDArrayView
+// Non-owning view of the elements of an array, described by a pointer to the
+// first element, along with the shape and the strides (in elements) of each
+// axis. Views are created by slicing an NDArray, and borrow its data: a view
+// must not be used once the array it was created from has been reallocated,
+// moved, or destroyed. Views of a const NDArray have type NDArrayView<const T>.
+template <class T>
+class NDArrayView {
+ public:
+  using value_type = typename std::remove_const<T>::type;
 
-// Enum of possible data types handeled by this implementation.
-enum class DType {
-  CHAR,
-  UCHAR,
-  INT16,
-  INT32,
-  INT64,
-  UINT16,
-  UINT32,
-  UINT64,
-  FLOAT32,
-  DOUBLE64,
-  COMPLEX64,
-  COMPLEX128
-};
+  //==========================================================================
+  // Constructors and Destructors
+  // data points to the beginning of the parent array, and offset is the
+  // position of the first element of the view from data, in bytes.
+  NDArrayView(T* data, size_t offset, const std::vector<size_t>& shape,
+              const std::vector<std::ptrdiff_t>& strides);
 
-// Function which opens file fname, and loads in the binary data into 1D
-// array of chars, which must latter be type cast be the user. The char* to
-// the data is returned as a reference, along with the number of elements,
-// continuits, and element size in bytes. Returned is a vector for the shape.
-void load_npy(const std::string& fname, char*& data_ptr, std::vector<size_t>& shape,
-              DType& dtype, bool& c_contiguous);
+  // A view of non-constant elements may be used as a view of constant ones
+  template <class C, class = typename std::enable_if<
+                         std::is_same<const C, T>::value>::type>
+  NDArrayView(const NDArrayView<C>& other);
 
-// Function which writes binary data to a Numpy .npy file.
-void write_npy(const std::string& fname, const char* data_ptr,
-               const std::vector<size_t>& shape, DType dtype, bool c_contiguous);
+  //==========================================================================
+  // Indexing
 
-// Returns the proper DType for a given Numpy dtype.descr string.
-DType descr_to_DType(const std::string& dtype);
+  // Indexing operator for indexing with vector
+  T& operator()(const std::vector<size_t>& indices) const;
 
-// Returns Numpy descr string for given DType
-std::string DType_to_descr(DType dtype);
+  // Variadic indexing operator
+  template <typename... INDS>
+  if_indices<T&, INDS...> operator()(INDS... inds) const;
 
-// Returns the number of bytes used to represent the provided DType.
-size_t size_of_DType(DType dtype);
+  // Variadic slicing operator, returning a view of this view
+  template <typename... INDS>
+  if_ranges<NDArrayView, INDS...> operator()(INDS... inds) const;
 
-// Function to check wether or not host system is little-endian or not
-bool system_is_little_endian();
+  // Returns a view of the elements selected by a Range for each of the
+  // leading axes, as for NDArray::slice.
+  NDArrayView slice(const std::vector<Range>& ranges) const;
 
-// Function to switch bye order of data for an array which contains
-// n_elements, each with element_size bytes. The size of data should
-// therefore be n_elements*element_size; if not, this is undefined behavior.
-void swap_bytes(char* data, uint64_t n_elements, size_t element_size);
+  template <typename... INDS>
+  NDArrayView slice(INDS... inds) const;
 
-// Swaps the first and second byte pointed to by char* bytes.
-void swap_two_bytes(char* bytes);
+  // Returns a view with the order of the axes reversed
+  NDArrayView transpose() const;
 
-// Swaps the first four bytes pointed to by char* bytes.
-void swap_four_bytes(char* bytes);
+  // Returns a view where axis i is axis axes[i] of this view
+  NDArrayView permute(const std::vector<size_t>& axes) const;
 
-// Swaps the first eight bytes pointed to by char* bytes.
-void swap_eight_bytes(char* bytes);
+  //==========================================================================
+  // Constant Methods
 
-// Swaps the first sixteen bytes pointed to by char* bytes.
-void swap_sixteen_bytes(char* bytes);
+  // Return pointer to the first element of the view
+  T* data() const;
 
-//==============================================================================
-// NDArray Implementation
-template <class T>
-NDArray<T>::NDArray():data_{}, shape_{}, c_continuous_{true}, dimensions_{0} {}
+  // Return the position of the first element from the beginning of the
+  // parent array, in bytes
+  size_t offset() const;
 
-template <class T>
-NDArray<T>::NDArray(const std::vector<size_t>& init_shape, bool c_continuous) {
-  if (init_shape.size() > 0) {
-    shape_ = init_shape;
-    dimensions_ = shape_.size();
+  // Return vector describing shape of view
+  const std::vector<size_t>& shape() const;
 
-    size_t ne = init_shape[0];
-    for (size_t i = 1; i < dimensions_; i++) {
-      ne *= init_shape[i];
-    }
+  // Return vector of the distance between consecutive elements along each
+  // axis, in elements
+  const std::vector<std::ptrdiff_t>& strides() const;
 
-    data_.resize(ne);
+  // Return number of elements in view
+  size_t size() const;
 
-    c_continuous_ = c_continuous;
+  // Returns an iterator over the elements in memory order, which keeps track
+  // of the index of each element
+  NDIter<T> nditer() const;
 
-  } else {
-    std::string mssg = "NDArray shape vector must have at least one element.";
-    throw std::runtime_error(mssg);
-  }
-}
+  // Returns true if the elements of the view are contiguous in memory, in
+  // c continuous (row-major) or fortran continuous (column-major) order
+  bool c_continuous() const;
+  bool fortran_continuous() const;
 
-template <class T>
-NDArray<T>::NDArray(const std::vector<T>& data, const std::vector<size_t>& init_shape,
-                    bool c_continuous) {
-  if (init_shape.size() > 0) {
-    shape_ = init_shape;
-    dimensions_ = shape_.size();
+  // Copies the elements of the view into a new c continuous NDArray
+  NDArray<value_type> copy() const;
 
-    size_t ne = init_shape[0];
-    for (size_t i = 1; i < dimensions_; i++) {
-      ne *= init_shape[i];
-    }
+  // Copies the elements of the view into a new c continuous or fortran
+  // continuous NDArray
+  NDArray<value_type> as_c_contiguous() const;
+  NDArray<value_type> as_fortran_contiguous() const;
 
-    if (ne != data.size()) {
-      std::string mssg =
-          "Shape is incompatible with number of elements provided for NDArray.";
-      throw std::runtime_error(mssg);
-    }
+  //==========================================================================
+  // Non-Constant Methods
+  // These modify the elements of the parent array.
 
-    data_ = data;
+  // Fills all elements of the view with the value provided
+  void fill(const value_type& val) const;
 
-    c_continuous_ = c_continuous;
+  //==========================================================================
+  // Operators for Arrays and Views of Any Type (Same or Different)
+  template <class C, class A>
+  const NDArrayView& operator+=(const NDArray<C, A>& a) const;
+  template <class C, class A>
+  const NDArrayView& operator-=(const NDArray<C, A>& a) const;
+  template <class C, class A>
+  const NDArrayView& operator*=(const NDArray<C, A>& a) const;
+  template <class C, class A>
+  const NDArrayView& operator/=(const NDArray<C, A>& a) const;
 
-  } else {
-    std::string mssg =
-        "Shape vector must have at least one element for NDArray.";
-    throw std::runtime_error(mssg);
-  }
-}
-
-template <class T>
-NDArray<T>::NDArray(std::vector<T>&& data, const std::vector<size_t>& init_shape,
-                    bool c_continuous) {
-  if (init_shape.size() > 0) {
-    shape_ = init_shape;
-    dimensions_ = shape_.size();
+  template <class C>
+  const NDArrayView& operator+=(const NDArrayView<C>& a) const;
+  template <class C>
+  const NDArrayView& operator-=(const NDArrayView<C>& a) const;
+  template <class C>
+  const NDArrayView& operator*=(const NDArrayView<C>& a) const;
+  template <class C>
+  const NDArrayView& operator/=(const NDArrayView<C>& a) const;
 
-    size_t ne = init_shape[0];
-    for (size_t i = 1; i < dimensions_; i++) {
-      ne *= init_shape[i];
-    }
+  template <class E>
+  if_array_expression<const NDArrayView&, E> operator+=(const E& expr) const;
+  template <class E>
+  if_array_expression<const NDArrayView&, E> operator-=(const E& expr) const;
+  template <class E>
+  if_array_expression<const NDArrayView&, E> operator*=(const E& expr) const;
+  template <class E>
+  if_array_expression<const NDArrayView&, E> operator/=(const E& expr) const;
 
-    if (ne != data.size()) {
-      std::string mssg =
-          "Shape is incompatible with number of elements provided for NDArray.";
-      throw std::runtime_error(mssg);
-    }
+  //==========================================================================
+  // Operators for Constants
+  template <class C>
+  if_not_array_operand<const NDArrayView&, C> operator+=(const C& c) const;
+  template <class C>
+  if_not_array_operand<const NDArrayView&, C> operator-=(const C& c) const;
+  template <class C>
+  if_not_array_operand<const NDArrayView&, C> operator*=(const C& c) const;
+  template <class C>
+  if_not_array_operand<const NDArrayView&, C> operator/=(const C& c) const;
 
-    data_ = std::move(data);
+ private:
+  T* data_;
+  size_t offset_;
+  std::vector<size_t> shape_;
+  std::vector<std::ptrdiff_t> strides_;
+  size_t size_;
 
-    c_continuous_ = c_continuous;
+  template <class C>
+  friend class NDArrayView;
 
-  } else {
-    std::string mssg =
-        "Shape vector must have at least one element for NDArray.";
-    throw std::runtime_error(mssg);
-  }
-}
+  template <class IndexContainer>
+  std::ptrdiff_t strided_index(const IndexContainer& indices) const;
 
+  // Applies func(element, other_element) to every element of the view, and
+  // the corresponding element of a, which is broadcast to the same shape.
+  template <class C, class F>
+  void apply(const NDArrayView<C>& a, const std::string& op, F func) const;
+};
 
+//==============================================================================
+// Template Class NDIter
+// Iterator over the elements of an array or view in the order in which they
+// are stored, for either layout, which keeps track of the index of the
+// current element. The index is updated in place as the iterator advances,
+// without recomputing any strides. Consecutive axes which are contiguous
+// with each other are coalesced into runs of elements with a single stride,
+// so that the elements may also be visited run by run, with a plain loop
+// over each run:
+//
+//   for (auto it = a.nditer(); !it.done(); it.next_run()) {
+//     double* p = it.run_data();
+//     for (size_t i = 0; i < it.run_size(); i++) p[i * it.run_stride()] = 0;
+//   }
+//
+// The runs of a contiguous array hold all of its elements.
 template <class T>
-NDArray<T> NDArray<T>::load(const std::string &fname) {
-  // Get expected DType according to T
-  DType expected_dtype;
-  const char* T_type_name = typeid(T).name();
-
-  if (T_type_name == typeid(char).name())
-    expected_dtype = DType::CHAR;
-  else if (T_type_name == typeid(unsigned char).name())
-    expected_dtype = DType::UCHAR;
-  else if (T_type_name == typeid(uint16_t).name())
-    expected_dtype = DType::UINT16;
-  else if (T_type_name == typeid(uint32_t).name())
-    expected_dtype = DType::UINT32;
-  else if (T_type_name == typeid(uint64_t).name())
-    expected_dtype = DType::UINT64;
-  else if (T_type_name == typeid(int16_t).name())
-    expected_dtype = DType::INT16;
-  else if (T_type_name == typeid(int32_t).name())
-    expected_dtype = DType::INT32;
-  else if (T_type_name == typeid(int64_t).name())
-    expected_dtype = DType::INT64;
-  else if (T_type_name == typeid(float).name())
-    expected_dtype = DType::FLOAT32;
-  else if (T_type_name == typeid(double).name())
-    expected_dtype = DType::DOUBLE64;
-  else if (T_type_name == typeid(std::complex<float>).name())
-    expected_dtype = DType::COMPLEX64;
-  else if (T_type_name == typeid(std::complex<double>).name())
-    expected_dtype = DType::COMPLEX128;
-  else {
-    std::string mssg = "The datatype is not supported for NDArray.";
-    throw std::runtime_error(mssg);
-  }
+class NDIter {
+ public:
+  // data points to the first element, and strides are in elements
+  NDIter(T* data, const std::vector<size_t>& shape,
+         const std::vector<std::ptrdiff_t>& strides);
 
-  // Variables to send to npy function
-  char* data_ptr;
-  std::vector<T> data_vector;
-  std::vector<size_t> data_shape;
-  DType data_dtype;
-  bool data_c_continuous;
+  // Returns true once every element has been visited
+  bool done() const;
 
-  // Load data into variables
-  load_npy(fname, data_ptr, data_shape, data_dtype, data_c_continuous);
+  // Current element
+  T& operator*() const;
+  T* operator->() const;
 
-  // Ensure DType variables match
-  if (expected_dtype != data_dtype) {
-    std::string mssg =
-        "NDArray template datatype does not match specified datatype in npy "
-        "file.";
-    throw std::runtime_error(mssg);
-  }
+  // Index of the current element along each axis of the array
+  const std::vector<size_t>& index() const;
 
-  if (data_shape.size() < 1) {
-    std::string mssg =
-        "Shape vector must have at least one element for NDArray.";
-    throw std::runtime_error(mssg);
-  }
+  // Advances to the next element
+  NDIter& operator++();
 
-  // Number of elements
-  size_t ne = data_shape[0];
-  for (size_t i = 1; i < data_shape.size(); i++) {
-    ne *= data_shape[i];
-  }
+  // The current run begins at the current element, and continues for
+  // run_size() elements, run_stride() elements apart
+  T* run_data() const;
+  size_t run_size() const;
+  std::ptrdiff_t run_stride() const;
 
-  data_vector = {reinterpret_cast<T*>(data_ptr),
-                 reinterpret_cast<T*>(data_ptr) + ne};
+  // Advances to the first element after the current run
+  void next_run();
 
-  // Free data_ptr
-  delete[] data_ptr;
+ private:
+  T* run_start_;
+  T* ptr_;
+  std::vector<size_t> shape_;
+  std::vector<std::ptrdiff_t> strides_;
+  std::vector<size_t> index_;
+  // Axes from the fastest varying in memory to the slowest, of which the
+  // first n_run_axes_ form a run
+  std::vector<size_t> order_;
+  size_t n_run_axes_;
+  size_t run_length_;
+  std::ptrdiff_t run_stride_;
+  size_t run_pos_;
+  bool done_;
+};
 
-  // Create NDArray object
-  NDArray<T> return_object(std::move(data_vector), data_shape);
-  return_object.c_continuous_ = data_c_continuous;
+//==============================================================================
+// Template Class FixedNDArray
+// Array with a number of dimensions N fixed at compile time. The shape and
+// the strides are held in std::arrays, with the strides computed once when
+// the shape is set, so that indexing with N indices unrolls to a single sum
+// of products. Indexing with the wrong number of indices does not compile.
+// FixedNDArray may be used as an operand of array expressions, and is
+// converted to an NDArray, or from any array operand of rank N, by
+// evaluating it as an expression.
+template <class T, size_t N, class Alloc>
+class FixedNDArray {
+  static_assert(N > 0, "FixedNDArray must have at least one dimension.");
 
-  // Return object
-  return return_object;
-}
+ public:
+  using allocator_type = Alloc;
 
-template <class T>
-NDARRAY_INLINE T& NDArray<T>::operator()(const std::vector<size_t>& indices) {
-  size_t indx;
-  if (c_continuous_) {
-    // Get linear index for row-major order
-    indx = c_continuous_index(indices);
-  } else {
-    // Get linear index for column-major order
-    indx = fortran_continuous_index(indices);
-  }
-  return data_[indx];
-}
+  //==========================================================================
+  // Constructors and Destructors
+  FixedNDArray();
+  FixedNDArray(const std::array<size_t, N>& init_shape,
+               bool c_continuous = true, const Alloc& alloc = Alloc());
+  ~FixedNDArray() = default;
+  FixedNDArray(const FixedNDArray&) = default;
+  FixedNDArray(FixedNDArray&&) = default;
+
+  // Constructs an array from an NDArray, view, or array expression, which
+  // must have N dimensions. The layout is kept, as for NDArray.
+  template <class E, class = if_array_operand<void, E>>
+  FixedNDArray(const E& expr);
 
-template <class T>
-NDARRAY_INLINE const T& NDArray<T>::operator()(
-    const std::vector<size_t>& indices) const {
-  size_t indx;
-  if (c_continuous_) {
-    // Get linear index for row-major order
-    indx = c_continuous_index(indices);
-  } else {
-    // Get linear index for column-major order
-    indx = fortran_continuous_index(indices);
-  }
-  return data_[indx];
-}
+  // Assignment Operator
+  FixedNDArray& operator=(const FixedNDArray&) = default;
+  FixedNDArray& operator=(FixedNDArray&&) = default;
 
-template <class T>
-template <typename... INDS>
-NDARRAY_INLINE T& NDArray<T>::operator()(INDS... inds) {
-  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  // Assigns the elements of an array operand of N dimensions. If the shape
+  // differs, the array is reallocated.
+  template <class E>
+  if_array_operand<FixedNDArray&, E> operator=(const E& expr);
 
-  size_t indx;
-  if (c_continuous_) {
-    // Get linear index for row-major order
-    indx = c_continuous_index(indices);
-  } else {
-    // Get linear index for column-major order
-    indx = fortran_continuous_index(indices);
-  }
-  return data_[indx];
-}
+  //==========================================================================
+  // Indexing
 
-template <class T>
-template <typename... INDS>
-NDARRAY_INLINE const T& NDArray<T>::operator()(INDS... inds) const {
-  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  // Indexing operators for indexing with array
+  T& operator()(const std::array<size_t, N>& indices);
+  const T& operator()(const std::array<size_t, N>& indices) const;
 
-  size_t indx;
-  if (c_continuous_) {
-    // Get linear index for row-major order
-    indx = c_continuous_index(indices);
-  } else {
-    // Get linear index for column-major order
-    indx = fortran_continuous_index(indices);
-  }
-  return data_[indx];
-}
+  // Variadic indexing operators
+  template <typename... INDS>
+  if_indices<T&, INDS...> operator()(INDS... inds);
+  template <typename... INDS>
+  if_indices<const T&, INDS...> operator()(INDS... inds) const;
 
-template <class T>
-NDARRAY_INLINE T& NDArray<T>::operator[](size_t i) {
-  return data_[i];
-}
+  // Variadic slicing operators
+  template <typename... INDS>
+  if_ranges<NDArrayView<T>, INDS...> operator()(INDS... inds);
+  template <typename... INDS>
+  if_ranges<NDArrayView<const T>, INDS...> operator()(INDS... inds) const;
 
-template <class T>
-NDARRAY_INLINE const T& NDArray<T>::operator[](size_t i) const {
-  return data_[i];
-}
+  // Linear Indexing operators
+  T& operator[](size_t i);
+  const T& operator[](size_t i) const;
 
-template <class T>
-NDARRAY_INLINE std::vector<T>& NDArray<T>::data_vector() {
-  return data_;
-}
+  // Indexing without any checks of the indices, regardless of
+  // NDARRAY_NO_BOUNDS_CHECK
+  template <typename... INDS>
+  T& at_unchecked(INDS... inds);
+  template <typename... INDS>
+  const T& at_unchecked(INDS... inds) const;
 
-template <class T>
-NDARRAY_INLINE const std::vector<T>& NDArray<T>::data_vector() const {
-  return data_;
-}
+  // Returns a view of the entire array
+  NDArrayView<T> view();
+  NDArrayView<const T> view() const;
 
-template <class T>
-NDARRAY_INLINE T* NDArray<T>::data() {
-  return data_.data();
-}
+  //==========================================================================
+  // Constant Methods
 
-template <class T>
-NDARRAY_INLINE const T* NDArray<T>::data() const {
-  return data_.data();
-}
+  // Return a copy of the allocator used for the data
+  Alloc get_allocator() const;
 
-template <class T>
-NDARRAY_INLINE const std::vector<size_t>& NDArray<T>::shape() const {
-  return shape_;
-}
+  // Return pointer to beginning of data
+  T* data();
+  const T* data() const;
 
-template <class T>
-NDARRAY_INLINE size_t NDArray<T>::size() const {
-  return data_.size();
-}
+  // Iterators over the elements in memory order, for use with the algorithms
+  // of the standard library
+  using iterator = T*;
+  using const_iterator = const T*;
 
-template <class T>
-NDARRAY_INLINE size_t
-NDArray<T>::linear_index(const std::vector<size_t>& indices) const {
-  if (c_continuous_) {
-    // Get linear index for row-major order
-    return c_continuous_index(indices);
-  } else {
-    // Get linear index for column-major order
-    return fortran_continuous_index(indices);
-  }
-}
+  iterator begin();
+  iterator end();
+  const_iterator begin() const;
+  const_iterator end() const;
+  const_iterator cbegin() const;
+  const_iterator cend() const;
 
-template <class T>
-template <typename... INDS>
-NDARRAY_INLINE size_t NDArray<T>::linear_index(INDS... inds) const {
-  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  // Return array describing shape of array
+  const std::array<size_t, N>& shape() const;
 
-  if (c_continuous_) {
-    // Get linear index for row-major order
-    return c_continuous_index(indices);
-  } else {
-    // Get linear index for column-major order
-    return fortran_continuous_index(indices);
-  }
-}
+  // Return array of the distance between consecutive elements along each
+  // axis, in elements
+  const std::array<size_t, N>& strides() const;
 
-template <class T>
-NDARRAY_INLINE bool NDArray<T>::c_continuous() const {
-  return c_continuous_;
-}
+  // Return number of elements in array
+  size_t size() const;
 
-template <class T>
-void NDArray<T>::save(const std::string& fname) const {
-  // Get expected DType according to T
-  DType dtype;
-  const char* T_type_name = typeid(T).name();
-
-  if (T_type_name == typeid(char).name())
-    dtype = DType::CHAR;
-  else if (T_type_name == typeid(unsigned char).name())
-    dtype = DType::UCHAR;
-  else if (T_type_name == typeid(uint16_t).name())
-    dtype = DType::UINT16;
-  else if (T_type_name == typeid(uint32_t).name())
-    dtype = DType::UINT32;
-  else if (T_type_name == typeid(uint64_t).name())
-    dtype = DType::UINT64;
-  else if (T_type_name == typeid(int16_t).name())
-    dtype = DType::INT16;
-  else if (T_type_name == typeid(int32_t).name())
-    dtype = DType::INT32;
-  else if (T_type_name == typeid(int64_t).name())
-    dtype = DType::INT64;
-  else if (T_type_name == typeid(float).name())
-    dtype = DType::FLOAT32;
-  else if (T_type_name == typeid(double).name())
-    dtype = DType::DOUBLE64;
-  else if (T_type_name == typeid(std::complex<float>).name())
-    dtype = DType::COMPLEX64;
-  else if (T_type_name == typeid(std::complex<double>).name())
-    dtype = DType::COMPLEX128;
-  else {
-    std::string mssg = "The datatype is not supported for NDArray.";
-    throw std::runtime_error(mssg);
-  }
+  size_t linear_index(const std::array<size_t, N>& indices) const;
 
-  // Write data to file
-  write_npy(fname, reinterpret_cast<const char*>(data_.data()), shape_, dtype,
-            c_continuous_);
-}
+  template <typename... INDS>
+  size_t linear_index(INDS... inds) const;
 
-template <class T>
-void NDArray<T>::fill(const T& val) {
-  std::fill(data_.begin(), data_.end(), val);
-}
+  // Returns true if data is stored as c continuous (row-major order),
+  // and false if fortran continuous (column-major order)
+  bool c_continuous() const;
 
-template <class T>
-void NDArray<T>::reshape(const std::vector<size_t>& new_shape) {
-  // Ensure new shape has proper dimensions
-  if (new_shape.size() < 1) {
-    std::string mssg =
-        "Shape vector must have at least one element to"
-        " reshpae NDArray.";
-    throw std::runtime_error(mssg);
-  } else {
-    size_t ne = new_shape[0];
+  //==========================================================================
+  // Non-Constant Methods
 
-    for (size_t i = 1; i < new_shape.size(); i++) {
-      ne *= new_shape[i];
-    }
+  // Fills entire array with the value provided
+  void fill(const T& val);
 
-    if (ne == data_.size()) {
-      shape_ = new_shape;
-      dimensions_ = shape_.size();
-    } else {
-      std::string mssg =
-          "Shape is incompatible with number of elements in"
-          " NDArray.";
-      throw std::runtime_error(mssg);
-    }
-  }
-}
+  // Will reshape the array to the given dimensions
+  void reshape(const std::array<size_t, N>& new_shape);
 
-template <class T>
-void NDArray<T>::reallocate(const std::vector<size_t>& new_shape) {
-  // Ensure new shape has proper dimensions
-  if (new_shape.size() < 1) {
-    std::string mssg =
-        "Shape vector must have at least one element to"
-        " reallocate NDArray.";
-    throw std::runtime_error(mssg);
-  } else {
-    size_t ne = new_shape[0];
+  // Realocates array to fit the new size.
+  // DATA CAN BE LOST IF ARRAY IS SHRUNK
+  void reallocate(const std::array<size_t, N>& new_shape);
 
-    for (size_t i = 1; i < new_shape.size(); i++) {
-      ne *= new_shape[i];
-    }
+  //==========================================================================
+  // Operators for Arrays, Views, Array Expressions, and Constants
+  // These are applied through a view of the entire array.
+  template <class C>
+  FixedNDArray& operator+=(const C& c);
+  template <class C>
+  FixedNDArray& operator-=(const C& c);
+  template <class C>
+  FixedNDArray& operator*=(const C& c);
+  template <class C>
+  FixedNDArray& operator/=(const C& c);
 
-    shape_ = new_shape;
-    dimensions_ = shape_.size();
-    data_.resize(ne);
+ private:
+  std::vector<T, Alloc> data_;
+  std::array<size_t, N> shape_;
+  std::array<size_t, N> strides_;
+  bool c_continuous_;
+
+  // Sets the shape, and computes the strides for the current layout
+  void set_shape(const std::array<size_t, N>& new_shape);
+
+  std::vector<size_t> shape_vector() const;
+};
+
+//==============================================================================
+// Array Expressions
+// Arithmetic between arrays, views, and scalars, and the math functions
+// below, return lazy expressions instead of new arrays. No elements are
+// computed until the expression is assigned to an NDArray (or added to one,
+// etc.), at which point every element of the result is evaluated in a single
+// loop, without any temporary arrays. Expressions refer to the arrays they
+// were built from, and should be evaluated within the same statement.
+
+// Operations which may appear in an expression
+struct ExprAdd {
+  static const char* name() { return "add"; }
+  template <class A, class B>
+  static auto apply(const A& a, const B& b) -> decltype(a + b) {
+    return a + b;
   }
-}
+  template <class A, class B>
+  static void assign(A& a, const B& b) {
+    a += b;
+  }
+};
 
-template <class T>
-template <class C>
-NDArray<T>& NDArray<T>::operator+=(const NDArray<C>& a) {
-  // Ensure same number of dimensions
-  if (dimensions_ != a.dimensions_) {
-    std::string mssg = "Cannot add two NDArrays with different dimensions.";
-    throw std::runtime_error(mssg);
+struct ExprSubtract {
+  static const char* name() { return "subtract"; }
+  template <class A, class B>
+  static auto apply(const A& a, const B& b) -> decltype(a - b) {
+    return a - b;
+  }
+  template <class A, class B>
+  static void assign(A& a, const B& b) {
+    a -= b;
   }
+};
 
-  // Ensure same shape
-  for (size_t i = 0; i < dimensions_; i++) {
-    if (shape_[i] != a.shape_[i]) {
-      std::string mssg = "Cannot add two NDArrays with different shapes";
-      throw std::runtime_error(mssg);
-    }
+struct ExprMultiply {
+  static const char* name() { return "multiply"; }
+  template <class A, class B>
+  static auto apply(const A& a, const B& b) -> decltype(a * b) {
+    return a * b;
   }
+  template <class A, class B>
+  static void assign(A& a, const B& b) {
+    a *= b;
+  }
+};
 
-  // Do addition
-  for (size_t i = 0; i < data_.size(); i++) {
-    data_[i] += a.data_[i];
+struct ExprDivide {
+  static const char* name() { return "divide"; }
+  template <class A, class B>
+  static auto apply(const A& a, const B& b) -> decltype(a / b) {
+    return a / b;
+  }
+  template <class A, class B>
+  static void assign(A& a, const B& b) {
+    a /= b;
   }
+};
 
-  return *this;
-}
+struct ExprPow {
+  static const char* name() { return "raise"; }
+  template <class A, class B>
+  static auto apply(const A& a, const B& b) -> decltype(std::pow(a, b)) {
+    return std::pow(a, b);
+  }
+};
 
-template <class T>
-template <class C>
-NDArray<T>& NDArray<T>::operator-=(const NDArray<C>& a) {
-  // Ensure same number of dimensions
-  if (dimensions_ != a.dimensions_) {
-    std::string mssg =
-        "Cannot subtract two NDArrays with different dimensions.";
-    throw std::runtime_error(mssg);
+struct ExprNegate {
+  template <class A>
+  static auto apply(const A& a) -> decltype(-a) {
+    return -a;
   }
+};
 
-  // Ensure same shape
-  for (size_t i = 0; i < dimensions_; i++) {
-    if (shape_[i] != a.shape_[i]) {
-      std::string mssg = "Cannot subtract two NDArrays with different shapes";
-      throw std::runtime_error(mssg);
-    }
+struct ExprAbs {
+  template <class A>
+  static auto apply(const A& a) -> decltype(std::abs(a)) {
+    return std::abs(a);
   }
+};
 
-  // Do subtraction
-  for (size_t i = 0; i < data_.size(); i++) {
-    data_[i] -= a.data_[i];
+struct ExprSqrt {
+  template <class A>
+  static auto apply(const A& a) -> decltype(std::sqrt(a)) {
+    return std::sqrt(a);
   }
+};
 
-  return *this;
-}
-
-template <class T>
-template <class C>
-NDArray<T>& NDArray<T>::operator*=(const NDArray<C>& a) {
-  // Ensure same number of dimensions
-  if (dimensions_ != a.dimensions_) {
-    std::string mssg =
-        "Cannot multiply two NDArrays with different dimensions.";
-    throw std::runtime_error(mssg);
+struct ExprExp {
+  template <class A>
+  static auto apply(const A& a) -> decltype(std::exp(a)) {
+    return std::exp(a);
   }
+};
 
-  // Ensure same shape
-  for (size_t i = 0; i < dimensions_; i++) {
-    if (shape_[i] != a.shape_[i]) {
-      std::string mssg = "Cannot multiply two NDArrays with different shapes";
-      throw std::runtime_error(mssg);
-    }
+struct ExprLog {
+  template <class A>
+  static auto apply(const A& a) -> decltype(std::log(a)) {
+    return std::log(a);
   }
+};
 
-  // Do multiplication
-  for (size_t i = 0; i < data_.size(); i++) {
-    data_[i] *= a.data_[i];
+struct ExprSin {
+  template <class A>
+  static auto apply(const A& a) -> decltype(std::sin(a)) {
+    return std::sin(a);
   }
+};
 
-  return *this;
-}
-
-template <class T>
-template <class C>
-NDArray<T>& NDArray<T>::operator/=(const NDArray<C>& a) {
-  // Ensure same number of dimensions
-  if (dimensions_ != a.dimensions_) {
-    std::string mssg = "Cannot divide two NDArrays with different dimensions.";
-    throw std::runtime_error(mssg);
+struct ExprCos {
+  template <class A>
+  static auto apply(const A& a) -> decltype(std::cos(a)) {
+    return std::cos(a);
   }
+};
 
-  // Ensure same shape
-  for (size_t i = 0; i < dimensions_; i++) {
-    if (shape_[i] != a.shape_[i]) {
-      std::string mssg = "Cannot divide two NDArrays with different shapes";
-      throw std::runtime_error(mssg);
-    }
+struct ExprTan {
+  template <class A>
+  static auto apply(const A& a) -> decltype(std::tan(a)) {
+    return std::tan(a);
   }
+};
 
-  // Do division
-  for (size_t i = 0; i < data_.size(); i++) {
-    data_[i] /= a.data_[i];
-  }
+// Operands with different shapes are broadcast against each other as in
+// NumPy: shapes are aligned on their last axis, and an axis of length 1 (or
+// a missing leading axis) is repeated along the length of the other operand
+// by using a stride of 0.
+//
+// Every expression node provides:
+//   shape()         : The shape of the result, which is empty for scalars.
+//   linear(c)       : True if operator[] may be used to index the elements in
+//                     c continuous (or fortran continuous) order, which is
+//                     only the case if no operand is broadcast.
+//   operator[](i)   : The element at linear index i.
+//   seek(index, k)  : Moves to the element at index, of the shape of the
+//                     final result, to iterate along axis k with run().
+//   run(j)          : The element j steps along axis k from the last seek.
+//   aliases(d, s, t): True if an array read by the expression shares memory
+//                     with the array at d, of shape s and strides t, other
+//                     than by being that same array.
+
+// Leaf of an expression, reading the elements of an array or view
+template <class T>
+class ExprTerm {
+ public:
+  using value_type = T;
 
-  return *this;
-}
+  template <class A>
+  ExprTerm(const NDArray<T, A>& a);
+  template <size_t N, class A>
+  ExprTerm(const FixedNDArray<T, N, A>& a);
+  ExprTerm(const NDArrayView<T>& a);
+  ExprTerm(const NDArrayView<const T>& a);
 
-template <class T>
-template <class C>
-NDArray<T>& NDArray<T>::operator+=(const C& c) {
-  // Do addition
-  for (size_t i = 0; i < data_.size(); i++) {
-    data_[i] += c;
-  }
+  const std::vector<size_t>& shape() const;
+  bool linear(bool c_continuous) const;
+  const T& operator[](size_t i) const;
+  void seek(const std::vector<size_t>& index, size_t axis);
+  const T& run(size_t j) const;
+  template <class D>
+  bool aliases(const D* dst, const std::vector<size_t>& shape,
+               const std::vector<std::ptrdiff_t>& strides) const;
 
-  return *this;
-}
+ private:
+  const T* data_;
+  std::vector<size_t> shape_;
+  std::vector<std::ptrdiff_t> strides_;
+  bool c_linear_;
+  bool fortran_linear_;
+  const T* base_;
+  std::ptrdiff_t step_;
+};
 
-template <class T>
+// Leaf of an expression holding a scalar
 template <class C>
-NDArray<T>& NDArray<T>::operator-=(const C& c) {
-  // Do subtraction
-  for (size_t i = 0; i < data_.size(); i++) {
-    data_[i] -= c;
-  }
+class ExprScalar {
+ public:
+  using value_type = C;
 
-  return *this;
-}
+  ExprScalar(const C& c);
 
-template <class T>
-template <class C>
-NDArray<T>& NDArray<T>::operator*=(const C& c) {
-  // Do multiplication
-  for (size_t i = 0; i < data_.size(); i++) {
-    data_[i] *= c;
-  }
+  const std::vector<size_t>& shape() const;
+  bool linear(bool c_continuous) const;
+  const C& operator[](size_t i) const;
+  void seek(const std::vector<size_t>& index, size_t axis);
+  const C& run(size_t j) const;
+  template <class D>
+  bool aliases(const D* dst, const std::vector<size_t>& shape,
+               const std::vector<std::ptrdiff_t>& strides) const;
 
-  return *this;
-}
+ private:
+  C value_;
+  std::vector<size_t> shape_;
+};
 
-template <class T>
-template <class C>
-NDArray<T>& NDArray<T>::operator/=(const C& c) {
-  // Do division
-  for (size_t i = 0; i < data_.size(); i++) {
-    data_[i] /= c;
-  }
+// Operation applied to every element of an expression
+template <class Op, class E>
+class ExprUnary {
+ public:
+  using value_type =
+      decltype(Op::apply(std::declval<typename E::value_type>()));
 
-  return *this;
-}
+  ExprUnary(const E& e);
 
-template <class T>
-template <class C>
-NDArray<T>::operator NDArray<C>() const {
-  // Make array to be returned of same shape
-  NDArray<C> new_array(shape_);
+  const std::vector<size_t>& shape() const;
+  bool linear(bool c_continuous) const;
+  value_type operator[](size_t i) const;
+  void seek(const std::vector<size_t>& index, size_t axis);
+  value_type run(size_t j) const;
+  template <class D>
+  bool aliases(const D* dst, const std::vector<size_t>& shape,
+               const std::vector<std::ptrdiff_t>& strides) const;
 
-  // Go through all elements
-  for (size_t i = 0; i < data_.size(); i++) {
-    new_array[i] = data_[i];
-  }
+ private:
+  E e_;
+};
 
-  return std::move(new_array);
-}
+// Operation applied to the corresponding elements of two expressions. An
+// exception is thrown on construction if the shapes cannot be broadcast.
+template <class Op, class L, class R>
+class ExprBinary {
+ public:
+  using value_type =
+      decltype(Op::apply(std::declval<typename L::value_type>(),
+                         std::declval<typename R::value_type>()));
 
-template <class T>
-NDARRAY_INLINE size_t
-NDArray<T>::c_continuous_index(const std::vector<size_t>& indices) const {
-  // Make sure proper number of indices
-  if (indices.size() != dimensions_) {
-    std::string mssg = "Improper number of indicies provided to NDArray.";
-    throw std::runtime_error(mssg);
-  }
+  ExprBinary(const L& l, const R& r);
 
-  size_t indx = indices[dimensions_ - 1];
-  if (indx >= shape_[dimensions_ - 1]) {
-    std::string mssg = "Index provided to NDArray out of range.";
-    throw std::out_of_range(mssg);
-  }
+  const std::vector<size_t>& shape() const;
+  bool linear(bool c_continuous) const;
+  value_type operator[](size_t i) const;
+  void seek(const std::vector<size_t>& index, size_t axis);
+  value_type run(size_t j) const;
+  template <class D>
+  bool aliases(const D* dst, const std::vector<size_t>& shape,
+               const std::vector<std::ptrdiff_t>& strides) const;
 
-  size_t coeff = 1;
+ private:
+  L l_;
+  R r_;
+  std::vector<size_t> shape_;
+};
 
-  for (size_t i = dimensions_ - 1; i > 0; i--) {
-    if (indices[i] >= shape_[i]) {
-      std::string mssg = "Index provided to NDArray out of range.";
-      throw std::out_of_range(mssg);
-    }
+// Type of the expression node used for an operand of type X
+template <class X>
+struct expr_traits {
+  using type = ExprScalar<X>;
+};
 
-    coeff *= shape_[i];
-    indx += coeff * indices[i - 1];
-  }
+template <class T, class Alloc>
+struct expr_traits<NDArray<T, Alloc>> {
+  using type = ExprTerm<T>;
+};
 
-  return indx;
-}
+template <class T, size_t N, class Alloc>
+struct expr_traits<FixedNDArray<T, N, Alloc>> {
+  using type = ExprTerm<T>;
+};
 
 template <class T>
-NDARRAY_INLINE size_t
-NDArray<T>::fortran_continuous_index(const std::vector<size_t>& indices) const {
-  // Make sure proper number of indices
-  if (indices.size() != dimensions_) {
-    std::string mssg = "Improper number of indicies provided to NDArray.";
-    throw std::runtime_error(mssg);
-  }
+struct expr_traits<NDArrayView<T>> {
+  using type = ExprTerm<typename std::remove_const<T>::type>;
+};
 
-  size_t indx = indices[0];
-  if (indx >= shape_[0]) {
-    std::string mssg = "Index provided to NDArray out of range.";
-    throw std::out_of_range(mssg);
-  }
-  size_t coeff = 1;
+template <class Op, class E>
+struct expr_traits<ExprUnary<Op, E>> {
+  using type = ExprUnary<Op, E>;
+};
 
-  for (size_t i = 0; i < dimensions_ - 1; i++) {
-    if (indices[i] >= shape_[i]) {
-      std::string mssg = "Index provided to NDArray out of range.";
-      throw std::out_of_range(mssg);
-    }
+template <class Op, class L, class R>
+struct expr_traits<ExprBinary<Op, L, R>> {
+  using type = ExprBinary<Op, L, R>;
+};
 
-    coeff *= shape_[i];
-    indx += coeff * indices[i + 1];
-  }
+template <class X>
+using expr_type = typename expr_traits<X>::type;
 
-  return indx;
-}
+// Trait which is true for types which may be used as a scalar operand
+template <class C>
+struct is_expr_scalar : std::is_arithmetic<C> {};
 
-template <class T>
-template <size_t D>
-NDARRAY_INLINE size_t
-NDArray<T>::c_continuous_index(const std::array<size_t, D>& indices) const {
-  // Make sure proper number of indices
-  if (indices.size() != dimensions_) {
-    std::string mssg = "Improper number of indicies provided to NDArray.";
-    throw std::runtime_error(mssg);
-  }
+template <class C>
+struct is_expr_scalar<std::complex<C>> : std::true_type {};
+
+// Trait which is true if L and R may be the operands of a binary operator
+// building an expression. At least one must be an array operand.
+template <class L, class R>
+struct is_expr_pair
+    : std::integral_constant<
+          bool, (is_array_operand<L>::value &&
+                 (is_array_operand<R>::value || is_expr_scalar<R>::value)) ||
+                    (is_expr_scalar<L>::value && is_array_operand<R>::value)> {
+};
 
-  size_t indx = indices[dimensions_ - 1];
-  if (indx >= shape_[dimensions_ - 1]) {
-    std::string mssg = "Index provided to NDArray out of range.";
-    throw std::out_of_range(mssg);
-  }
+template <class Op, class L, class R>
+using expr_binary =
+    typename std::enable_if<is_expr_pair<L, R>::value,
+                            ExprBinary<Op, expr_type<L>, expr_type<R>>>::type;
 
-  size_t coeff = 1;
+template <class Op, class E>
+using expr_unary =
+    typename std::enable_if<is_array_operand<E>::value,
+                            ExprUnary<Op, expr_type<E>>>::type;
 
-  for (size_t i = dimensions_ - 1; i > 0; i--) {
-    if (indices[i] >= shape_[i]) {
-      std::string mssg = "Index provided to NDArray out of range.";
-      throw std::out_of_range(mssg);
-    }
+// Arithmetic operators
+template <class L, class R>
+expr_binary<ExprAdd, L, R> operator+(const L& l, const R& r);
 
-    coeff *= shape_[i];
-    indx += coeff * indices[i - 1];
-  }
+template <class L, class R>
+expr_binary<ExprSubtract, L, R> operator-(const L& l, const R& r);
 
-  return indx;
-}
+template <class L, class R>
+expr_binary<ExprMultiply, L, R> operator*(const L& l, const R& r);
 
-template <class T>
-template <size_t D>
-NDARRAY_INLINE size_t NDArray<T>::fortran_continuous_index(
-    const std::array<size_t, D>& indices) const {
-  // Make sure proper number of indices
-  if (indices.size() != dimensions_) {
-    std::string mssg = "Improper number of indicies provided to NDArray.";
-    throw std::runtime_error(mssg);
-  }
+template <class L, class R>
+expr_binary<ExprDivide, L, R> operator/(const L& l, const R& r);
 
-  size_t indx = indices[0];
-  if (indx >= shape_[0]) {
-    std::string mssg = "Index provided to NDArray out of range.";
-    throw std::out_of_range(mssg);
-  }
-  size_t coeff = 1;
+template <class E>
+expr_unary<ExprNegate, E> operator-(const E& e);
 
-  for (size_t i = 0; i < dimensions_ - 1; i++) {
-    if (indices[i] >= shape_[i]) {
-      std::string mssg = "Index provided to NDArray out of range.";
-      throw std::out_of_range(mssg);
-    }
+// Math functions, applied to every element
+template <class L, class R>
+expr_binary<ExprPow, L, R> pow(const L& l, const R& r);
 
-    coeff *= shape_[i];
-    indx += coeff * indices[i + 1];
-  }
+template <class E>
+expr_unary<ExprAbs, E> abs(const E& e);
 
-  return indx;
-}
+template <class E>
+expr_unary<ExprSqrt, E> sqrt(const E& e);
 
-//==============================================================================
-// NPY Function Definitions
-inline void load_npy(const std::string& fname, char*& data_ptr,
-                     std::vector<size_t>& shape, DType& dtype,
-                     bool& c_contiguous) {
-  // Open file
-  std::ifstream file(fname, std::ios::binary);
+template <class E>
+expr_unary<ExprExp, E> exp(const E& e);
 
-  // Read magic string
-  char* magic_string = new char[6];
-  file.read(magic_string, 6);
+template <class E>
+expr_unary<ExprLog, E> log(const E& e);
 
-  // Ensure magic string has right value
-  if (magic_string[0] != '\x93' || magic_string[1] != 'N' ||
-      magic_string[2] != 'U' || magic_string[3] != 'M' ||
-      magic_string[4] != 'P' || magic_string[5] != 'Y') {
-    std::string mssg = fname + " is an invalid .npy file.";
-    throw std::runtime_error(mssg);
-  }
+template <class E>
+expr_unary<ExprSin, E> sin(const E& e);
 
-  char major_verison = 0x00;
-  char minor_version = 0x00;
-  file.read(&major_verison, 1);
-  file.read(&minor_version, 1);
+template <class E>
+expr_unary<ExprCos, E> cos(const E& e);
 
-  uint32_t length_of_header = 0;
-  // Do any version checks here if required
-  if (major_verison == 0x01) {
-    uint16_t length_temp = 0;
-    file.read((char*)&length_temp, 2);
+template <class E>
+expr_unary<ExprTan, E> tan(const E& e);
 
-    // Value is stored as little endian. If system is big-endian, swap bytes
-    if (!system_is_little_endian()) {
-      swap_bytes((char*)&length_temp, 2, 1);
-    }
+//==============================================================================
+// Matrix Products
+// Arrays may be stored in either layout. The products of arrays of float or
+// double use SIMD micro-kernels on x86, and large products are split among
+// threads as set by execution_settings().
+
+// Matrix product of arrays with 1 or 2 dimensions, as numpy.matmul. A vector
+// on the left is a single row, and a vector on the right a single column, and
+// its axis is removed from the result. Unlike numpy.matmul, which returns a
+// scalar, the product of two vectors is an array of shape {1}; dot returns
+// the scalar. The result is fortran continuous if both arrays are, and c
+// continuous otherwise.
+template <class T, class A, class B>
+NDArray<T, A> matmul(const NDArray<T, A>& a, const NDArray<T, B>& b);
+
+// Inner product of two vectors of the same length
+template <class T, class A, class B>
+T dot(const NDArray<T, A>& a, const NDArray<T, B>& b);
+
+// Outer product of two vectors, which is c continuous, with
+// result(i, j) = a(i) * b(j).
+template <class T, class A, class B>
+NDArray<T, A> outer(const NDArray<T, A>& a, const NDArray<T, B>& b);
+
+// Returns the shape obtained by broadcasting arrays of shapes a and b against
+// each other. If they cannot be broadcast, an exception is thrown, with a
+// message which refers to the operation op.
+std::vector<size_t> broadcast_shape(const std::vector<size_t>& a,
+                                    const std::vector<size_t>& b,
+                                    const std::string& op);
+
+// Returns true if the arrays a and b, with the given shapes and strides,
+// share any memory, unless b is a itself, with the same shape and strides.
+// Writing to the elements of a may then change elements of b which have not
+// yet been read.
+template <class T, class U>
+bool arrays_alias(const T* a, const std::vector<size_t>& a_shape,
+                  const std::vector<std::ptrdiff_t>& a_strides, const U* b,
+                  const std::vector<size_t>& b_shape,
+                  const std::vector<std::ptrdiff_t>& b_strides);
+
+// Calls func(dst_element, value) for every element of the array dst, which
+// has the given shape and strides, with the corresponding element of expr,
+// which is broadcast to the shape of dst. When the elements of dst and of
+// every array in expr are contiguous in the same order, this is a single
+// linear loop. Otherwise, the elements are visited in runs along the fastest
+// axis of dst, with broadcast operands advancing with a stride of 0. If expr
+// reads dst through other strides, as in a = a.transpose(), it is first
+// evaluated into a temporary array.
+template <class T, class E, class F>
+void evaluate_expression(T* dst, const std::vector<size_t>& shape,
+                         const std::vector<std::ptrdiff_t>& strides,
+                         const E& expr, const std::string& op, F func);
+
+// evaluate_expression, without the check for aliasing
+template <class T, class E, class F>
+void evaluate_expression_direct(T* dst, const std::vector<size_t>& shape,
+                                const std::vector<std::ptrdiff_t>& strides,
+                                const E& expr, const std::string& op, F func);
+
+// Computes a[i] op= b[i] for the first n elements of a and b, where Op is one
+// of ExprAdd, ExprSubtract, ExprMultiply, or ExprDivide. On x86, SIMD kernels
+// for the widest instruction set supported by the CPU are used for arrays of
+// float, double, and int32_t in any combination with a float or double result,
+// and for arrays of std::complex<float> or std::complex<double>. Complex
+// results with infinite or NaN parts, or from division by zero, may differ
+// from those of std::complex. Other types use a scalar loop.
+template <class Op, class T, class C>
+void simd_apply(T* a, const C* b, size_t n);
+
+// Computes a[i] op= c for the first n elements of a, as for simd_apply
+template <class Op, class T, class C>
+void simd_apply_scalar(T* a, const C& c, size_t n);
+
+// Sets a[i] = b[i] for the first n elements of a and b, converting each
+// element to T. The SIMD kernels of simd_apply are used for float, double,
+// and int32_t, with conversions to int32_t truncating towards zero.
+template <class T, class C>
+void simd_convert(T* a, const C* b, size_t n);
+
+// Adds the product of the m x k matrix a and the k x n matrix b to the m x n
+// matrix c, where element (i, j) of each matrix is i * rs + j * cs elements
+// from its start.
+template <class T>
+void gemm(size_t m, size_t n, size_t k, const T* a, std::ptrdiff_t a_rs,
+          std::ptrdiff_t a_cs, const T* b, std::ptrdiff_t b_rs,
+          std::ptrdiff_t b_cs, T* c, std::ptrdiff_t c_rs, std::ptrdiff_t c_cs);
+
+// gemm, computed with the micro-kernel K. The matrices are split into blocks
+// which fit in the caches, and the blocks of a and b are packed into panels
+// of K::mr rows and K::nr columns, stored in the order K::kernel reads them.
+// Blocks of rows of c are computed concurrently.
+template <class K, class T>
+void gemm_blocked(size_t m, size_t n, size_t k, const T* a,
+                  std::ptrdiff_t a_rs, std::ptrdiff_t a_cs, const T* b,
+                  std::ptrdiff_t b_rs, std::ptrdiff_t b_cs, T* c,
+                  std::ptrdiff_t c_rs, std::ptrdiff_t c_cs);
+
+// Micro-kernel for any type, computing a 4 x 4 block of c. kernel writes the
+// product of kc columns of a packed panel of a and kc rows of a packed panel
+// of b to tile, in fortran order.
+template <class T>
+struct GemmKernel {
+  static const size_t mr = 4;
+  static const size_t nr = 4;
+  static void kernel(size_t kc, const T* a, const T* b, T* tile);
+};
 
-    // Cast to main variable
-    length_of_header = static_cast<uint32_t>(length_temp);
-  } else if (major_verison >= 0x02) {
-    uint32_t length_temp = 0;
-    file.read((char*)&length_temp, 4);
+//==============================================================================
+// Template Class MappedNDArray
+// Array which points directly into a memory mapped .npy file. Only the header
+// is parsed on construction, and pages of the data are read from disk by the
+// OS as they are accessed. The mapping is released on destruction. T may be
+// const, in which case the elements can only be read.
+template <class T>
+class MappedNDArray {
+ public:
+  using value_type = typename std::remove_const<T>::type;
 
-    // Value is stored as little endian. If system is big-endian, swap bytes
-    if (!system_is_little_endian()) {
-      swap_bytes((char*)&length_temp, 4, 1);
-    }
+  //==========================================================================
+  // Constructors and Destructors
+  // Maps the file fname. A READ_ONLY mapping requires T to be const.
+  MappedNDArray(const std::string& fname,
+                MapMode mode = std::is_const<T>::value
+                                   ? MapMode::READ_ONLY
+                                   : MapMode::COPY_ON_WRITE);
+  // Creates a READ_ONLY array over the contents of a .npy file held in
+  // buffer, which must outlive the array. The data is only copied if it is
+  // misaligned in the buffer, or has a different byte order than the system.
+  // T must be const, as the buffer is never written to.
+  MappedNDArray(const void* buffer, size_t n_bytes);
+  ~MappedNDArray();
+  MappedNDArray(const MappedNDArray&) = delete;
+  MappedNDArray(MappedNDArray&& other);
 
-    // Set to main variable
-    length_of_header = length_temp;
-  }
+  // Assignment Operator
+  MappedNDArray& operator=(const MappedNDArray&) = delete;
+  MappedNDArray& operator=(MappedNDArray&& other);
 
-  // Array for header, and read in
-  char* header_char = new char[length_of_header];
-  file.read(header_char, length_of_header);
-  std::string header(header_char);
-
-  // Parse header to get continuity
-  size_t loc1 = header.find("'fortran_order': ");
-  loc1 += 17;
-  std::string f_order_string = "";
-  size_t i = 0;
-  while (true) {
-    if (header[loc1 + i] != ' ') {
-      if (header[loc1 + i] == ',')
-        break;
-      else
-        f_order_string += header[loc1 + i];
-    }
-    i++;
-  }
-  if (f_order_string == "False")
-    c_contiguous = true;
-  else
-    c_contiguous = false;
-
-  // Parse header to get type description
-  loc1 = header.find("'descr': ");
-  loc1 += 9;
-  std::string descr_string = "";
-  bool data_is_little_endian = false;
-  if (header[loc1 + 1] == '>')
-    data_is_little_endian = false;
-  else
-    data_is_little_endian = true;
-  i = 2;
-  while (true) {
-    if (header[loc1 + i] != ' ') {
-      if (header[loc1 + i] != '\'') {
-        descr_string += header[loc1 + i];
-      } else
-        break;
-    }
-    i++;
-  }
-  dtype = descr_to_DType(descr_string);
-  size_t element_size = size_of_DType(dtype);
+  //==========================================================================
+  // Indexing
+  // The pages of a READ_ONLY mapping are mapped without write permission,
+  // so its elements are const.
 
-  // Parse header to get shape
-  loc1 = header.find('(');
-  size_t loc2 = header.find(')');
-  loc1 += 1;
-  // Clear shape vector to ensure it's empty (even though it should already be
-  // empty)
-  shape.clear();
-  if (loc1 == loc2) {
-    shape.push_back(1);
-  } else {
-    std::string temp = "";
-    for (i = loc1; i < loc2; i++) {
-      if (header[i] != ',')
-        temp += header[i];
-      else {
-        if (temp.size() > 0) {
-          shape.push_back(static_cast<size_t>(std::stoul(temp)));
-          temp = "";
-        }
-      }
-    }
-    if (temp.size() > 0) {
-      shape.push_back(static_cast<size_t>(std::stoul(temp)));
-    }
-  }
+  // Indexing operators for indexing with vector
+  T& operator()(const std::vector<size_t>& indices);
+  const T& operator()(const std::vector<size_t>& indices) const;
 
-  // Get number of bytes to be read into system
-  size_t n_elements = shape[0];
-  for (size_t j = 1; j < shape.size(); j++) n_elements *= shape[j];
-  std::streamsize n_bytes_to_read = static_cast<std::streamsize>(n_elements * element_size);
-  char* data = new char[static_cast<std::size_t>(n_bytes_to_read)];
-  file.read(data, n_bytes_to_read);
+  // Variadic indexing operators
+  template <typename... INDS>
+  T& operator()(INDS... inds);
+  template <typename... INDS>
+  const T& operator()(INDS... inds) const;
 
-  // If byte order of data different from byte order of system, swap data bytes
-  if (system_is_little_endian() != data_is_little_endian) {
-    swap_bytes(data, n_elements, element_size);
-  }
+  // Linear Indexing operators
+  T& operator[](size_t i);
+  const T& operator[](size_t i) const;
 
-  // Set pointer reference
-  data_ptr = data;
+  //==========================================================================
+  // Constant Methods
 
-  // Clear Memory
-  delete[] magic_string;
-  delete[] header_char;
-  file.close();
-}
+  // Return pointer to beginning of data
+  T* data();
+  const T* data() const;
 
-inline void write_npy(const std::string& fname, const char* data_ptr,
-                      const std::vector<size_t>& shape, DType dtype,
-                      bool c_contiguous) {
-  // Calculate number of elements from the shape
-  size_t n_elements = shape[0];
-  for (size_t j = 1; j < shape.size(); j++) {
-    n_elements *= shape[j];
-  }
+  // Iterators over the elements in memory order, for use with the algorithms
+  // of the standard library
+  using iterator = T*;
+  using const_iterator = const T*;
 
-  // Open file
-  std::ofstream file(fname, std::ios::binary);
+  iterator begin();
+  iterator end();
+  const_iterator begin() const;
+  const_iterator end() const;
+  const_iterator cbegin() const;
+  const_iterator cend() const;
 
-  // First write magic string
-  file << '\x93' << 'N' << 'U' << 'M' << 'P' << 'Y';
+  // Return vector describing shape of array
+  const std::vector<size_t>& shape() const;
 
-  // Next make the header. This is needed to know what version number to use
+  // Return number of elements in array
+  size_t size() const;
+
+  size_t linear_index(const std::vector<size_t>& indices) const;
+
+  template <typename... INDS>
+  size_t linear_index(INDS... inds) const;
+
+  // Returns true if data is stored as c continuous (row-major order),
+  // and false if fortran continuous (column-major order)
+  bool c_continuous() const;
+
+  // Returns the mode with which the file was mapped
+  MapMode mode() const;
+
+  // Returns true if the data points directly into the mapped file or the
+  // buffer, and false if it had to be copied.
+  bool zero_copy() const;
+
+  // Copies the mapped data into a new NDArray
+  NDArray<value_type> copy() const;
+
+ private:
+  void* map_ptr_;
+  size_t map_size_;
+  T* data_;
+  size_t size_;
+  std::vector<size_t> shape_;
+  std::vector<size_t> strides_;
+  bool c_continuous_;
+  MapMode mode_;
+  std::vector<value_type> copy_;
+
+  void init(const char* bytes, size_t n_bytes, const std::string& name,
+            bool allow_copy);
+
+  void unmap();
+
+  template <class IndexContainer>
+  size_t strided_index(const IndexContainer& indices) const;
+};
+
+//==============================================================================
+// Declarations for NPY functions
+
+// Enum of possible data types handeled by this implementation.
+enum class DType {
+  CHAR,
+  UCHAR,
+  INT16,
+  INT32,
+  INT64,
+  UINT16,
+  UINT32,
+  UINT64,
+  FLOAT32,
+  DOUBLE64,
+  COMPLEX64,
+  COMPLEX128
+};
+
+// Function which opens file fname, and loads in the binary data into 1D
+// array of chars, which must latter be type cast be the user. The char* to
+// the data is returned as a reference, along with the number of elements,
+// continuits, and element size in bytes. Returned is a vector for the shape.
+void load_npy(const std::string& fname, char*& data_ptr, std::vector<size_t>& shape,
+              DType& dtype, bool& c_contiguous);
+
+// Function which reads a .npy file from a stream, in the same manner as
+// load_npy for files.
+void load_npy(std::istream& stream, char*& data_ptr,
+              std::vector<size_t>& shape, DType& dtype, bool& c_contiguous);
+
+// Function which writes binary data to a Numpy .npy file.
+void write_npy(const std::string& fname, const char* data_ptr,
+               const std::vector<size_t>& shape, DType dtype, bool c_contiguous,
+               const NpyWriteOptions& options = NpyWriteOptions());
+
+// Function which writes binary data to a stream, in the .npy format.
+void write_npy(std::ostream& stream, const char* data_ptr,
+               const std::vector<size_t>& shape, DType dtype, bool c_contiguous);
+
+// Settings for the I/O of the data in .npy files. Data is split into chunks
+// of chunk_size bytes (aligned to multiples of chunk_size in the file), which
+// are read or written concurrently by up to n_threads threads using
+// positioned I/O. By default, all I/O is done by the calling thread.
+struct NpyIOSettings {
+  size_t n_threads;
+  size_t chunk_size;
+};
+
+// Returns a reference to the global settings used for .npy I/O. These should
+// not be changed while a file is being read or written.
+NpyIOSettings& npy_io_settings();
+
+// Description of the contents of a .npy file, obtained from its header.
+// The shape of 0 dimensional (scalar) arrays is given as {1}.
+struct NpyInfo {
+  DType dtype;
+  std::vector<size_t> shape;
+  bool c_contiguous;
+  bool little_endian;
+  uint32_t header_length;  // Length of the header dict, in bytes
+  uint64_t data_offset;    // Position of the array data in the file
+};
+
+// Returns the description of the .npy file fname. Only the header of the file
+// is read.
+NpyInfo npy_info(const std::string& fname);
+
+// Returns the descriptions of many .npy files, reading their headers
+// concurrently with up to n_threads threads. If n_threads is 0, the number of
+// hardware threads is used.
+std::vector<NpyInfo> npy_info(const std::vector<std::string>& fnames,
+                              size_t n_threads = 0);
+
+// Reads the preamble and header of a .npy file from the stream file, leaving
+// the stream positioned at the beginning of the data. The data_offset of the
+// returned description is relative to the initial position of the stream.
+NpyInfo read_npy_info(std::istream& file, const std::string& fname);
+
+// Reads the preamble and header of the contents of a .npy file held in the
+// first n_bytes of bytes. name is only used in error messages.
+NpyInfo read_npy_info(const char* bytes, size_t n_bytes,
+                      const std::string& name);
+
+// Calls func(i) for every i in [0, n), with the indices shared out one at a
+// time among up to n_threads threads (including the calling thread). The
+// first exception thrown by func is rethrown once all threads are finished.
+template <class F>
+void parallel_for(size_t n, size_t n_threads, F func);
+
+// Pool of persistent worker threads, which runs the work of parallel_for.
+// Workers are started as they are first needed, and are kept until the
+// program exits, so that parallel operations do not pay for creating
+// threads. The calling thread always takes part in its own work, so work
+// started from within a worker (nested parallelism) can not deadlock.
+class ThreadPool {
+ public:
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Returns the pool shared by the whole program
+  static ThreadPool& instance();
+
+  // Calls func(i) for every i in [0, n), as parallel_for
+  void run(size_t n, size_t n_threads, const std::function<void(size_t)>& func);
+
+ private:
+  struct Job;
+
+  std::vector<std::thread> threads_;
+  std::deque<std::shared_ptr<Job>> queue_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+
+  ThreadPool();
+
+  void work();
+  static void execute(Job& job);
+};
+
+// Single thread which runs the writes of save_async, one after another in
+// the order they were queued. The thread is started with the first write,
+// and kept until the program exits, when the writes still queued are
+// finished before it is joined.
+class AsyncWriter {
+ public:
+  ~AsyncWriter();
+
+  AsyncWriter(const AsyncWriter&) = delete;
+  AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+  // Returns the writer shared by the whole program
+  static AsyncWriter& instance();
+
+  // Queues task, and returns the future of its result. Unlike the future of
+  // std::async, it does not wait for the task when destroyed.
+  std::future<void> submit(std::packaged_task<void()> task);
+
+ private:
+  std::thread thread_;
+  std::deque<std::packaged_task<void()>> queue_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+
+  AsyncWriter();
+
+  void work();
+};
+
+// Settings for the execution of elementwise operations on arrays: fill, the
+// arithmetic operators, expressions, and conversions. Operations on at least
+// parallel_threshold elements are split among up to n_threads threads of the
+// ThreadPool, and smaller ones stay on the calling thread. If n_threads is 0,
+// the number of hardware threads is used. By default, all operations run on
+// the calling thread.
+struct ExecutionSettings {
+  size_t n_threads;
+  size_t parallel_threshold;
+};
+
+// Returns a reference to the global settings used for elementwise
+// operations. These should not be changed while an operation is running.
+ExecutionSettings& execution_settings();
+
+// Calls func(begin, end) for consecutive blocks of indices covering [0, n),
+// where each index stands for n_elements elements of an array. If there are
+// enough elements in total, as set by execution_settings(), the blocks are
+// processed concurrently, with one block per thread. Otherwise, func(0, n)
+// is called on the calling thread.
+template <class F>
+void parallel_blocks(size_t n, size_t n_elements, F func);
+
+// Zeroes the elements of data from index begin onwards, if they were left
+// uninitialized by an UninitializedAllocator when data was resized. The
+// elements are split among threads as by parallel_blocks.
+template <class T, class Alloc>
+void zero_new_elements(std::vector<T, Alloc>& data, size_t begin);
+
+// Returns the size in bytes of the default huge pages of the system, or of
+// 2 MiB if it is not known.
+size_t huge_page_size();
+
+// Maps at least n_bytes of memory, aligned to a huge page, according to
+// options. Returns nullptr if no memory could be mapped.
+void* map_pages(size_t n_bytes, const PageOptions& options);
+
+// Releases memory of n_bytes obtained from map_pages
+void unmap_pages(void* p, size_t n_bytes);
+
+// Returns the bit mask of the NUMA nodes of the machine which have memory
+uint64_t numa_node_mask();
+
+// Reads the preamble and header of a .npy file from the stream file, leaving
+// the stream positioned at the beginning of the data.
+void read_npy_header(std::istream& file, const std::string& fname,
+                     std::vector<size_t>& shape, DType& dtype,
+                     bool& c_contiguous, bool& data_is_little_endian);
+
+// Reads n_elements of the provided DType from the stream file directly into
+// data_ptr, swapping the bytes in place if the byte order of the data differs
+// from that of the system.
+void read_npy_data(std::istream& file, const std::string& fname,
+                   char* data_ptr, uint64_t n_elements, DType dtype,
+                   bool data_is_little_endian);
+
+// Reads n_elements of the provided DType starting at data_offset of the file
+// fname directly into data_ptr, using the settings of npy_io_settings().
+// Bytes are swapped in place if the byte order of the data differs from that
+// of the system.
+void read_npy_data(const std::string& fname, uint64_t data_offset,
+                   char* data_ptr, uint64_t n_elements, DType dtype,
+                   bool data_is_little_endian);
+
+// Splits the bytes [begin, end) of a file into the chunks described by
+// npy_io_settings(), and calls func(offset, n_bytes) for each chunk, where
+// offset is the position of the chunk in the file. Chunks are processed
+// concurrently when multiple threads are requested. Returns false if any
+// call to func returned false.
+template <class F>
+bool for_each_npy_chunk(uint64_t begin, uint64_t end, F func);
+
+#if defined(NDARRAY_POSIX)
+// Reads exactly n_bytes at offset of the file descriptor fd into data_ptr.
+// Returns false if an error occurs, or the end of the file is reached.
+bool pread_all(int fd, char* data_ptr, uint64_t n_bytes, uint64_t offset);
+
+// Writes exactly n_bytes from data_ptr at offset of the file descriptor fd.
+// Returns false if an error occurs.
+bool pwrite_all(int fd, const char* data_ptr, uint64_t n_bytes,
+                uint64_t offset);
+
+// Writes the header followed by n_bytes of data_ptr at the beginning of the
+// file descriptor fd, using as few system calls as possible. If direct is
+// true, the file must have been opened for direct I/O, and all writes are
+// made from aligned buffers. Returns false if an error occurs.
+bool write_npy_contents(int fd, const std::string& header,
+                        const char* data_ptr, uint64_t n_bytes, bool direct);
+#endif
+
+// Reads the block of the data of the .npy file fname described by ranges,
+// which holds a [begin, end) pair for every axis, into data_ptr. data_offset
+// is the position of the data in the file, while shape and c_contiguous
+// describe the entire array. Only the contiguous runs of bytes belonging to
+// the block are read, using positioned reads. No bytes are swapped.
+void read_npy_slice(const std::string& fname, uint64_t data_offset,
+                    const std::vector<size_t>& shape, bool c_contiguous,
+                    const std::vector<std::pair<size_t, size_t>>& ranges,
+                    size_t element_size, char* data_ptr);
+
+// Checks the magic string and version of the .npy preamble contained in the
+// first n_bytes of bytes. The length of the header dict is returned through
+// length_of_header, and the offset to the start of the header dict is
+// returned.
+size_t read_npy_preamble(const char* bytes, size_t n_bytes,
+                         const std::string& fname, uint32_t& length_of_header);
+
+// Parses the header dict of a .npy file to get the shape, DType, continuity,
+// and byte order of the data. The header is a Python dict literal with the
+// keys 'descr', 'fortran_order', and 'shape', in any order.
+void parse_npy_header(const std::string& header, std::vector<size_t>& shape,
+                      DType& dtype, bool& c_contiguous,
+                      bool& data_is_little_endian);
+
+// Parser for the Python dict literal which forms the header of a .npy file.
+// A std::runtime_error is thrown if the header is malformed, or if the size
+// in bytes of the data it describes does not fit in a size_t.
+class NpyHeaderParser {
+ public:
+  NpyHeaderParser(const std::string& header);
+
+  void parse(std::vector<size_t>& shape, DType& dtype, bool& c_contiguous,
+             bool& data_is_little_endian);
+
+ private:
+  const std::string& header_;
+  size_t pos_;
+
+  void skip_whitespace();
+  bool accept(char c);
+  void expect(char c);
+  std::string parse_string();
+  bool parse_bool();
+  std::vector<size_t> parse_shape();
+  void error(const std::string& what) const;
+};
+
+// Returns the strides, in elements, of a contiguous array with the given
+// shape, stored in c continuous or fortran continuous order.
+std::vector<std::ptrdiff_t> contiguous_strides(const std::vector<size_t>& shape,
+                                               bool c_continuous);
+
+// Calls func(a_offset, b_offset, n, a_step, b_step) for every run of n
+// elements along the innermost axis of the index space described by shape,
+// for two arrays with the strides a_strides and b_strides. The offsets are
+// of the first element of the run, and the steps are the strides of the
+// innermost axis. Axes are visited in the memory order of the first array.
+template <class F>
+void strided_apply(const std::vector<size_t>& shape,
+                   const std::vector<std::ptrdiff_t>& a_strides,
+                   const std::vector<std::ptrdiff_t>& b_strides, F func);
+
+// Copies the elements of an array with the strides src_strides into an
+// array with the strides dst_strides, both with the given shape. When the
+// fastest axes of the two arrays differ, as in a transpose, the copy is done
+// in square tiles, so that both arrays are accessed within the cache.
+template <class T, class U>
+void strided_copy(T* dst, const std::vector<std::ptrdiff_t>& dst_strides,
+                  const U* src, const std::vector<std::ptrdiff_t>& src_strides,
+                  const std::vector<size_t>& shape);
+
+// Returns the sum of the n contiguous elements of x, computed by pairwise
+// summation, so that the rounding error grows with log(n) instead of n.
+template <class T>
+T pairwise_sum(const T* x, size_t n);
+
+// Returns the sum of x[i] * y[i] for the n contiguous elements of x and y,
+// computed by pairwise summation as for pairwise_sum.
+template <class T>
+T pairwise_dot(const T* x, const T* y, size_t n);
+
+// Writes the sum of n_rows rows of n_cols contiguous elements, the starts of
+// which are row_stride elements apart, to out. The rows are added pairwise.
+// scratch must hold pairwise_depth(n_rows) * n_cols elements.
+template <class T>
+void pairwise_sum_rows(const T* x, size_t n_rows, size_t row_stride,
+                       size_t n_cols, T* out, T* scratch);
+
+// Number of levels of pairwise_sum_rows for n_rows rows
+size_t pairwise_depth(size_t n_rows);
+
+// Returns true if x should replace best as the smallest element, when
+// Compare is std::less, or as the largest, when it is std::greater. As in
+// NumPy, NaN is more extreme than any number, so that it propagates. An
+// element equal to best, or a NaN when best is already NaN, does not replace
+// it, so that the first is kept.
+template <class Compare, class T>
+bool more_extreme(const T& x, const T& best);
+
+// Returns x if it should replace best, as for more_extreme, and best if not,
+// for reductions which only keep the value. As any NaN is as good as
+// another, a NaN x always replaces best, which is cheaper to vectorize.
+template <class Compare, class T>
+T select_extreme(const T& x, const T& best);
+
+// Describes an axis of a contiguous array with the given shape, as the
+// elements being outer blocks of len x inner elements, where len is the
+// length of the axis, and inner (outer) is the number of elements of the
+// axes which vary faster (slower) in memory.
+void reduction_dims(const std::vector<size_t>& shape, bool c_continuous,
+                    size_t axis, size_t& outer, size_t& len, size_t& inner);
+
+// Calls func(o, begin, end) for every outer block o, and for ranges of
+// consecutive columns [begin, end) covering [0, inner), possibly
+// concurrently. Each call should reduce the len rows of its columns.
+template <class F>
+void reduce_axis(size_t outer, size_t len, size_t inner, F func);
+
+// Returns the DType which corresponds to the template type T. An exception is
+// thrown if T may not be stored in a .npy file.
+template <class T>
+DType type_to_DType();
+
+// Returns the magic string, version, header length, and header dict which
+// begin a .npy file holding an array of the given shape, DType, and
+// continuity. The header is padded with spaces so that it is at least
+// min_length bytes long, and the data begins on a multiple of 64 bytes.
+std::string make_npy_header(const std::vector<size_t>& shape, DType dtype,
+                            bool c_contiguous, size_t min_length = 0);
+
+// Returns the proper DType for a given Numpy dtype.descr string.
+DType descr_to_DType(const std::string& dtype);
+
+// Returns Numpy descr string for given DType
+std::string DType_to_descr(DType dtype);
+
+// Returns the number of bytes used to represent the provided DType.
+size_t size_of_DType(DType dtype);
+
+// Function to check wether or not host system is little-endian or not
+bool system_is_little_endian();
+
+// Set result to a * b (or a + b), returning false instead if the result does
+// not fit in a size_t.
+bool checked_multiply(size_t a, size_t b, size_t& result);
+bool checked_add(size_t a, size_t b, size_t& result);
+
+// Function to switch bye order of data for an array which contains
+// n_elements, each with element_size bytes. The size of data should
+// therefore be n_elements*element_size; if not, this is undefined behavior.
+void swap_bytes(char* data, uint64_t n_elements, size_t element_size);
+
+// Function to switch byte order of data for an array which contains
+// n_elements of the given DType. The real and imaginary components of
+// complex types are swapped separately.
+void swap_bytes(char* data, uint64_t n_elements, DType dtype);
+
+// Swaps the byte order of each of the n_elements elements of 2, 4, or 8 bytes
+// in data. SIMD kernels are used when supported by the CPU.
+void swap_two_byte_elements(char* data, uint64_t n_elements);
+void swap_four_byte_elements(char* data, uint64_t n_elements);
+void swap_eight_byte_elements(char* data, uint64_t n_elements);
+
+// Swaps the first and second byte pointed to by char* bytes.
+void swap_two_bytes(char* bytes);
+
+// Swaps the first four bytes pointed to by char* bytes.
+void swap_four_bytes(char* bytes);
+
+// Swaps the first eight bytes pointed to by char* bytes.
+void swap_eight_bytes(char* bytes);
+
+// Swaps the first sixteen bytes pointed to by char* bytes.
+void swap_sixteen_bytes(char* bytes);
+
+//==============================================================================
+// Template Class NpyWriter
+// Writes a .npy file one batch of rows at a time, along the first axis, so
+// that the entire array never needs to be held in memory. Space for the
+// header is reserved when the file is opened, and the shape in the header is
+// updated on flush() and close().
+template <class T>
+class NpyWriter {
+ public:
+  //==========================================================================
+  // Constructors and Destructors
+  // row_shape is the shape of a single row (every axis except the first),
+  // and is empty when writing a 1D array.
+  NpyWriter(const std::string& fname, const std::vector<size_t>& row_shape);
+  ~NpyWriter();
+  NpyWriter(const NpyWriter&) = delete;
+
+  // Assignment Operator
+  NpyWriter& operator=(const NpyWriter&) = delete;
+
+  //==========================================================================
+  // Non-Constant Methods
+
+  // Appends n_rows rows, stored in c continuous order, to the file
+  void append(const T* data, size_t n_rows);
+
+  // Appends an array to the file. The array must either have the shape of
+  // a single row, or have the row shape for all but its first axis.
+  template <class A>
+  void append(const NDArray<T, A>& array);
+
+  // Updates the header with the current number of rows, and flushes all
+  // data to the file, so that the file is a valid .npy file.
+  void flush();
+
+  // Writes the final header and closes the file
+  void close();
+
+  //==========================================================================
+  // Constant Methods
+
+  // Return number of rows written so far
+  size_t rows() const;
+
+  // Return vector describing shape of a single row
+  const std::vector<size_t>& row_shape() const;
+
+  // Returns true until close() has been called
+  bool is_open() const;
+
+ private:
+  std::ofstream file_;
+  std::string fname_;
+  std::vector<size_t> row_shape_;
+  size_t row_size_;
+  size_t n_rows_;
+  size_t header_length_;
+  DType dtype_;
+
+  void write_header();
+};
+
+//==============================================================================
+// NDArray Implementation
+template <class T, class Alloc>
+NDArray<T, Alloc>::NDArray()
+    : data_{}, shape_{}, strides_{}, c_continuous_{true}, dimensions_{0} {}
+
+template <class T, class Alloc>
+NDArray<T, Alloc>::NDArray(const std::vector<size_t>& init_shape,
+                           bool c_continuous, const Alloc& alloc)
+    : NDArray(init_shape, c_continuous, alloc, UninitializedTag()) {
+  zero_new_elements(data_, 0);
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc>::NDArray(const std::vector<size_t>& init_shape,
+                           bool c_continuous, const Alloc& alloc,
+                           UninitializedTag)
+    : data_(alloc) {
+  if (init_shape.size() > 0) {
+    shape_ = init_shape;
+    dimensions_ = shape_.size();
+
+    size_t ne = init_shape[0];
+    for (size_t i = 1; i < dimensions_; i++) {
+      ne *= init_shape[i];
+    }
+
+    data_.resize(ne);
+
+    c_continuous_ = c_continuous;
+    compute_strides();
+
+  } else {
+    std::string mssg = "NDArray shape vector must have at least one element.";
+    throw std::runtime_error(mssg);
+  }
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::uninitialized(
+    const std::vector<size_t>& shape, bool c_continuous, const Alloc& alloc) {
+  return NDArray(shape, c_continuous, alloc, UninitializedTag());
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc>::NDArray(const std::vector<T, Alloc>& data,
+                           const std::vector<size_t>& init_shape,
+                           bool c_continuous) {
+  if (init_shape.size() > 0) {
+    shape_ = init_shape;
+    dimensions_ = shape_.size();
+
+    size_t ne = init_shape[0];
+    for (size_t i = 1; i < dimensions_; i++) {
+      ne *= init_shape[i];
+    }
+
+    if (ne != data.size()) {
+      std::string mssg =
+          "Shape is incompatible with number of elements provided for NDArray.";
+      throw std::runtime_error(mssg);
+    }
+
+    data_ = data;
+
+    c_continuous_ = c_continuous;
+    compute_strides();
+
+  } else {
+    std::string mssg =
+        "Shape vector must have at least one element for NDArray.";
+    throw std::runtime_error(mssg);
+  }
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc>::NDArray(std::vector<T, Alloc>&& data,
+                           const std::vector<size_t>& init_shape,
+                           bool c_continuous) {
+  if (init_shape.size() > 0) {
+    shape_ = init_shape;
+    dimensions_ = shape_.size();
+
+    size_t ne = init_shape[0];
+    for (size_t i = 1; i < dimensions_; i++) {
+      ne *= init_shape[i];
+    }
+
+    if (ne != data.size()) {
+      std::string mssg =
+          "Shape is incompatible with number of elements provided for NDArray.";
+      throw std::runtime_error(mssg);
+    }
+
+    data_ = std::move(data);
+
+    c_continuous_ = c_continuous;
+    compute_strides();
+
+  } else {
+    std::string mssg =
+        "Shape vector must have at least one element for NDArray.";
+    throw std::runtime_error(mssg);
+  }
+}
+
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::load(const std::string &fname) {
+  // Get expected DType according to T
+  DType expected_dtype = type_to_DType<T>();
+
+  // Open file and read header
+  std::ifstream file(fname, std::ios::binary);
+  if (!file.is_open()) {
+    std::string mssg = "Could not open " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+
+  std::vector<size_t> data_shape;
+  DType data_dtype;
+  bool data_c_continuous;
+  bool data_is_little_endian;
+  read_npy_header(file, fname, data_shape, data_dtype, data_c_continuous,
+                  data_is_little_endian);
+  uint64_t data_offset = static_cast<uint64_t>(file.tellg());
+  file.close();
+
+  // Ensure DType variables match
+  if (expected_dtype != data_dtype) {
+    std::string mssg =
+        "NDArray template datatype does not match specified datatype in npy "
+        "file.";
+    throw std::runtime_error(mssg);
+  }
+
+  // Create NDArray object, and read the data directly into its storage
+  NDArray<T, Alloc> return_object =
+      uninitialized(data_shape, data_c_continuous);
+  read_npy_data(fname, data_offset,
+                reinterpret_cast<char*>(return_object.data()),
+                return_object.size(), data_dtype, data_is_little_endian);
+
+  // Return object
+  return return_object;
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::load(std::istream& stream) {
+  // Get expected DType according to T
+  DType expected_dtype = type_to_DType<T>();
+
+  NpyInfo info = read_npy_info(stream, "stream");
+
+  // Ensure DType variables match
+  if (expected_dtype != info.dtype) {
+    std::string mssg =
+        "NDArray template datatype does not match specified datatype in npy "
+        "file.";
+    throw std::runtime_error(mssg);
+  }
+
+  // Create NDArray object, and read the data directly into its storage
+  NDArray<T, Alloc> return_object =
+      uninitialized(info.shape, info.c_contiguous);
+  read_npy_data(stream, "stream",
+                reinterpret_cast<char*>(return_object.data()),
+                return_object.size(), info.dtype, info.little_endian);
+
+  return return_object;
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::load(const void* buffer, size_t n_bytes) {
+  // Get expected DType according to T
+  DType expected_dtype = type_to_DType<T>();
+
+  const char* bytes = static_cast<const char*>(buffer);
+  NpyInfo info = read_npy_info(bytes, n_bytes, "buffer");
+
+  // Ensure DType variables match
+  if (expected_dtype != info.dtype) {
+    std::string mssg =
+        "NDArray template datatype does not match specified datatype in npy "
+        "file.";
+    throw std::runtime_error(mssg);
+  }
+
+  // Create NDArray object, and copy the data directly into its storage
+  NDArray<T, Alloc> return_object =
+      uninitialized(info.shape, info.c_contiguous);
+  size_t n_data_bytes = return_object.size() * sizeof(T);
+  if (info.data_offset + n_data_bytes > n_bytes) {
+    std::string mssg = "buffer does not contain all of the array data.";
+    throw std::runtime_error(mssg);
+  }
+  std::memcpy(return_object.data(), bytes + info.data_offset, n_data_bytes);
+
+  // If byte order of data different from byte order of system, swap data
+  // bytes in place
+  if (system_is_little_endian() != info.little_endian) {
+    swap_bytes(reinterpret_cast<char*>(return_object.data()),
+               return_object.size(), info.dtype);
+  }
+
+  return return_object;
+}
+
+template <class T, class Alloc>
+MappedNDArray<const T> NDArray<T, Alloc>::map(const std::string& fname) {
+  return MappedNDArray<const T>(fname, MapMode::READ_ONLY);
+}
+
+template <class T, class Alloc>
+MappedNDArray<T> NDArray<T, Alloc>::map_cow(const std::string& fname) {
+  return MappedNDArray<T>(fname, MapMode::COPY_ON_WRITE);
+}
+
+template <class T, class Alloc>
+MappedNDArray<const T> NDArray<T, Alloc>::map(const void* buffer,
+                                              size_t n_bytes) {
+  return MappedNDArray<const T>(buffer, n_bytes);
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::load_slice(
+    const std::string& fname,
+    const std::vector<std::pair<size_t, size_t>>& ranges) {
+  // Get expected DType according to T
+  DType expected_dtype = type_to_DType<T>();
+
+  // Open file and read header
+  std::ifstream file(fname, std::ios::binary);
+  if (!file.is_open()) {
+    std::string mssg = "Could not open " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+
+  std::vector<size_t> data_shape;
+  DType data_dtype;
+  bool data_c_continuous;
+  bool data_is_little_endian;
+  read_npy_header(file, fname, data_shape, data_dtype, data_c_continuous,
+                  data_is_little_endian);
+  uint64_t data_offset = static_cast<uint64_t>(file.tellg());
+  file.close();
+
+  // Ensure DType variables match
+  if (expected_dtype != data_dtype) {
+    std::string mssg =
+        "NDArray template datatype does not match specified datatype in npy "
+        "file.";
+    throw std::runtime_error(mssg);
+  }
+
+  if (ranges.size() > data_shape.size()) {
+    std::string mssg = "Improper number of ranges provided to load NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  // Get the range and shape of the block for every axis
+  std::vector<std::pair<size_t, size_t>> block_ranges = ranges;
+  std::vector<size_t> block_shape(data_shape.size());
+  for (size_t i = 0; i < data_shape.size(); i++) {
+    if (i >= ranges.size()) block_ranges.push_back({0, data_shape[i]});
+
+    if (block_ranges[i].first > block_ranges[i].second ||
+        block_ranges[i].second > data_shape[i]) {
+      std::string mssg = "Range provided to load NDArray out of range.";
+      throw std::out_of_range(mssg);
+    }
+
+    block_shape[i] = block_ranges[i].second - block_ranges[i].first;
+  }
+
+  // Create NDArray object, and read the block directly into its storage
+  NDArray<T, Alloc> return_object =
+      uninitialized(block_shape, data_c_continuous);
+  read_npy_slice(fname, data_offset, data_shape, data_c_continuous,
+                 block_ranges, sizeof(T),
+                 reinterpret_cast<char*>(return_object.data()));
+
+  // If byte order of data different from byte order of system, swap data
+  // bytes in place
+  if (system_is_little_endian() != data_is_little_endian) {
+    swap_bytes(reinterpret_cast<char*>(return_object.data()),
+               return_object.size(), data_dtype);
+  }
+
+  return return_object;
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::load_rows(const std::string& fname,
+                                               size_t begin, size_t end) {
+  return load_slice(fname, {{begin, end}});
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE T& NDArray<T, Alloc>::operator()(
+    const std::vector<size_t>& indices) {
+  return data_[strided_index(indices)];
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const T& NDArray<T, Alloc>::operator()(
+    const std::vector<size_t>& indices) const {
+  return data_[strided_index(indices)];
+}
+
+template <class T, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE if_indices<T&, INDS...> NDArray<T, Alloc>::operator()(
+    INDS... inds) {
+  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+
+  return data_[strided_index(indices)];
+}
+
+template <class T, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE if_indices<const T&, INDS...> NDArray<T, Alloc>::operator()(
+    INDS... inds) const {
+  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+
+  return data_[strided_index(indices)];
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE T& NDArray<T, Alloc>::operator[](size_t i) {
+  return data_[i];
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const T& NDArray<T, Alloc>::operator[](size_t i) const {
+  return data_[i];
+}
+
+template <class T, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE T& NDArray<T, Alloc>::at_unchecked(INDS... inds) {
+  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  return data_[unchecked_index(indices)];
+}
+
+template <class T, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE const T& NDArray<T, Alloc>::at_unchecked(INDS... inds) const {
+  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  return data_[unchecked_index(indices)];
+}
+
+template <class T, class Alloc>
+template <typename... INDS>
+if_ranges<NDArrayView<T>, INDS...> NDArray<T, Alloc>::operator()(INDS... inds) {
+  return slice(std::vector<Range>{Range(inds)...});
+}
+
+template <class T, class Alloc>
+template <typename... INDS>
+if_ranges<NDArrayView<const T>, INDS...> NDArray<T, Alloc>::operator()(
+    INDS... inds) const {
+  return slice(std::vector<Range>{Range(inds)...});
+}
+
+template <class T, class Alloc>
+NDArrayView<T> NDArray<T, Alloc>::view() {
+  return NDArrayView<T>(data_.data(), 0, shape_,
+                        contiguous_strides(shape_, c_continuous_));
+}
+
+template <class T, class Alloc>
+NDArrayView<const T> NDArray<T, Alloc>::view() const {
+  return NDArrayView<const T>(data_.data(), 0, shape_,
+                              contiguous_strides(shape_, c_continuous_));
+}
+
+template <class T, class Alloc>
+NDArrayView<T> NDArray<T, Alloc>::slice(const std::vector<Range>& ranges) {
+  return view().slice(ranges);
+}
+
+template <class T, class Alloc>
+NDArrayView<const T> NDArray<T, Alloc>::slice(
+    const std::vector<Range>& ranges) const {
+  return view().slice(ranges);
+}
+
+template <class T, class Alloc>
+template <typename... INDS>
+NDArrayView<T> NDArray<T, Alloc>::slice(INDS... inds) {
+  return slice(std::vector<Range>{Range(inds)...});
+}
+
+template <class T, class Alloc>
+template <typename... INDS>
+NDArrayView<const T> NDArray<T, Alloc>::slice(INDS... inds) const {
+  return slice(std::vector<Range>{Range(inds)...});
+}
+
+template <class T, class Alloc>
+NDArrayView<T> NDArray<T, Alloc>::transpose() {
+  return view().transpose();
+}
+
+template <class T, class Alloc>
+NDArrayView<const T> NDArray<T, Alloc>::transpose() const {
+  return view().transpose();
+}
+
+template <class T, class Alloc>
+NDArrayView<T> NDArray<T, Alloc>::permute(const std::vector<size_t>& axes) {
+  return view().permute(axes);
+}
+
+template <class T, class Alloc>
+NDArrayView<const T> NDArray<T, Alloc>::permute(
+    const std::vector<size_t>& axes) const {
+  return view().permute(axes);
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::as_c_contiguous() const {
+  if (c_continuous_) return *this;
+
+  NDArray new_array = uninitialized(shape_, true, data_.get_allocator());
+  strided_copy(new_array.data(), contiguous_strides(shape_, true), data(),
+               contiguous_strides(shape_, false), shape_);
+  return new_array;
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::as_fortran_contiguous() const {
+  if (!c_continuous_) return *this;
+
+  NDArray new_array = uninitialized(shape_, false, data_.get_allocator());
+  strided_copy(new_array.data(), contiguous_strides(shape_, false), data(),
+               contiguous_strides(shape_, true), shape_);
+  return new_array;
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE std::vector<T, Alloc>& NDArray<T, Alloc>::data_vector() {
+  return data_;
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const std::vector<T, Alloc>& NDArray<T, Alloc>::data_vector()
+    const {
+  return data_;
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE Alloc NDArray<T, Alloc>::get_allocator() const {
+  return data_.get_allocator();
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE T* NDArray<T, Alloc>::data() {
+  return data_.data();
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const T* NDArray<T, Alloc>::data() const {
+  return data_.data();
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE T* NDArray<T, Alloc>::begin() {
+  return data();
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE T* NDArray<T, Alloc>::end() {
+  return data() + size();
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const T* NDArray<T, Alloc>::begin() const {
+  return data();
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const T* NDArray<T, Alloc>::end() const {
+  return data() + size();
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const T* NDArray<T, Alloc>::cbegin() const {
+  return data();
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const T* NDArray<T, Alloc>::cend() const {
+  return data() + size();
+}
+
+template <class T, class Alloc>
+NDIter<T> NDArray<T, Alloc>::nditer() {
+  return NDIter<T>(data_.data(), shape_,
+                   contiguous_strides(shape_, c_continuous_));
+}
+
+template <class T, class Alloc>
+NDIter<const T> NDArray<T, Alloc>::nditer() const {
+  return NDIter<const T>(data_.data(), shape_,
+                         contiguous_strides(shape_, c_continuous_));
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const std::vector<size_t>& NDArray<T, Alloc>::shape() const {
+  return shape_;
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE const std::vector<size_t>& NDArray<T, Alloc>::strides() const {
+  return strides_;
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE size_t NDArray<T, Alloc>::size() const {
+  return data_.size();
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE size_t
+NDArray<T, Alloc>::linear_index(const std::vector<size_t>& indices) const {
+  return strided_index(indices);
+}
+
+template <class T, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE size_t NDArray<T, Alloc>::linear_index(INDS... inds) const {
+  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  return strided_index(indices);
+}
+
+template <class T, class Alloc>
+NDARRAY_INLINE bool NDArray<T, Alloc>::c_continuous() const {
+  return c_continuous_;
+}
+
+template <class T, class Alloc>
+void NDArray<T, Alloc>::save(const std::string& fname,
+                              const NpyWriteOptions& options) const {
+  // Get expected DType according to T
+  DType dtype = type_to_DType<T>();
+
+  // Write data to file
+  write_npy(fname, reinterpret_cast<const char*>(data_.data()), shape_, dtype,
+            c_continuous_, options);
+}
+
+template <class T, class Alloc>
+void NDArray<T, Alloc>::save(std::ostream& stream) const {
+  // Get expected DType according to T
+  DType dtype = type_to_DType<T>();
+
+  // Write data to stream
+  write_npy(stream, reinterpret_cast<const char*>(data_.data()), shape_, dtype,
+            c_continuous_);
+}
+
+template <class T, class Alloc>
+std::future<void> NDArray<T, Alloc>::save_async(
+    const std::string& fname, bool snapshot,
+    const NpyWriteOptions& options) const {
+  // Get expected DType according to T. This is done here so that an
+  // unsupported type is reported immediately.
+  DType dtype = type_to_DType<T>();
+
+  if (snapshot) {
+    // The copy is moved into the task, which owns it until the write is done.
+    // It always uses the default allocator, as the allocator of the array
+    // may not be usable from another thread.
+    return AsyncWriter::instance().submit(std::packaged_task<void()>(std::bind(
+        [](const std::string& fname, const std::vector<T>& data,
+           const std::vector<size_t>& shape, DType dtype, bool c_continuous,
+           const NpyWriteOptions& options) {
+          write_npy(fname, reinterpret_cast<const char*>(data.data()), shape,
+                    dtype, c_continuous, options);
+        },
+        fname, std::vector<T>(data_.begin(), data_.end()), shape_, dtype,
+        c_continuous_, options)));
+  }
+
+  const char* data_ptr = reinterpret_cast<const char*>(data_.data());
+  return AsyncWriter::instance().submit(std::packaged_task<void()>(std::bind(
+      [data_ptr](const std::string& fname, const std::vector<size_t>& shape,
+                 DType dtype, bool c_continuous,
+                 const NpyWriteOptions& options) {
+        write_npy(fname, data_ptr, shape, dtype, c_continuous, options);
+      },
+      fname, shape_, dtype, c_continuous_, options)));
+}
+
+template <class T, class Alloc>
+T NDArray<T, Alloc>::sum() const {
+  // Each block is summed separately, and the partial sums are added in
+  // order, so that the result does not depend on the timing of threads.
+  std::vector<std::pair<size_t, T>> partials;
+  std::mutex partials_mutex;
+  const T* data = data_.data();
+  parallel_blocks(data_.size(), 1, [&](size_t begin, size_t end) {
+    T partial = pairwise_sum(data + begin, end - begin);
+    std::lock_guard<std::mutex> lock(partials_mutex);
+    partials.push_back({begin, partial});
+  });
+
+  std::sort(partials.begin(), partials.end(),
+            [](const std::pair<size_t, T>& a, const std::pair<size_t, T>& b) {
+              return a.first < b.first;
+            });
+
+  T total = T();
+  for (const auto& partial : partials) total += partial.second;
+  return total;
+}
+
+template <class T, class Alloc>
+T NDArray<T, Alloc>::mean() const {
+  if (data_.empty()) {
+    std::string mssg = "Cannot find the mean of an empty NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  return sum() / static_cast<T>(data_.size());
+}
+
+template <class T, class Alloc>
+T NDArray<T, Alloc>::min() const {
+  return extreme_value<std::less<T>>();
+}
+
+template <class T, class Alloc>
+T NDArray<T, Alloc>::max() const {
+  return extreme_value<std::greater<T>>();
+}
+
+template <class T, class Alloc>
+size_t NDArray<T, Alloc>::argmin() const {
+  return extreme_index<std::less<T>>();
+}
+
+template <class T, class Alloc>
+size_t NDArray<T, Alloc>::argmax() const {
+  return extreme_index<std::greater<T>>();
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::sum(size_t axis) const {
+  NDArray out = reduced_array(axis);
+
+  size_t outer, len, inner;
+  reduction_dims(shape_, c_continuous_, axis, outer, len, inner);
+  const T* data = data_.data();
+  T* out_data = out.data();
+
+  if (outer == 1 && inner == 1) {
+    // The axis is the whole array
+    out_data[0] = sum();
+  } else if (inner == 1) {
+    // The axis is contiguous, so each sum is over a contiguous run
+    parallel_blocks(outer, len, [&](size_t begin, size_t end) {
+      for (size_t o = begin; o < end; o++) {
+        out_data[o] = pairwise_sum(data + o * len, len);
+      }
+    });
+  } else {
+    size_t depth = pairwise_depth(len);
+    reduce_axis(outer, len, inner, [&](size_t o, size_t begin, size_t end) {
+      std::vector<T> scratch(depth * (end - begin));
+      pairwise_sum_rows(data + o * len * inner + begin, len, inner,
+                        end - begin, out_data + o * inner + begin,
+                        scratch.data());
+    });
+  }
+
+  return out;
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::mean(size_t axis) const {
+  NDArray out = sum(axis);
+  if (shape_[axis] == 0) {
+    std::string mssg = "Cannot find the mean along an empty axis of NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  out /= static_cast<T>(shape_[axis]);
+  return out;
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::min(size_t axis) const {
+  NDArray out = reduced_array(axis);
+  extreme_axis<std::less<T>>(axis, out.data(), nullptr);
+  return out;
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::max(size_t axis) const {
+  NDArray out = reduced_array(axis);
+  extreme_axis<std::greater<T>>(axis, out.data(), nullptr);
+  return out;
+}
+
+template <class T, class Alloc>
+NDArray<size_t> NDArray<T, Alloc>::argmin(size_t axis) const {
+  NDArray<size_t> out =
+      NDArray<size_t>::uninitialized(reduced_shape(axis), c_continuous_);
+  extreme_axis<std::less<T>>(axis, nullptr, out.data());
+  return out;
+}
+
+template <class T, class Alloc>
+NDArray<size_t> NDArray<T, Alloc>::argmax(size_t axis) const {
+  NDArray<size_t> out =
+      NDArray<size_t>::uninitialized(reduced_shape(axis), c_continuous_);
+  extreme_axis<std::greater<T>>(axis, nullptr, out.data());
+  return out;
+}
+
+template <class T, class Alloc>
+std::vector<size_t> NDArray<T, Alloc>::reduced_shape(size_t axis) const {
+  if (axis >= dimensions_) {
+    std::string mssg = "Axis provided to reduce NDArray out of range.";
+    throw std::out_of_range(mssg);
+  }
+
+  // Reducing the only axis leaves a single element
+  std::vector<size_t> new_shape;
+  for (size_t i = 0; i < dimensions_; i++) {
+    if (i != axis) new_shape.push_back(shape_[i]);
+  }
+  if (new_shape.empty()) new_shape.push_back(1);
+
+  return new_shape;
+}
+
+template <class T, class Alloc>
+NDArray<T, Alloc> NDArray<T, Alloc>::reduced_array(size_t axis) const {
+  // Every reduction writes each element of the result
+  return uninitialized(reduced_shape(axis), c_continuous_,
+                       data_.get_allocator());
+}
+
+template <class T, class Alloc>
+template <class Compare>
+size_t NDArray<T, Alloc>::extreme_index() const {
+  if (data_.empty()) {
+    std::string mssg = "Cannot find the extreme element of an empty NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  // Each block finds its own extreme, and the blocks are then compared in
+  // order, so that the first of equal elements, or the first NaN, is always
+  // chosen.
+  std::vector<size_t> candidates;
+  std::mutex candidates_mutex;
+  const T* data = data_.data();
+  parallel_blocks(data_.size(), 1, [&](size_t begin, size_t end) {
+    size_t best = begin;
+    for (size_t i = begin + 1; i < end; i++) {
+      if (more_extreme<Compare>(data[i], data[best])) best = i;
+    }
+
+    std::lock_guard<std::mutex> lock(candidates_mutex);
+    candidates.push_back(best);
+  });
+
+  std::sort(candidates.begin(), candidates.end());
+  size_t best = candidates[0];
+  for (size_t i : candidates) {
+    if (more_extreme<Compare>(data[i], data[best])) best = i;
+  }
+  return best;
+}
+
+template <class T, class Alloc>
+template <class Compare>
+T NDArray<T, Alloc>::extreme_value() const {
+  if (data_.empty()) {
+    std::string mssg = "Cannot find the extreme element of an empty NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  // The candidates of the blocks are combined in the order of the blocks,
+  // so that the result does not depend on the timing of threads.
+  std::vector<std::pair<size_t, T>> candidates;
+  std::mutex candidates_mutex;
+  const T* data = data_.data();
+  parallel_blocks(data_.size(), 1, [&](size_t begin, size_t end) {
+    // Independent candidates, which may be vectorized. More than a vector
+    // of them hide the latency of the compare and blend.
+    T best[32];
+    for (size_t k = 0; k < 32; k++) best[k] = data[begin];
+    size_t i = begin;
+    for (; i + 32 <= end; i += 32) {
+      for (size_t k = 0; k < 32; k++) {
+        best[k] = select_extreme<Compare>(data[i + k], best[k]);
+      }
+    }
+    for (; i < end; i++) best[0] = select_extreme<Compare>(data[i], best[0]);
+    for (size_t k = 1; k < 32; k++) {
+      best[0] = select_extreme<Compare>(best[k], best[0]);
+    }
+
+    std::lock_guard<std::mutex> lock(candidates_mutex);
+    candidates.push_back({begin, best[0]});
+  });
+
+  std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<size_t, T>& a, const std::pair<size_t, T>& b) {
+              return a.first < b.first;
+            });
+
+  T best = candidates[0].second;
+  for (const auto& c : candidates) {
+    best = select_extreme<Compare>(c.second, best);
+  }
+  return best;
+}
+
+template <class T, class Alloc>
+template <class Compare>
+void NDArray<T, Alloc>::extreme_axis(size_t axis, T* values,
+                                     size_t* indices) const {
+  size_t outer, len, inner;
+  reduction_dims(shape_, c_continuous_, axis, outer, len, inner);
+  if (len == 0) {
+    std::string mssg =
+        "Cannot find the extreme element along an empty axis of NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  const T* data = data_.data();
+  if (inner == 1) {
+    // The axis is contiguous, so each lane is a contiguous run
+    parallel_blocks(outer, len, [&](size_t begin, size_t end) {
+      for (size_t o = begin; o < end; o++) {
+        const T* x = data + o * len;
+        size_t best = 0;
+        for (size_t r = 1; r < len; r++) {
+          if (more_extreme<Compare>(x[r], x[best])) best = r;
+        }
+
+        if (values) values[o] = x[best];
+        if (indices) indices[o] = best;
+      }
+    });
+    return;
+  }
+
+  reduce_axis(outer, len, inner, [&](size_t o, size_t begin, size_t end) {
+    // The best value and index of every column of the block are kept, and
+    // updated by streaming through the rows
+    size_t n_cols = end - begin;
+    const T* x = data + o * len * inner + begin;
+    std::vector<T> best(x, x + n_cols);
+    std::vector<size_t> best_index(indices ? n_cols : 0, 0);
+    for (size_t r = 1; r < len; r++) {
+      const T* row = x + r * inner;
+      if (indices) {
+        for (size_t c = 0; c < n_cols; c++) {
+          if (more_extreme<Compare>(row[c], best[c])) {
+            best[c] = row[c];
+            best_index[c] = r;
+          }
+        }
+      } else {
+        // Without indices, the selection may be vectorized
+        for (size_t c = 0; c < n_cols; c++) {
+          best[c] = select_extreme<Compare>(row[c], best[c]);
+        }
+      }
+    }
+
+    size_t out = o * inner + begin;
+    if (values) std::copy(best.begin(), best.end(), values + out);
+    if (indices) std::copy(best_index.begin(), best_index.end(), indices + out);
+  });
+}
+
+template <class T, class Alloc>
+void NDArray<T, Alloc>::fill(const T& val) {
+  T* data = data_.data();
+  parallel_blocks(data_.size(), 1, [data, &val](size_t begin, size_t end) {
+    std::fill(data + begin, data + end, val);
+  });
+}
+
+template <class T, class Alloc>
+void NDArray<T, Alloc>::reshape(const std::vector<size_t>& new_shape) {
+  // Ensure new shape has proper dimensions
+  if (new_shape.size() < 1) {
+    std::string mssg =
+        "Shape vector must have at least one element to"
+        " reshpae NDArray.";
+    throw std::runtime_error(mssg);
+  } else {
+    size_t ne = new_shape[0];
+
+    for (size_t i = 1; i < new_shape.size(); i++) {
+      ne *= new_shape[i];
+    }
+
+    if (ne == data_.size()) {
+      shape_ = new_shape;
+      dimensions_ = shape_.size();
+      compute_strides();
+    } else {
+      std::string mssg =
+          "Shape is incompatible with number of elements in"
+          " NDArray.";
+      throw std::runtime_error(mssg);
+    }
+  }
+}
+
+template <class T, class Alloc>
+void NDArray<T, Alloc>::reallocate(const std::vector<size_t>& new_shape) {
+  // Ensure new shape has proper dimensions
+  if (new_shape.size() < 1) {
+    std::string mssg =
+        "Shape vector must have at least one element to"
+        " reallocate NDArray.";
+    throw std::runtime_error(mssg);
+  } else {
+    size_t ne = new_shape[0];
+
+    for (size_t i = 1; i < new_shape.size(); i++) {
+      ne *= new_shape[i];
+    }
+
+    shape_ = new_shape;
+    dimensions_ = shape_.size();
+    size_t old_size = data_.size();
+    data_.resize(ne);
+    zero_new_elements(data_, old_size);
+    compute_strides();
+  }
+}
+
+template <class T, class Alloc>
+template <class C, class A>
+NDArray<T, Alloc>& NDArray<T, Alloc>::operator+=(const NDArray<C, A>& a) {
+  // Arrays of different shapes or layouts are broadcast through a view
+  if (shape_ != a.shape_ || c_continuous_ != a.c_continuous_) {
+    return *this += a.view();
+  }
+
+  // Do addition
+  simd_apply<ExprAdd>(data_.data(), a.data_.data(), data_.size());
+
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class C, class A>
+NDArray<T, Alloc>& NDArray<T, Alloc>::operator-=(const NDArray<C, A>& a) {
+  // Arrays of different shapes or layouts are broadcast through a view
+  if (shape_ != a.shape_ || c_continuous_ != a.c_continuous_) {
+    return *this -= a.view();
+  }
+
+  // Do subtraction
+  simd_apply<ExprSubtract>(data_.data(), a.data_.data(), data_.size());
+
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class C, class A>
+NDArray<T, Alloc>& NDArray<T, Alloc>::operator*=(const NDArray<C, A>& a) {
+  // Arrays of different shapes or layouts are broadcast through a view
+  if (shape_ != a.shape_ || c_continuous_ != a.c_continuous_) {
+    return *this *= a.view();
+  }
+
+  // Do multiplication
+  simd_apply<ExprMultiply>(data_.data(), a.data_.data(), data_.size());
+
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class C, class A>
+NDArray<T, Alloc>& NDArray<T, Alloc>::operator/=(const NDArray<C, A>& a) {
+  // Arrays of different shapes or layouts are broadcast through a view
+  if (shape_ != a.shape_ || c_continuous_ != a.c_continuous_) {
+    return *this /= a.view();
+  }
+
+  // Do division
+  simd_apply<ExprDivide>(data_.data(), a.data_.data(), data_.size());
+
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class C>
+if_not_array_operand<NDArray<T, Alloc>&, C>
+NDArray<T, Alloc>::operator+=(const C& c) {
+  // Do addition
+  simd_apply_scalar<ExprAdd>(data_.data(), c, data_.size());
+
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class C>
+if_not_array_operand<NDArray<T, Alloc>&, C>
+NDArray<T, Alloc>::operator-=(const C& c) {
+  // Do subtraction
+  simd_apply_scalar<ExprSubtract>(data_.data(), c, data_.size());
+
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class C>
+if_not_array_operand<NDArray<T, Alloc>&, C>
+NDArray<T, Alloc>::operator*=(const C& c) {
+  // Do multiplication
+  simd_apply_scalar<ExprMultiply>(data_.data(), c, data_.size());
+
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class C>
+if_not_array_operand<NDArray<T, Alloc>&, C>
+NDArray<T, Alloc>::operator/=(const C& c) {
+  // Do division
+  simd_apply_scalar<ExprDivide>(data_.data(), c, data_.size());
+
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class E, class>
+NDArray<T, Alloc>::NDArray(const E& expr) : NDArray() {
+  const expr_type<E> e(expr);
+  *this = uninitialized(e.shape(), e.linear(true) || !e.linear(false));
+
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_.data(), shape_,
+                      contiguous_strides(shape_, c_continuous_), e, "assign",
+                      [](T& d, const V& v) { d = v; });
+}
+
+template <class T, class Alloc>
+template <class E>
+if_array_expression<NDArray<T, Alloc>&, E>
+NDArray<T, Alloc>::operator=(const E& expr) {
+  const expr_type<E> e(expr);
+  if (e.shape() != shape_) {
+    *this = NDArray(expr);
+    return *this;
+  }
+
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_.data(), shape_,
+                      contiguous_strides(shape_, c_continuous_), e, "assign",
+                      [](T& d, const V& v) { d = v; });
+
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class E>
+if_array_expression<NDArray<T, Alloc>&, E>
+NDArray<T, Alloc>::operator+=(const E& expr) {
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_.data(), shape_,
+                      contiguous_strides(shape_, c_continuous_),
+                      expr_type<E>(expr), "add",
+                      [](T& d, const V& v) { d += v; });
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class E>
+if_array_expression<NDArray<T, Alloc>&, E>
+NDArray<T, Alloc>::operator-=(const E& expr) {
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_.data(), shape_,
+                      contiguous_strides(shape_, c_continuous_),
+                      expr_type<E>(expr), "subtract",
+                      [](T& d, const V& v) { d -= v; });
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class E>
+if_array_expression<NDArray<T, Alloc>&, E>
+NDArray<T, Alloc>::operator*=(const E& expr) {
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_.data(), shape_,
+                      contiguous_strides(shape_, c_continuous_),
+                      expr_type<E>(expr), "multiply",
+                      [](T& d, const V& v) { d *= v; });
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class E>
+if_array_expression<NDArray<T, Alloc>&, E>
+NDArray<T, Alloc>::operator/=(const E& expr) {
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_.data(), shape_,
+                      contiguous_strides(shape_, c_continuous_),
+                      expr_type<E>(expr), "divide",
+                      [](T& d, const V& v) { d /= v; });
+  return *this;
+}
+
+template <class T, class Alloc>
+template <class C, class A>
+NDArray<T, Alloc>::operator NDArray<C, A>() const {
+  // The new array has the same layout, so the elements are converted in a
+  // single linear pass.
+  auto new_array = NDArray<C, A>::uninitialized(shape_, c_continuous_);
+  simd_convert(new_array.data(), data_.data(), data_.size());
+  return new_array;
+}
+
+template <class T, class Alloc>
+void NDArray<T, Alloc>::compute_strides() {
+  strides_.resize(shape_.size());
+  size_t coeff = 1;
+  if (c_continuous_) {
+    for (size_t i = shape_.size(); i > 0; i--) {
+      strides_[i - 1] = coeff;
+      coeff *= shape_[i - 1];
+    }
+  } else {
+    for (size_t i = 0; i < shape_.size(); i++) {
+      strides_[i] = coeff;
+      coeff *= shape_[i];
+    }
+  }
+}
+
+template <class T, class Alloc>
+template <class IndexContainer>
+NDARRAY_INLINE size_t
+NDArray<T, Alloc>::strided_index(const IndexContainer& indices) const {
+#if !defined(NDARRAY_NO_BOUNDS_CHECK)
+  // Make sure proper number of indices
+  if (indices.size() != dimensions_) {
+    std::string mssg = "Improper number of indicies provided to NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  // The bounds are combined so that a single branch checks all of them
+  const size_t* shape = shape_.data();
+  bool in_range = true;
+  for (size_t i = 0; i < indices.size(); i++) {
+    in_range &= indices[i] < shape[i];
+  }
+
+  if (!in_range) {
+    std::string mssg = "Index provided to NDArray out of range.";
+    throw std::out_of_range(mssg);
+  }
+#endif
+
+  return unchecked_index(indices);
+}
+
+template <class T, class Alloc>
+template <class IndexContainer>
+NDARRAY_INLINE size_t
+NDArray<T, Alloc>::unchecked_index(const IndexContainer& indices) const {
+  // For a std::array, the number of indices is known at compile time, and
+  // the loop is unrolled into a single dot product with the strides
+  const size_t* strides = strides_.data();
+  size_t indx = 0;
+  for (size_t i = 0; i < indices.size(); i++) {
+    indx += strides[i] * indices[i];
+  }
+
+  return indx;
+}
+
+//==============================================================================
+// Range Implementation
+inline Range::Range()
+    : start{0}, stop{std::numeric_limits<size_t>::max()}, step{1},
+      single{false} {}
+
+inline Range::Range(size_t index)
+    : start{index}, stop{index + 1}, step{1}, single{true} {}
+
+inline Range::Range(size_t start, size_t stop, size_t step)
+    : start{start}, stop{stop}, step{step}, single{false} {}
+
+//==============================================================================
+// NDArrayView Implementation
+template <class T>
+NDArrayView<T>::NDArrayView(T* data, size_t offset,
+                            const std::vector<size_t>& shape,
+                            const std::vector<std::ptrdiff_t>& strides)
+    : data_{reinterpret_cast<T*>(
+          reinterpret_cast<typename std::conditional<
+              std::is_const<T>::value, const char*, char*>::type>(data) +
+          offset)},
+      offset_{offset},
+      shape_{shape},
+      strides_{strides},
+      size_{1} {
+  if (shape_.size() != strides_.size()) {
+    std::string mssg = "NDArrayView shape and strides must have same size.";
+    throw std::runtime_error(mssg);
+  }
+
+  for (const auto& e : shape_) size_ *= e;
+}
+
+template <class T>
+template <class C, class>
+NDArrayView<T>::NDArrayView(const NDArrayView<C>& other)
+    : data_{other.data_},
+      offset_{other.offset_},
+      shape_{other.shape_},
+      strides_{other.strides_},
+      size_{other.size_} {}
+
+template <class T>
+NDARRAY_INLINE T& NDArrayView<T>::operator()(
+    const std::vector<size_t>& indices) const {
+  return data_[strided_index(indices)];
+}
+
+template <class T>
+template <typename... INDS>
+NDARRAY_INLINE if_indices<T&, INDS...> NDArrayView<T>::operator()(
+    INDS... inds) const {
+  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  return data_[strided_index(indices)];
+}
+
+template <class T>
+template <typename... INDS>
+if_ranges<NDArrayView<T>, INDS...> NDArrayView<T>::operator()(
+    INDS... inds) const {
+  return slice(std::vector<Range>{Range(inds)...});
+}
+
+template <class T>
+NDArrayView<T> NDArrayView<T>::slice(const std::vector<Range>& ranges) const {
+  if (ranges.size() > shape_.size()) {
+    std::string mssg = "Improper number of ranges provided to slice NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  std::vector<size_t> new_shape;
+  std::vector<std::ptrdiff_t> new_strides;
+  std::ptrdiff_t first = 0;
+
+  for (size_t i = 0; i < shape_.size(); i++) {
+    Range r = i < ranges.size() ? ranges[i] : Range();
+
+    if (r.step == 0) {
+      std::string mssg = "Range provided to slice NDArray has step of zero.";
+      throw std::runtime_error(mssg);
+    }
+
+    size_t stop = std::min(r.stop, shape_[i]);
+    if ((r.single && r.start >= shape_[i]) || r.start > stop) {
+      std::string mssg = "Range provided to slice NDArray out of range.";
+      throw std::out_of_range(mssg);
+    }
+
+    // Only move to the first element if there are any elements at all
+    size_t len = (stop - r.start + r.step - 1) / r.step;
+    if (len > 0) first += static_cast<std::ptrdiff_t>(r.start) * strides_[i];
+
+    if (!r.single) {
+      new_shape.push_back(len);
+      new_strides.push_back(strides_[i] * static_cast<std::ptrdiff_t>(r.step));
+    }
+  }
+
+  // If every axis was removed, the view is of a single element
+  if (new_shape.empty()) {
+    new_shape.push_back(1);
+    new_strides.push_back(1);
+  }
+
+  // The new view keeps the same parent, with its offset moved forward
+  size_t new_offset =
+      offset_ + static_cast<size_t>(first) * sizeof(T);
+  T* parent = reinterpret_cast<T*>(
+      reinterpret_cast<typename std::conditional<
+          std::is_const<T>::value, const char*, char*>::type>(data_) -
+      offset_);
+
+  return NDArrayView<T>(parent, new_offset, new_shape, new_strides);
+}
+
+template <class T>
+template <typename... INDS>
+NDArrayView<T> NDArrayView<T>::slice(INDS... inds) const {
+  return slice(std::vector<Range>{Range(inds)...});
+}
+
+template <class T>
+NDArrayView<T> NDArrayView<T>::transpose() const {
+  std::vector<size_t> axes(shape_.size());
+  for (size_t i = 0; i < axes.size(); i++) axes[i] = axes.size() - 1 - i;
+  return permute(axes);
+}
+
+template <class T>
+NDArrayView<T> NDArrayView<T>::permute(const std::vector<size_t>& axes) const {
+  if (axes.size() != shape_.size()) {
+    std::string mssg = "Improper number of axes provided to permute NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  std::vector<bool> used(axes.size(), false);
+  std::vector<size_t> new_shape(axes.size());
+  std::vector<std::ptrdiff_t> new_strides(axes.size());
+  for (size_t i = 0; i < axes.size(); i++) {
+    if (axes[i] >= axes.size() || used[axes[i]]) {
+      std::string mssg = "Invalid axes provided to permute NDArray.";
+      throw std::runtime_error(mssg);
+    }
+    used[axes[i]] = true;
+    new_shape[i] = shape_[axes[i]];
+    new_strides[i] = strides_[axes[i]];
+  }
+
+  NDArrayView<T> out(*this);
+  out.shape_ = new_shape;
+  out.strides_ = new_strides;
+  return out;
+}
+
+template <class T>
+NDARRAY_INLINE T* NDArrayView<T>::data() const {
+  return data_;
+}
+
+template <class T>
+NDARRAY_INLINE size_t NDArrayView<T>::offset() const {
+  return offset_;
+}
+
+template <class T>
+NDARRAY_INLINE const std::vector<size_t>& NDArrayView<T>::shape() const {
+  return shape_;
+}
+
+template <class T>
+NDARRAY_INLINE const std::vector<std::ptrdiff_t>& NDArrayView<T>::strides()
+    const {
+  return strides_;
+}
+
+template <class T>
+NDARRAY_INLINE size_t NDArrayView<T>::size() const {
+  return size_;
+}
+
+template <class T>
+NDIter<T> NDArrayView<T>::nditer() const {
+  return NDIter<T>(data_, shape_, strides_);
+}
+
+template <class T>
+bool NDArrayView<T>::c_continuous() const {
+  return strides_ == contiguous_strides(shape_, true);
+}
+
+template <class T>
+bool NDArrayView<T>::fortran_continuous() const {
+  return strides_ == contiguous_strides(shape_, false);
+}
+
+template <class T>
+NDArray<typename NDArrayView<T>::value_type> NDArrayView<T>::copy() const {
+  return as_c_contiguous();
+}
+
+template <class T>
+NDArray<typename NDArrayView<T>::value_type> NDArrayView<T>::as_c_contiguous()
+    const {
+  NDArray<value_type> new_array(shape_, true);
+  strided_copy(new_array.data(), contiguous_strides(shape_, true), data_,
+               strides_, shape_);
+  return new_array;
+}
+
+template <class T>
+NDArray<typename NDArrayView<T>::value_type>
+NDArrayView<T>::as_fortran_contiguous() const {
+  NDArray<value_type> new_array(shape_, false);
+  strided_copy(new_array.data(), contiguous_strides(shape_, false), data_,
+               strides_, shape_);
+  return new_array;
+}
+
+template <class T>
+void NDArrayView<T>::fill(const value_type& val) const {
+  apply(*this, "fill", [&val](T& e, const T&) { e = val; });
+}
+
+template <class T>
+template <class C, class A>
+const NDArrayView<T>& NDArrayView<T>::operator+=(
+    const NDArray<C, A>& a) const {
+  return *this += a.view();
+}
+
+template <class T>
+template <class C, class A>
+const NDArrayView<T>& NDArrayView<T>::operator-=(
+    const NDArray<C, A>& a) const {
+  return *this -= a.view();
+}
+
+template <class T>
+template <class C, class A>
+const NDArrayView<T>& NDArrayView<T>::operator*=(
+    const NDArray<C, A>& a) const {
+  return *this *= a.view();
+}
+
+template <class T>
+template <class C, class A>
+const NDArrayView<T>& NDArrayView<T>::operator/=(
+    const NDArray<C, A>& a) const {
+  return *this /= a.view();
+}
+
+template <class T>
+template <class C>
+const NDArrayView<T>& NDArrayView<T>::operator+=(
+    const NDArrayView<C>& a) const {
+  apply(a, "add", [](T& e, const C& c) { e += c; });
+  return *this;
+}
+
+template <class T>
+template <class C>
+const NDArrayView<T>& NDArrayView<T>::operator-=(
+    const NDArrayView<C>& a) const {
+  apply(a, "subtract", [](T& e, const C& c) { e -= c; });
+  return *this;
+}
+
+template <class T>
+template <class C>
+const NDArrayView<T>& NDArrayView<T>::operator*=(
+    const NDArrayView<C>& a) const {
+  apply(a, "multiply", [](T& e, const C& c) { e *= c; });
+  return *this;
+}
+
+template <class T>
+template <class C>
+const NDArrayView<T>& NDArrayView<T>::operator/=(
+    const NDArrayView<C>& a) const {
+  apply(a, "divide", [](T& e, const C& c) { e /= c; });
+  return *this;
+}
+
+template <class T>
+template <class E>
+if_array_expression<const NDArrayView<T>&, E> NDArrayView<T>::operator+=(
+    const E& expr) const {
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_, shape_, strides_, expr_type<E>(expr), "add",
+                      [](T& d, const V& v) { d += v; });
+  return *this;
+}
+
+template <class T>
+template <class E>
+if_array_expression<const NDArrayView<T>&, E> NDArrayView<T>::operator-=(
+    const E& expr) const {
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_, shape_, strides_, expr_type<E>(expr), "subtract",
+                      [](T& d, const V& v) { d -= v; });
+  return *this;
+}
+
+template <class T>
+template <class E>
+if_array_expression<const NDArrayView<T>&, E> NDArrayView<T>::operator*=(
+    const E& expr) const {
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_, shape_, strides_, expr_type<E>(expr), "multiply",
+                      [](T& d, const V& v) { d *= v; });
+  return *this;
+}
+
+template <class T>
+template <class E>
+if_array_expression<const NDArrayView<T>&, E> NDArrayView<T>::operator/=(
+    const E& expr) const {
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_, shape_, strides_, expr_type<E>(expr), "divide",
+                      [](T& d, const V& v) { d /= v; });
+  return *this;
+}
+
+template <class T>
+template <class C>
+if_not_array_operand<const NDArrayView<T>&, C> NDArrayView<T>::operator+=(
+    const C& c) const {
+  apply(*this, "add", [&c](T& e, const T&) { e += c; });
+  return *this;
+}
+
+template <class T>
+template <class C>
+if_not_array_operand<const NDArrayView<T>&, C> NDArrayView<T>::operator-=(
+    const C& c) const {
+  apply(*this, "subtract", [&c](T& e, const T&) { e -= c; });
+  return *this;
+}
+
+template <class T>
+template <class C>
+if_not_array_operand<const NDArrayView<T>&, C> NDArrayView<T>::operator*=(
+    const C& c) const {
+  apply(*this, "multiply", [&c](T& e, const T&) { e *= c; });
+  return *this;
+}
+
+template <class T>
+template <class C>
+if_not_array_operand<const NDArrayView<T>&, C> NDArrayView<T>::operator/=(
+    const C& c) const {
+  apply(*this, "divide", [&c](T& e, const T&) { e /= c; });
+  return *this;
+}
+
+template <class T>
+template <class IndexContainer>
+NDARRAY_INLINE std::ptrdiff_t NDArrayView<T>::strided_index(
+    const IndexContainer& indices) const {
+#if !defined(NDARRAY_NO_BOUNDS_CHECK)
+  // Make sure proper number of indices
+  if (indices.size() != shape_.size()) {
+    std::string mssg = "Improper number of indicies provided to NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  for (size_t i = 0; i < shape_.size(); i++) {
+    if (indices[i] >= shape_[i]) {
+      std::string mssg = "Index provided to NDArray out of range.";
+      throw std::out_of_range(mssg);
+    }
+  }
+#endif
+
+  std::ptrdiff_t indx = 0;
+  for (size_t i = 0; i < indices.size(); i++) {
+    indx += strides_[i] * static_cast<std::ptrdiff_t>(indices[i]);
+  }
+
+  return indx;
+}
+
+template <class T>
+template <class C, class F>
+void NDArrayView<T>::apply(const NDArrayView<C>& a, const std::string& op,
+                           F func) const {
+  if (broadcast_shape(shape_, a.shape_, op) != shape_) {
+    std::string mssg =
+        "Cannot " + op + " NDArrays with shapes which can not be broadcast.";
+    throw std::runtime_error(mssg);
+  }
+
+  // If a reads this view through other strides, as in v += v.transpose(),
+  // its elements are copied before any are written
+  if (arrays_alias(data_, shape_, strides_, a.data_, a.shape_, a.strides_)) {
+    apply(a.as_c_contiguous().view(), op, func);
+    return;
+  }
+
+  // Broadcast axes of a are given a stride of 0
+  std::vector<std::ptrdiff_t> a_strides(shape_.size(), 0);
+  size_t lead = shape_.size() - a.shape_.size();
+  for (size_t i = 0; i < a.shape_.size(); i++) {
+    if (a.shape_[i] != 1) a_strides[lead + i] = a.strides_[i];
+  }
+
+  T* dst = data_;
+  const C* src = a.data_;
+  strided_apply(shape_, strides_, a_strides,
+                [dst, src, &func](std::ptrdiff_t a_off, std::ptrdiff_t b_off,
+                                  size_t n, std::ptrdiff_t a_step,
+                                  std::ptrdiff_t b_step) {
+                  if (a_step == 1 && b_step == 1) {
+                    // Contiguous run, which may be vectorized
+                    T* d = dst + a_off;
+                    const C* s = src + b_off;
+                    for (size_t i = 0; i < n; i++) func(d[i], s[i]);
+                  } else if (a_step == 1 && b_step == 0) {
+                    // Run against a single broadcast element
+                    T* d = dst + a_off;
+                    const C s = src[b_off];
+                    for (size_t i = 0; i < n; i++) func(d[i], s);
+                  } else {
+                    for (size_t i = 0; i < n; i++) {
+                      func(dst[a_off + static_cast<std::ptrdiff_t>(i) * a_step],
+                           src[b_off + static_cast<std::ptrdiff_t>(i) * b_step]);
+                    }
+                  }
+                });
+}
+
+//==============================================================================
+// NDIter Implementation
+template <class T>
+NDIter<T>::NDIter(T* data, const std::vector<size_t>& shape,
+                  const std::vector<std::ptrdiff_t>& strides)
+    : run_start_(data),
+      ptr_(data),
+      shape_(shape),
+      strides_(strides),
+      index_(shape.size(), 0),
+      order_(shape.size()),
+      n_run_axes_(0),
+      run_length_(1),
+      run_stride_(1),
+      run_pos_(0),
+      done_(false) {
+  if (shape_.size() != strides_.size()) {
+    std::string mssg = "NDIter shape and strides must have same size.";
+    throw std::runtime_error(mssg);
+  }
+
+  // A default constructed array has no shape and no data, so has nothing to
+  // visit.
+  if (shape_.empty() || data == nullptr) done_ = true;
+
+  // Axes are ordered by the magnitude of their strides. Among equal strides,
+  // later axes are taken as faster, as in c continuous order.
+  for (size_t i = 0; i < order_.size(); i++) {
+    order_[i] = order_.size() - 1 - i;
+  }
+  std::stable_sort(order_.begin(), order_.end(), [this](size_t a, size_t b) {
+    return std::abs(strides_[a]) < std::abs(strides_[b]);
+  });
+
+  // The run is extended over slower axes for as long as each begins where
+  // the elements of the faster ones end. Axes of length 1 never break it.
+  for (size_t k = 0; k < order_.size(); k++) {
+    size_t a = order_[k];
+    if (shape_[a] == 0) done_ = true;
+    if (shape_[a] <= 1) {
+      if (n_run_axes_ == k) n_run_axes_ = k + 1;
+    } else if (n_run_axes_ == k && run_length_ == 1) {
+      run_stride_ = strides_[a];
+      run_length_ = shape_[a];
+      n_run_axes_ = k + 1;
+    } else if (n_run_axes_ == k &&
+               strides_[a] ==
+                   run_stride_ * static_cast<std::ptrdiff_t>(run_length_)) {
+      run_length_ *= shape_[a];
+      n_run_axes_ = k + 1;
+    }
+  }
+}
+
+template <class T>
+NDARRAY_INLINE bool NDIter<T>::done() const {
+  return done_;
+}
+
+template <class T>
+NDARRAY_INLINE T& NDIter<T>::operator*() const {
+  return *ptr_;
+}
+
+template <class T>
+NDARRAY_INLINE T* NDIter<T>::operator->() const {
+  return ptr_;
+}
+
+template <class T>
+NDARRAY_INLINE const std::vector<size_t>& NDIter<T>::index() const {
+  return index_;
+}
+
+template <class T>
+NDARRAY_INLINE NDIter<T>& NDIter<T>::operator++() {
+  if (++run_pos_ < run_length_) {
+    ptr_ += run_stride_;
+    for (size_t k = 0; k < n_run_axes_; k++) {
+      size_t a = order_[k];
+      if (++index_[a] < shape_[a]) break;
+      index_[a] = 0;
+    }
+  } else {
+    next_run();
+  }
+  return *this;
+}
+
+template <class T>
+NDARRAY_INLINE T* NDIter<T>::run_data() const {
+  return ptr_;
+}
+
+template <class T>
+NDARRAY_INLINE size_t NDIter<T>::run_size() const {
+  return run_length_ - run_pos_;
+}
+
+template <class T>
+NDARRAY_INLINE std::ptrdiff_t NDIter<T>::run_stride() const {
+  return run_stride_;
+}
+
+template <class T>
+void NDIter<T>::next_run() {
+  for (size_t k = 0; k < n_run_axes_; k++) index_[order_[k]] = 0;
+  run_pos_ = 0;
+
+  // The remaining axes advance like the digits of a counter
+  for (size_t k = n_run_axes_; k < order_.size(); k++) {
+    size_t a = order_[k];
+    if (++index_[a] < shape_[a]) {
+      run_start_ += strides_[a];
+      ptr_ = run_start_;
+      return;
+    }
+    index_[a] = 0;
+    run_start_ -= strides_[a] * static_cast<std::ptrdiff_t>(shape_[a] - 1);
+  }
+  done_ = true;
+}
+
+//==============================================================================
+// FixedNDArray Implementation
+// Computes the linear index of the first I of the indices, and whether they
+// are all within the shape. The recursion is resolved at compile time,
+// leaving a sum of products with no loop, and the bounds are combined so that
+// a single branch checks all of them.
+template <size_t I>
+struct FixedIndex {
+  template <size_t N>
+  static NDARRAY_INLINE size_t get(const std::array<size_t, N>& indices,
+                                   const std::array<size_t, N>& strides) {
+    return FixedIndex<I - 1>::get(indices, strides) +
+           indices[I - 1] * strides[I - 1];
+  }
+
+  template <size_t N>
+  static NDARRAY_INLINE bool in_range(const std::array<size_t, N>& indices,
+                                      const std::array<size_t, N>& shape) {
+    return FixedIndex<I - 1>::in_range(indices, shape) &
+           (indices[I - 1] < shape[I - 1]);
+  }
+};
+
+template <>
+struct FixedIndex<0> {
+  template <size_t N>
+  static NDARRAY_INLINE size_t get(const std::array<size_t, N>&,
+                                   const std::array<size_t, N>&) {
+    return 0;
+  }
+
+  template <size_t N>
+  static NDARRAY_INLINE bool in_range(const std::array<size_t, N>&,
+                                      const std::array<size_t, N>&) {
+    return true;
+  }
+};
+
+template <class T, size_t N, class Alloc>
+FixedNDArray<T, N, Alloc>::FixedNDArray()
+    : data_{}, shape_{}, strides_{}, c_continuous_{true} {}
+
+template <class T, size_t N, class Alloc>
+FixedNDArray<T, N, Alloc>::FixedNDArray(const std::array<size_t, N>& init_shape,
+                                        bool c_continuous, const Alloc& alloc)
+    : data_(alloc), shape_{}, strides_{}, c_continuous_{c_continuous} {
+  reallocate(init_shape);
+}
+
+template <class T, size_t N, class Alloc>
+template <class E, class>
+FixedNDArray<T, N, Alloc>::FixedNDArray(const E& expr) : FixedNDArray() {
+  const expr_type<E> e(expr);
+  if (e.shape().size() != N) {
+    std::string mssg =
+        "Array with improper number of dimensions provided to FixedNDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  std::array<size_t, N> new_shape;
+  std::copy(e.shape().begin(), e.shape().end(), new_shape.begin());
+  c_continuous_ = e.linear(true) || !e.linear(false);
+  reallocate(new_shape);
+
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_.data(), e.shape(),
+                      contiguous_strides(e.shape(), c_continuous_), e,
+                      "assign", [](T& d, const V& v) { d = v; });
+}
+
+template <class T, size_t N, class Alloc>
+template <class E>
+if_array_operand<FixedNDArray<T, N, Alloc>&, E>
+FixedNDArray<T, N, Alloc>::operator=(const E& expr) {
+  const expr_type<E> e(expr);
+  const std::vector<size_t> shape = shape_vector();
+  if (e.shape() != shape) {
+    *this = FixedNDArray(expr);
+    return *this;
+  }
+
+  using V = typename expr_type<E>::value_type;
+  evaluate_expression(data_.data(), shape,
+                      contiguous_strides(shape, c_continuous_), e, "assign",
+                      [](T& d, const V& v) { d = v; });
+  return *this;
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE T& FixedNDArray<T, N, Alloc>::operator()(
+    const std::array<size_t, N>& indices) {
+  return data_[linear_index(indices)];
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE const T& FixedNDArray<T, N, Alloc>::operator()(
+    const std::array<size_t, N>& indices) const {
+  return data_[linear_index(indices)];
+}
+
+template <class T, size_t N, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE if_indices<T&, INDS...> FixedNDArray<T, N, Alloc>::operator()(
+    INDS... inds) {
+  return data_[linear_index(inds...)];
+}
+
+template <class T, size_t N, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE if_indices<const T&, INDS...>
+FixedNDArray<T, N, Alloc>::operator()(INDS... inds) const {
+  return data_[linear_index(inds...)];
+}
+
+template <class T, size_t N, class Alloc>
+template <typename... INDS>
+if_ranges<NDArrayView<T>, INDS...> FixedNDArray<T, N, Alloc>::operator()(
+    INDS... inds) {
+  return view()(inds...);
+}
+
+template <class T, size_t N, class Alloc>
+template <typename... INDS>
+if_ranges<NDArrayView<const T>, INDS...> FixedNDArray<T, N, Alloc>::operator()(
+    INDS... inds) const {
+  return view()(inds...);
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE T& FixedNDArray<T, N, Alloc>::operator[](size_t i) {
+  return data_[i];
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE const T& FixedNDArray<T, N, Alloc>::operator[](size_t i) const {
+  return data_[i];
+}
+
+template <class T, size_t N, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE T& FixedNDArray<T, N, Alloc>::at_unchecked(INDS... inds) {
+  static_assert(sizeof...(INDS) == N,
+                "Improper number of indicies provided to FixedNDArray.");
+  const std::array<size_t, N> indices{{static_cast<size_t>(inds)...}};
+  return data_[FixedIndex<N>::get(indices, strides_)];
+}
+
+template <class T, size_t N, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE const T& FixedNDArray<T, N, Alloc>::at_unchecked(
+    INDS... inds) const {
+  static_assert(sizeof...(INDS) == N,
+                "Improper number of indicies provided to FixedNDArray.");
+  const std::array<size_t, N> indices{{static_cast<size_t>(inds)...}};
+  return data_[FixedIndex<N>::get(indices, strides_)];
+}
+
+template <class T, size_t N, class Alloc>
+NDArrayView<T> FixedNDArray<T, N, Alloc>::view() {
+  return NDArrayView<T>(data_.data(), 0, shape_vector(),
+                        std::vector<std::ptrdiff_t>(strides_.begin(),
+                                                    strides_.end()));
+}
+
+template <class T, size_t N, class Alloc>
+NDArrayView<const T> FixedNDArray<T, N, Alloc>::view() const {
+  return NDArrayView<const T>(data_.data(), 0, shape_vector(),
+                              std::vector<std::ptrdiff_t>(strides_.begin(),
+                                                          strides_.end()));
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE Alloc FixedNDArray<T, N, Alloc>::get_allocator() const {
+  return data_.get_allocator();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE T* FixedNDArray<T, N, Alloc>::data() {
+  return data_.data();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE const T* FixedNDArray<T, N, Alloc>::data() const {
+  return data_.data();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE T* FixedNDArray<T, N, Alloc>::begin() {
+  return data();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE T* FixedNDArray<T, N, Alloc>::end() {
+  return data() + size();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE const T* FixedNDArray<T, N, Alloc>::begin() const {
+  return data();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE const T* FixedNDArray<T, N, Alloc>::end() const {
+  return data() + size();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE const T* FixedNDArray<T, N, Alloc>::cbegin() const {
+  return data();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE const T* FixedNDArray<T, N, Alloc>::cend() const {
+  return data() + size();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE const std::array<size_t, N>& FixedNDArray<T, N, Alloc>::shape()
+    const {
+  return shape_;
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE const std::array<size_t, N>&
+FixedNDArray<T, N, Alloc>::strides() const {
+  return strides_;
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE size_t FixedNDArray<T, N, Alloc>::size() const {
+  return data_.size();
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE size_t FixedNDArray<T, N, Alloc>::linear_index(
+    const std::array<size_t, N>& indices) const {
+#if !defined(NDARRAY_NO_BOUNDS_CHECK)
+  if (!FixedIndex<N>::in_range(indices, shape_)) {
+    std::string mssg = "Index provided to FixedNDArray out of range.";
+    throw std::out_of_range(mssg);
+  }
+#endif
+
+  return FixedIndex<N>::get(indices, strides_);
+}
+
+template <class T, size_t N, class Alloc>
+template <typename... INDS>
+NDARRAY_INLINE size_t FixedNDArray<T, N, Alloc>::linear_index(
+    INDS... inds) const {
+  static_assert(sizeof...(INDS) == N,
+                "Improper number of indicies provided to FixedNDArray.");
+  return linear_index(std::array<size_t, N>{{static_cast<size_t>(inds)...}});
+}
+
+template <class T, size_t N, class Alloc>
+NDARRAY_INLINE bool FixedNDArray<T, N, Alloc>::c_continuous() const {
+  return c_continuous_;
+}
+
+template <class T, size_t N, class Alloc>
+void FixedNDArray<T, N, Alloc>::fill(const T& val) {
+  T* data = data_.data();
+  parallel_blocks(data_.size(), 1, [data, &val](size_t begin, size_t end) {
+    std::fill(data + begin, data + end, val);
+  });
+}
+
+template <class T, size_t N, class Alloc>
+void FixedNDArray<T, N, Alloc>::reshape(
+    const std::array<size_t, N>& new_shape) {
+  size_t ne = 1;
+  for (size_t i = 0; i < N; i++) ne *= new_shape[i];
+
+  if (ne != data_.size()) {
+    std::string mssg =
+        "Shape is incompatible with number of elements in"
+        " FixedNDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  set_shape(new_shape);
+}
+
+template <class T, size_t N, class Alloc>
+void FixedNDArray<T, N, Alloc>::reallocate(
+    const std::array<size_t, N>& new_shape) {
+  size_t ne = 1;
+  for (size_t i = 0; i < N; i++) ne *= new_shape[i];
+
+  size_t old_size = data_.size();
+  data_.resize(ne);
+  zero_new_elements(data_, old_size);
+  set_shape(new_shape);
+}
+
+template <class T, size_t N, class Alloc>
+template <class C>
+FixedNDArray<T, N, Alloc>& FixedNDArray<T, N, Alloc>::operator+=(const C& c) {
+  view() += c;
+  return *this;
+}
+
+template <class T, size_t N, class Alloc>
+template <class C>
+FixedNDArray<T, N, Alloc>& FixedNDArray<T, N, Alloc>::operator-=(const C& c) {
+  view() -= c;
+  return *this;
+}
+
+template <class T, size_t N, class Alloc>
+template <class C>
+FixedNDArray<T, N, Alloc>& FixedNDArray<T, N, Alloc>::operator*=(const C& c) {
+  view() *= c;
+  return *this;
+}
+
+template <class T, size_t N, class Alloc>
+template <class C>
+FixedNDArray<T, N, Alloc>& FixedNDArray<T, N, Alloc>::operator/=(const C& c) {
+  view() /= c;
+  return *this;
+}
+
+template <class T, size_t N, class Alloc>
+void FixedNDArray<T, N, Alloc>::set_shape(
+    const std::array<size_t, N>& new_shape) {
+  shape_ = new_shape;
+
+  size_t stride = 1;
+  for (size_t i = 0; i < N; i++) {
+    size_t axis = c_continuous_ ? N - 1 - i : i;
+    strides_[axis] = stride;
+    stride *= shape_[axis];
+  }
+}
+
+template <class T, size_t N, class Alloc>
+std::vector<size_t> FixedNDArray<T, N, Alloc>::shape_vector() const {
+  return std::vector<size_t>(shape_.begin(), shape_.end());
+}
+
+//==============================================================================
+// Strided Function Definitions
+inline std::vector<std::ptrdiff_t> contiguous_strides(
+    const std::vector<size_t>& shape, bool c_continuous) {
+  std::vector<std::ptrdiff_t> strides(shape.size());
+  std::ptrdiff_t coeff = 1;
+  if (c_continuous) {
+    for (size_t i = shape.size(); i > 0; i--) {
+      strides[i - 1] = coeff;
+      coeff *= static_cast<std::ptrdiff_t>(shape[i - 1]);
+    }
+  } else {
+    for (size_t i = 0; i < shape.size(); i++) {
+      strides[i] = coeff;
+      coeff *= static_cast<std::ptrdiff_t>(shape[i]);
+    }
+  }
+  return strides;
+}
+
+template <class F>
+void strided_apply(const std::vector<size_t>& shape,
+                   const std::vector<std::ptrdiff_t>& a_strides,
+                   const std::vector<std::ptrdiff_t>& b_strides, F func) {
+  // A default constructed array has no axes, and no elements
+  size_t n_dims = shape.size();
+  if (n_dims == 0) return;
+  for (const auto& e : shape) {
+    if (e == 0) return;
+  }
+
+  // Order axes from the largest to the smallest stride of the first array,
+  // so that its elements are visited in memory order.
+  std::vector<size_t> axes(n_dims);
+  for (size_t i = 0; i < n_dims; i++) axes[i] = i;
+  std::stable_sort(axes.begin(), axes.end(), [&](size_t i, size_t j) {
+    return std::abs(a_strides[i]) > std::abs(a_strides[j]);
+  });
+
+  size_t inner = axes[n_dims - 1];
+  size_t n = shape[inner];
+  std::ptrdiff_t a_step = a_strides[inner];
+  std::ptrdiff_t b_step = b_strides[inner];
+
+  size_t n_runs = 1;
+  for (size_t k = 0; k + 1 < n_dims; k++) n_runs *= shape[axes[k]];
+
+  // Blocks of runs may be processed concurrently
+  parallel_blocks(n_runs, n, [&](size_t begin, size_t end) {
+    // Find the index of the outer axes for the first run of the block
+    std::vector<size_t> index(n_dims - 1, 0);
+    std::ptrdiff_t a_off = 0;
+    std::ptrdiff_t b_off = 0;
+    size_t r = begin;
+    for (size_t k = n_dims - 1; k > 0; k--) {
+      size_t axis = axes[k - 1];
+      index[k - 1] = r % shape[axis];
+      a_off += static_cast<std::ptrdiff_t>(index[k - 1]) * a_strides[axis];
+      b_off += static_cast<std::ptrdiff_t>(index[k - 1]) * b_strides[axis];
+      r /= shape[axis];
+    }
+
+    for (r = begin; r < end; r++) {
+      func(a_off, b_off, n, a_step, b_step);
+
+      // Increment index, with the last outer axis varying fastest
+      for (size_t k = n_dims - 1; k > 0; k--) {
+        size_t axis = axes[k - 1];
+        if (++index[k - 1] < shape[axis]) {
+          a_off += a_strides[axis];
+          b_off += b_strides[axis];
+          break;
+        }
+        a_off -=
+            static_cast<std::ptrdiff_t>(shape[axis] - 1) * a_strides[axis];
+        b_off -=
+            static_cast<std::ptrdiff_t>(shape[axis] - 1) * b_strides[axis];
+        index[k - 1] = 0;
+      }
+    }
+  });
+}
+
+template <class T, class U>
+void strided_copy(T* dst, const std::vector<std::ptrdiff_t>& dst_strides,
+                  const U* src, const std::vector<std::ptrdiff_t>& src_strides,
+                  const std::vector<size_t>& shape) {
+  size_t n_dims = shape.size();
+  if (n_dims == 0) return;
+  for (const auto& e : shape) {
+    if (e == 0) return;
+  }
+
+  // Find the fastest varying axis of each array
+  size_t di = 0;
+  size_t si = 0;
+  for (size_t i = 1; i < n_dims; i++) {
+    if (std::abs(dst_strides[i]) < std::abs(dst_strides[di])) di = i;
+    if (std::abs(src_strides[i]) < std::abs(src_strides[si])) si = i;
+  }
+
+  if (n_dims < 2 || di == si || shape[di] == 1 || shape[si] == 1) {
+    // Both arrays are read along the same axis, so there is nothing to gain
+    // from tiling.
+    strided_apply(shape, dst_strides, src_strides,
+                  [dst, src](std::ptrdiff_t a_off, std::ptrdiff_t b_off,
+                             size_t n, std::ptrdiff_t a_step,
+                             std::ptrdiff_t b_step) {
+                    if (a_step == 1 && b_step == 1) {
+                      T* d = dst + a_off;
+                      const U* s = src + b_off;
+                      for (size_t i = 0; i < n; i++) d[i] = s[i];
+                    } else {
+                      for (size_t i = 0; i < n; i++) {
+                        dst[a_off + static_cast<std::ptrdiff_t>(i) * a_step] =
+                            src[b_off + static_cast<std::ptrdiff_t>(i) * b_step];
+                      }
+                    }
+                  });
+    return;
+  }
+
+  // A tile of each array takes at most 8 KiB, so both fit in the L1 cache
+  const size_t element_size = std::max(sizeof(T), sizeof(U));
+  size_t tile = 8;
+  while (4 * tile * tile * element_size <= 8192) tile *= 2;
+
+  const std::ptrdiff_t d_di = dst_strides[di];
+  const std::ptrdiff_t d_si = dst_strides[si];
+  const std::ptrdiff_t s_di = src_strides[di];
+  const std::ptrdiff_t s_si = src_strides[si];
+  const size_t n_di = shape[di];
+  const size_t n_si = shape[si];
+
+  // Remaining axes are iterated over in the memory order of dst
+  std::vector<size_t> outer;
+  for (size_t i = 0; i < n_dims; i++) {
+    if (i != di && i != si) outer.push_back(i);
+  }
+  std::stable_sort(outer.begin(), outer.end(), [&](size_t i, size_t j) {
+    return std::abs(dst_strides[i]) > std::abs(dst_strides[j]);
+  });
+
+  std::vector<size_t> index(outer.size(), 0);
+  std::ptrdiff_t d_off = 0;
+  std::ptrdiff_t s_off = 0;
+  while (true) {
+    for (size_t sb = 0; sb < n_si; sb += tile) {
+      size_t s_end = std::min(sb + tile, n_si);
+      for (size_t db = 0; db < n_di; db += tile) {
+        size_t d_end = std::min(db + tile, n_di);
+        for (size_t j = sb; j < s_end; j++) {
+          T* d = dst + d_off + static_cast<std::ptrdiff_t>(j) * d_si;
+          const U* s = src + s_off + static_cast<std::ptrdiff_t>(j) * s_si;
+          for (size_t i = db; i < d_end; i++) {
+            d[static_cast<std::ptrdiff_t>(i) * d_di] =
+                s[static_cast<std::ptrdiff_t>(i) * s_di];
+          }
+        }
+      }
+    }
+
+    // Increment index, with the last outer axis varying fastest
+    size_t k = outer.size();
+    while (k > 0) {
+      k--;
+      size_t axis = outer[k];
+      if (++index[k] < shape[axis]) {
+        d_off += dst_strides[axis];
+        s_off += src_strides[axis];
+        break;
+      }
+      d_off -= static_cast<std::ptrdiff_t>(shape[axis] - 1) * dst_strides[axis];
+      s_off -= static_cast<std::ptrdiff_t>(shape[axis] - 1) * src_strides[axis];
+      index[k] = 0;
+      if (k == 0) return;
+    }
+    if (outer.empty()) return;
+  }
+}
+
+//==============================================================================
+// Reduction Function Definitions
+template <class T>
+T pairwise_sum(const T* x, size_t n) {
+  if (n <= 128) {
+    // Eight independent partial sums, which may be vectorized
+    T partial[8] = {};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      for (size_t k = 0; k < 8; k++) partial[k] += x[i + k];
+    }
+
+    T sum = ((partial[0] + partial[1]) + (partial[2] + partial[3])) +
+            ((partial[4] + partial[5]) + (partial[6] + partial[7]));
+    for (; i < n; i++) sum += x[i];
+    return sum;
+  }
+
+  // Split on a multiple of 8 elements, to keep the partial sums aligned
+  size_t half = n / 16 * 8;
+  return pairwise_sum(x, half) + pairwise_sum(x + half, n - half);
+}
+
+template <class T>
+T pairwise_dot(const T* x, const T* y, size_t n) {
+  if (n <= 128) {
+    T partial[8] = {};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      for (size_t k = 0; k < 8; k++) partial[k] += x[i + k] * y[i + k];
+    }
+
+    T sum = ((partial[0] + partial[1]) + (partial[2] + partial[3])) +
+            ((partial[4] + partial[5]) + (partial[6] + partial[7]));
+    for (; i < n; i++) sum += x[i] * y[i];
+    return sum;
+  }
+
+  size_t half = n / 16 * 8;
+  return pairwise_dot(x, y, half) +
+         pairwise_dot(x + half, y + half, n - half);
+}
+
+template <class T>
+void pairwise_sum_rows(const T* x, size_t n_rows, size_t row_stride,
+                       size_t n_cols, T* out, T* scratch) {
+  if (n_rows <= 16) {
+    std::fill(out, out + n_cols, T());
+    for (size_t r = 0; r < n_rows; r++) {
+      const T* row = x + r * row_stride;
+      for (size_t c = 0; c < n_cols; c++) out[c] += row[c];
+    }
+    return;
+  }
+
+  // The first half is summed into out, using scratch for its own halves,
+  // and the second half into the first row of scratch.
+  size_t half = n_rows / 2;
+  pairwise_sum_rows(x, half, row_stride, n_cols, out, scratch);
+  pairwise_sum_rows(x + half * row_stride, n_rows - half, row_stride, n_cols,
+                    scratch, scratch + n_cols);
+  for (size_t c = 0; c < n_cols; c++) out[c] += scratch[c];
+}
+
+inline size_t pairwise_depth(size_t n_rows) {
+  size_t depth = 0;
+  while (n_rows > 16) {
+    n_rows -= n_rows / 2;
+    depth++;
+  }
+  return depth;
+}
+
+template <class Compare, class T>
+NDARRAY_INLINE bool more_extreme(const T& x, const T& best) {
+  // x != x only holds for NaN
+  return Compare()(x, best) || (x != x && best == best);
+}
+
+template <class Compare, class T>
+NDARRAY_INLINE T select_extreme(const T& x, const T& best) {
+  // The operators are not short circuited, so that this may be vectorized
+  return (Compare()(x, best) | (x != x)) ? x : best;
+}
+
+inline void reduction_dims(const std::vector<size_t>& shape, bool c_continuous,
+                           size_t axis, size_t& outer, size_t& len,
+                           size_t& inner) {
+  outer = 1;
+  inner = 1;
+  len = shape[axis];
+  for (size_t i = 0; i < shape.size(); i++) {
+    if (i == axis) continue;
+    if ((i > axis) == c_continuous) {
+      inner *= shape[i];
+    } else {
+      outer *= shape[i];
+    }
+  }
+}
+
+template <class F>
+void reduce_axis(size_t outer, size_t len, size_t inner, F func) {
+  // Columns are taken in blocks, so that the sums of a block stay in the
+  // cache while its rows are streamed through.
+  const size_t block = 512;
+  size_t n_blocks = (inner + block - 1) / block;
+  parallel_blocks(outer * n_blocks, len * std::min(inner, block),
+                  [&](size_t begin, size_t end) {
+                    for (size_t t = begin; t < end; t++) {
+                      size_t o = t / n_blocks;
+                      size_t c = (t % n_blocks) * block;
+                      func(o, c, std::min(inner, c + block));
+                    }
+                  });
+}
+
+//==============================================================================
+// Array Expression Implementation
+template <class T>
+template <class A>
+ExprTerm<T>::ExprTerm(const NDArray<T, A>& a)
+    : data_{a.data()},
+      shape_{a.shape()},
+      strides_{contiguous_strides(a.shape(), a.c_continuous())},
+      c_linear_{a.c_continuous()},
+      fortran_linear_{!a.c_continuous()},
+      base_{a.data()},
+      step_{0} {
+  // Arrays with a single axis are linear in either order
+  if (shape_.size() == 1) c_linear_ = fortran_linear_ = true;
+}
+
+template <class T>
+template <size_t N, class A>
+ExprTerm<T>::ExprTerm(const FixedNDArray<T, N, A>& a) : ExprTerm(a.view()) {}
+
+template <class T>
+ExprTerm<T>::ExprTerm(const NDArrayView<T>& a)
+    : ExprTerm(NDArrayView<const T>(a)) {}
+
+template <class T>
+ExprTerm<T>::ExprTerm(const NDArrayView<const T>& a)
+    : data_{a.data()},
+      shape_{a.shape()},
+      strides_{a.strides()},
+      c_linear_{a.c_continuous()},
+      fortran_linear_{a.fortran_continuous()},
+      base_{a.data()},
+      step_{0} {}
+
+template <class T>
+NDARRAY_INLINE const std::vector<size_t>& ExprTerm<T>::shape() const {
+  return shape_;
+}
+
+template <class T>
+NDARRAY_INLINE bool ExprTerm<T>::linear(bool c_continuous) const {
+  return c_continuous ? c_linear_ : fortran_linear_;
+}
+
+template <class T>
+NDARRAY_INLINE const T& ExprTerm<T>::operator[](size_t i) const {
+  return data_[i];
+}
+
+template <class T>
+void ExprTerm<T>::seek(const std::vector<size_t>& index, size_t axis) {
+  // Axes are aligned on the last axis, with broadcast axes taking stride 0
+  size_t lead = index.size() - shape_.size();
+  std::ptrdiff_t indx = 0;
+  for (size_t i = 0; i < shape_.size(); i++) {
+    if (shape_[i] != 1) {
+      indx += strides_[i] * static_cast<std::ptrdiff_t>(index[lead + i]);
+    }
+  }
+  base_ = data_ + indx;
+
+  step_ = 0;
+  if (axis >= lead && shape_[axis - lead] != 1) step_ = strides_[axis - lead];
+}
+
+template <class T>
+NDARRAY_INLINE const T& ExprTerm<T>::run(size_t j) const {
+  return base_[static_cast<std::ptrdiff_t>(j) * step_];
+}
+
+template <class T>
+template <class D>
+bool ExprTerm<T>::aliases(const D* dst, const std::vector<size_t>& shape,
+                          const std::vector<std::ptrdiff_t>& strides) const {
+  return arrays_alias(dst, shape, strides, data_, shape_, strides_);
+}
+
+template <class C>
+ExprScalar<C>::ExprScalar(const C& c) : value_{c}, shape_{} {}
+
+template <class C>
+NDARRAY_INLINE const std::vector<size_t>& ExprScalar<C>::shape() const {
+  return shape_;
+}
+
+template <class C>
+NDARRAY_INLINE bool ExprScalar<C>::linear(bool) const {
+  return true;
+}
+
+template <class C>
+NDARRAY_INLINE const C& ExprScalar<C>::operator[](size_t) const {
+  return value_;
+}
+
+template <class C>
+NDARRAY_INLINE void ExprScalar<C>::seek(const std::vector<size_t>&, size_t) {}
+
+template <class C>
+NDARRAY_INLINE const C& ExprScalar<C>::run(size_t) const {
+  return value_;
+}
+
+template <class C>
+template <class D>
+NDARRAY_INLINE bool ExprScalar<C>::aliases(
+    const D*, const std::vector<size_t>&,
+    const std::vector<std::ptrdiff_t>&) const {
+  return false;
+}
+
+template <class Op, class E>
+ExprUnary<Op, E>::ExprUnary(const E& e) : e_{e} {}
+
+template <class Op, class E>
+NDARRAY_INLINE const std::vector<size_t>& ExprUnary<Op, E>::shape() const {
+  return e_.shape();
+}
+
+template <class Op, class E>
+NDARRAY_INLINE bool ExprUnary<Op, E>::linear(bool c_continuous) const {
+  return e_.linear(c_continuous);
+}
+
+template <class Op, class E>
+NDARRAY_INLINE typename ExprUnary<Op, E>::value_type ExprUnary<Op, E>::
+operator[](size_t i) const {
+  return Op::apply(e_[i]);
+}
+
+template <class Op, class E>
+NDARRAY_INLINE void ExprUnary<Op, E>::seek(const std::vector<size_t>& index,
+                                           size_t axis) {
+  e_.seek(index, axis);
+}
+
+template <class Op, class E>
+NDARRAY_INLINE typename ExprUnary<Op, E>::value_type ExprUnary<Op, E>::run(
+    size_t j) const {
+  return Op::apply(e_.run(j));
+}
+
+template <class Op, class E>
+template <class D>
+bool ExprUnary<Op, E>::aliases(
+    const D* dst, const std::vector<size_t>& shape,
+    const std::vector<std::ptrdiff_t>& strides) const {
+  return e_.aliases(dst, shape, strides);
+}
+
+template <class Op, class L, class R>
+ExprBinary<Op, L, R>::ExprBinary(const L& l, const R& r)
+    : l_{l}, r_{r}, shape_{broadcast_shape(l.shape(), r.shape(), Op::name())} {}
+
+template <class Op, class L, class R>
+NDARRAY_INLINE const std::vector<size_t>& ExprBinary<Op, L, R>::shape() const {
+  return shape_;
+}
+
+template <class Op, class L, class R>
+NDARRAY_INLINE bool ExprBinary<Op, L, R>::linear(bool c_continuous) const {
+  // Broadcast operands can not be indexed linearly
+  return l_.linear(c_continuous) && r_.linear(c_continuous) &&
+         (l_.shape().empty() || l_.shape() == shape_) &&
+         (r_.shape().empty() || r_.shape() == shape_);
+}
+
+template <class Op, class L, class R>
+NDARRAY_INLINE typename ExprBinary<Op, L, R>::value_type ExprBinary<Op, L, R>::
+operator[](size_t i) const {
+  return Op::apply(l_[i], r_[i]);
+}
+
+template <class Op, class L, class R>
+NDARRAY_INLINE void ExprBinary<Op, L, R>::seek(
+    const std::vector<size_t>& index, size_t axis) {
+  l_.seek(index, axis);
+  r_.seek(index, axis);
+}
+
+template <class Op, class L, class R>
+NDARRAY_INLINE typename ExprBinary<Op, L, R>::value_type
+ExprBinary<Op, L, R>::run(size_t j) const {
+  return Op::apply(l_.run(j), r_.run(j));
+}
+
+template <class Op, class L, class R>
+template <class D>
+bool ExprBinary<Op, L, R>::aliases(
+    const D* dst, const std::vector<size_t>& shape,
+    const std::vector<std::ptrdiff_t>& strides) const {
+  return l_.aliases(dst, shape, strides) || r_.aliases(dst, shape, strides);
+}
+
+template <class L, class R>
+expr_binary<ExprAdd, L, R> operator+(const L& l, const R& r) {
+  return expr_binary<ExprAdd, L, R>(expr_type<L>(l), expr_type<R>(r));
+}
+
+template <class L, class R>
+expr_binary<ExprSubtract, L, R> operator-(const L& l, const R& r) {
+  return expr_binary<ExprSubtract, L, R>(expr_type<L>(l), expr_type<R>(r));
+}
+
+template <class L, class R>
+expr_binary<ExprMultiply, L, R> operator*(const L& l, const R& r) {
+  return expr_binary<ExprMultiply, L, R>(expr_type<L>(l), expr_type<R>(r));
+}
+
+template <class L, class R>
+expr_binary<ExprDivide, L, R> operator/(const L& l, const R& r) {
+  return expr_binary<ExprDivide, L, R>(expr_type<L>(l), expr_type<R>(r));
+}
+
+template <class E>
+expr_unary<ExprNegate, E> operator-(const E& e) {
+  return expr_unary<ExprNegate, E>(expr_type<E>(e));
+}
+
+template <class L, class R>
+expr_binary<ExprPow, L, R> pow(const L& l, const R& r) {
+  return expr_binary<ExprPow, L, R>(expr_type<L>(l), expr_type<R>(r));
+}
+
+template <class E>
+expr_unary<ExprAbs, E> abs(const E& e) {
+  return expr_unary<ExprAbs, E>(expr_type<E>(e));
+}
+
+template <class E>
+expr_unary<ExprSqrt, E> sqrt(const E& e) {
+  return expr_unary<ExprSqrt, E>(expr_type<E>(e));
+}
+
+template <class E>
+expr_unary<ExprExp, E> exp(const E& e) {
+  return expr_unary<ExprExp, E>(expr_type<E>(e));
+}
+
+template <class E>
+expr_unary<ExprLog, E> log(const E& e) {
+  return expr_unary<ExprLog, E>(expr_type<E>(e));
+}
+
+template <class E>
+expr_unary<ExprSin, E> sin(const E& e) {
+  return expr_unary<ExprSin, E>(expr_type<E>(e));
+}
+
+template <class E>
+expr_unary<ExprCos, E> cos(const E& e) {
+  return expr_unary<ExprCos, E>(expr_type<E>(e));
+}
+
+template <class E>
+expr_unary<ExprTan, E> tan(const E& e) {
+  return expr_unary<ExprTan, E>(expr_type<E>(e));
+}
+
+inline std::vector<size_t> broadcast_shape(const std::vector<size_t>& a,
+                                           const std::vector<size_t>& b,
+                                           const std::string& op) {
+  const std::vector<size_t>& longer = a.size() >= b.size() ? a : b;
+  const std::vector<size_t>& shorter = a.size() >= b.size() ? b : a;
+  size_t lead = longer.size() - shorter.size();
+
+  std::vector<size_t> shape = longer;
+  for (size_t i = 0; i < shorter.size(); i++) {
+    size_t& s = shape[lead + i];
+    if (s == 1) {
+      s = shorter[i];
+    } else if (shorter[i] != 1 && shorter[i] != s) {
+      std::string mssg =
+          "Cannot " + op + " NDArrays with shapes which can not be broadcast.";
+      throw std::runtime_error(mssg);
+    }
+  }
+
+  return shape;
+}
+
+template <class T, class U>
+bool arrays_alias(const T* a, const std::vector<size_t>& a_shape,
+                  const std::vector<std::ptrdiff_t>& a_strides, const U* b,
+                  const std::vector<size_t>& b_shape,
+                  const std::vector<std::ptrdiff_t>& b_strides) {
+  // Each element of b is then read before the same element of a is written
+  if (std::is_same<typename std::remove_const<T>::type,
+                   typename std::remove_const<U>::type>::value &&
+      static_cast<const void*>(a) == static_cast<const void*>(b) &&
+      a_shape == b_shape && a_strides == b_strides) {
+    return false;
+  }
+
+  // Finds the first and one past the last byte spanned by an array
+  auto extent = [](const char* data, const std::vector<size_t>& shape,
+                   const std::vector<std::ptrdiff_t>& strides, size_t size,
+                   const char*& begin, const char*& end) {
+    std::ptrdiff_t lo = 0;
+    std::ptrdiff_t hi = 0;
+    for (size_t i = 0; i < shape.size(); i++) {
+      if (shape[i] == 0) return false;
+      std::ptrdiff_t span =
+          static_cast<std::ptrdiff_t>(shape[i] - 1) * strides[i];
+      if (span < 0) {
+        lo += span;
+      } else {
+        hi += span;
+      }
+    }
+    begin = data + lo * static_cast<std::ptrdiff_t>(size);
+    end = data + (hi + 1) * static_cast<std::ptrdiff_t>(size);
+    return true;
+  };
+
+  const char *a_begin, *a_end, *b_begin, *b_end;
+  if (!extent(reinterpret_cast<const char*>(a), a_shape, a_strides,
+              sizeof(T), a_begin, a_end) ||
+      !extent(reinterpret_cast<const char*>(b), b_shape, b_strides,
+              sizeof(U), b_begin, b_end)) {
+    return false;
+  }
+
+  return std::less<const char*>()(a_begin, b_end) &&
+         std::less<const char*>()(b_begin, a_end);
+}
+
+template <class T, class E, class F>
+void evaluate_expression(T* dst, const std::vector<size_t>& shape,
+                         const std::vector<std::ptrdiff_t>& strides,
+                         const E& expr, const std::string& op, F func) {
+  if (!expr.aliases(dst, shape, strides)) {
+    evaluate_expression_direct(dst, shape, strides, expr, op, func);
+    return;
+  }
+
+  // The expression is evaluated into a temporary in the layout of dst, which
+  // is then applied to dst
+  using V = typename E::value_type;
+  bool c_continuous = strides != contiguous_strides(shape, false);
+  NDArray<V> tmp = NDArray<V>::uninitialized(shape, c_continuous);
+  evaluate_expression_direct(tmp.data(), shape,
+                             contiguous_strides(shape, c_continuous), expr, op,
+                             [](V& d, const V& v) { d = v; });
+  evaluate_expression_direct(dst, shape, strides, ExprTerm<V>(tmp), op, func);
+}
+
+template <class T, class E, class F>
+void evaluate_expression_direct(T* dst, const std::vector<size_t>& shape,
+                                const std::vector<std::ptrdiff_t>& strides,
+                                const E& expr, const std::string& op,
+                                F func) {
+  // The expression may be broadcast to dst, but not the other way around
+  if (broadcast_shape(shape, expr.shape(), op) != shape) {
+    std::string mssg =
+        "Cannot " + op + " NDArrays with shapes which can not be broadcast.";
+    throw std::runtime_error(mssg);
+  }
+
+  // A default constructed array has no axes, and no elements
+  if (shape.empty()) return;
+  size_t n = 1;
+  for (const auto& e : shape) n *= e;
+  if (n == 0) return;
+
+  // Fast path, where all elements are in the same linear order
+  if (expr.shape() == shape &&
+      ((expr.linear(true) && strides == contiguous_strides(shape, true)) ||
+       (expr.linear(false) && strides == contiguous_strides(shape, false)))) {
+    parallel_blocks(n, 1, [dst, &expr, &func](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) func(dst[i], expr[i]);
+    });
+    return;
+  }
+
+  // Otherwise, go through runs along the fastest axis of dst, with the
+  // remaining axes in c continuous order. Blocks of runs may be evaluated
+  // concurrently, each with its own copy of the expression.
+  size_t axis = shape.size() - 1;
+  for (size_t i = 0; i < shape.size(); i++) {
+    if (shape[i] > 1 && (shape[axis] == 1 ||
+                         std::abs(strides[i]) < std::abs(strides[axis]))) {
+      axis = i;
+    }
+  }
+  const size_t n_run = shape[axis];
+  const std::ptrdiff_t step = strides[axis];
+
+  parallel_blocks(n / n_run, n_run, [&](size_t begin, size_t end) {
+    // Find the index of the first run of the block
+    std::vector<size_t> index(shape.size(), 0);
+    std::ptrdiff_t offset = 0;
+    size_t r = begin;
+    for (size_t k = shape.size(); k > 0; k--) {
+      if (k - 1 == axis) continue;
+      index[k - 1] = r % shape[k - 1];
+      offset += static_cast<std::ptrdiff_t>(index[k - 1]) * strides[k - 1];
+      r /= shape[k - 1];
+    }
+
+    E e(expr);
+    for (r = begin; r < end; r++) {
+      e.seek(index, axis);
+      T* d = dst + offset;
+      if (step == 1) {
+        for (size_t j = 0; j < n_run; j++) func(d[j], e.run(j));
+      } else {
+        for (size_t j = 0; j < n_run; j++) {
+          func(d[static_cast<std::ptrdiff_t>(j) * step], e.run(j));
+        }
+      }
+
+      // Move to the next run
+      for (size_t k = shape.size(); k > 0; k--) {
+        if (k - 1 == axis) continue;
+        if (++index[k - 1] < shape[k - 1]) {
+          offset += strides[k - 1];
+          break;
+        }
+        offset -=
+            static_cast<std::ptrdiff_t>(shape[k - 1] - 1) * strides[k - 1];
+        index[k - 1] = 0;
+      }
+    }
+  });
+}
+
+//==============================================================================
+// MappedNDArray Implementation
+template <class T>
+MappedNDArray<T>::MappedNDArray(const std::string& fname, MapMode mode)
+    : map_ptr_{nullptr},
+      map_size_{0},
+      data_{nullptr},
+      size_{0},
+      shape_{},
+      strides_{},
+      c_continuous_{true},
+      mode_{mode},
+      copy_{} {
+  if (mode_ == MapMode::READ_ONLY && !std::is_const<T>::value) {
+    std::string mssg =
+        "A READ_ONLY MappedNDArray must have a const element type.";
+    throw std::runtime_error(mssg);
+  }
+
+#if defined(NDARRAY_POSIX)
+  // Open file and get its size
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::string mssg = "Could not open " + fname + " to be mapped.";
+    throw std::runtime_error(mssg);
+  }
+
+  struct stat file_stats;
+  if (::fstat(fd, &file_stats) != 0) {
+    ::close(fd);
+    std::string mssg = "Could not determine the size of " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+  map_size_ = static_cast<size_t>(file_stats.st_size);
+
+  if (map_size_ == 0) {
+    ::close(fd);
+    std::string mssg = fname + " is an invalid .npy file.";
+    throw std::runtime_error(mssg);
+  }
+
+  // Map entire file. A read only mapping is shared, so that all processes
+  // mapping the file use the same physical pages.
+  int prot = PROT_READ;
+  int flags = MAP_SHARED;
+  if (mode_ == MapMode::COPY_ON_WRITE) {
+    prot = PROT_READ | PROT_WRITE;
+    flags = MAP_PRIVATE;
+  }
+  map_ptr_ = ::mmap(nullptr, map_size_, prot, flags, fd, 0);
+
+  // The mapping remains valid once the file descriptor is closed
+  ::close(fd);
+
+  if (map_ptr_ == MAP_FAILED) {
+    map_ptr_ = nullptr;
+    std::string mssg = "Could not memory map " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+
+  try {
+    init(static_cast<const char*>(map_ptr_), map_size_, fname, false);
+  } catch (...) {
+    unmap();
+    throw;
+  }
+#else
+  (void)fname;
+  std::string mssg = "Memory mapping is not supported on this platform.";
+  throw std::runtime_error(mssg);
+#endif
+}
+
+template <class T>
+MappedNDArray<T>::MappedNDArray(const void* buffer, size_t n_bytes)
+    : map_ptr_{nullptr},
+      map_size_{0},
+      data_{nullptr},
+      size_{0},
+      shape_{},
+      strides_{},
+      c_continuous_{true},
+      mode_{MapMode::READ_ONLY},
+      copy_{} {
+  static_assert(std::is_const<T>::value,
+                "MappedNDArray over a const buffer must have const elements.");
+  init(static_cast<const char*>(buffer), n_bytes, "buffer", true);
+}
+
+template <class T>
+void MappedNDArray<T>::init(const char* bytes, size_t n_bytes,
+                            const std::string& name, bool allow_copy) {
+  // Get expected DType according to T
+  DType expected_dtype = type_to_DType<value_type>();
+
+  // Read preamble and header
+  NpyInfo info = read_npy_info(bytes, n_bytes, name);
+
+  // Ensure DType variables match
+  if (expected_dtype != info.dtype) {
+    std::string mssg =
+        "MappedNDArray template datatype does not match specified datatype "
+        "in npy file.";
+    throw std::runtime_error(mssg);
+  }
+
+  shape_ = info.shape;
+  c_continuous_ = info.c_contiguous;
+
+  // Number of elements, and of bytes up to the end of the data. A shape
+  // which overflows can not fit in the buffer.
+  size_t n_elements = 1;
+  size_t data_end = 0;
+  bool fits = true;
+  for (size_t i = 0; i < shape_.size() && fits; i++) {
+    fits = checked_multiply(n_elements, shape_[i], n_elements);
+  }
+  fits = fits && checked_multiply(n_elements, sizeof(T), data_end) &&
+         checked_add(data_end, info.data_offset, data_end);
+
+  // Ensure buffer actually contains all of the data
+  if (!fits || data_end > n_bytes) {
+    std::string mssg = name + " does not contain all of the array data.";
+    throw std::runtime_error(mssg);
+  }
+  size_ = n_elements;
+
+  // Mappings are page aligned, so data is only misaligned if the header was
+  // not padded properly when the file was written, or if the buffer itself
+  // is misaligned.
+  const char* data_bytes = bytes + info.data_offset;
+  bool aligned =
+      reinterpret_cast<std::uintptr_t>(data_bytes) % alignof(T) == 0;
+
+  // If byte order of data different from byte order of system, data can
+  // only be swapped in place in a private mapping.
+  bool swap = system_is_little_endian() != info.little_endian;
+
+  if (aligned && (!swap || mode_ == MapMode::COPY_ON_WRITE)) {
+    data_ = reinterpret_cast<T*>(const_cast<char*>(data_bytes));
+  } else if (allow_copy) {
+    copy_.resize(size_);
+    std::memcpy(copy_.data(), data_bytes, size_ * sizeof(T));
+    data_ = copy_.data();
+  } else if (!aligned) {
+    std::string mssg =
+        "Data in " + name + " is not aligned, and cannot be mapped.";
+    throw std::runtime_error(mssg);
+  } else {
+    std::string mssg = "Byte order of " + name +
+                       " differs from system, and cannot be mapped as"
+                       " READ_ONLY.";
+    throw std::runtime_error(mssg);
+  }
+
+  // Data is only swapped in a copy, or in a private mapping, both of which
+  // may be written even if T is const
+  if (swap) {
+    swap_bytes(const_cast<char*>(reinterpret_cast<const char*>(data_)), size_,
+               info.dtype);
+  }
+
+  // Get strides for indexing
+  strides_.resize(shape_.size());
+  size_t coeff = 1;
+  if (c_continuous_) {
+    for (size_t i = shape_.size(); i > 0; i--) {
+      strides_[i - 1] = coeff;
+      coeff *= shape_[i - 1];
+    }
+  } else {
+    for (size_t i = 0; i < shape_.size(); i++) {
+      strides_[i] = coeff;
+      coeff *= shape_[i];
+    }
+  }
+}
+
+template <class T>
+MappedNDArray<T>::~MappedNDArray() {
+  unmap();
+}
+
+template <class T>
+MappedNDArray<T>::MappedNDArray(MappedNDArray&& other)
+    : map_ptr_{other.map_ptr_},
+      map_size_{other.map_size_},
+      data_{other.data_},
+      size_{other.size_},
+      shape_{std::move(other.shape_)},
+      strides_{std::move(other.strides_)},
+      c_continuous_{other.c_continuous_},
+      mode_{other.mode_},
+      copy_{std::move(other.copy_)} {
+  other.map_ptr_ = nullptr;
+  other.map_size_ = 0;
+  other.data_ = nullptr;
+  other.size_ = 0;
+}
+
+template <class T>
+MappedNDArray<T>& MappedNDArray<T>::operator=(MappedNDArray&& other) {
+  if (this != &other) {
+    unmap();
+
+    map_ptr_ = other.map_ptr_;
+    map_size_ = other.map_size_;
+    data_ = other.data_;
+    size_ = other.size_;
+    shape_ = std::move(other.shape_);
+    strides_ = std::move(other.strides_);
+    c_continuous_ = other.c_continuous_;
+    mode_ = other.mode_;
+    copy_ = std::move(other.copy_);
+
+    other.map_ptr_ = nullptr;
+    other.map_size_ = 0;
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+
+  return *this;
+}
+
+template <class T>
+NDARRAY_INLINE T& MappedNDArray<T>::operator()(
+    const std::vector<size_t>& indices) {
+  return data_[strided_index(indices)];
+}
+
+template <class T>
+NDARRAY_INLINE const T& MappedNDArray<T>::operator()(
+    const std::vector<size_t>& indices) const {
+  return data_[strided_index(indices)];
+}
+
+template <class T>
+template <typename... INDS>
+NDARRAY_INLINE T& MappedNDArray<T>::operator()(INDS... inds) {
+  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  return data_[strided_index(indices)];
+}
+
+template <class T>
+template <typename... INDS>
+NDARRAY_INLINE const T& MappedNDArray<T>::operator()(INDS... inds) const {
+  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  return data_[strided_index(indices)];
+}
+
+template <class T>
+NDARRAY_INLINE T& MappedNDArray<T>::operator[](size_t i) {
+  return data_[i];
+}
+
+template <class T>
+NDARRAY_INLINE const T& MappedNDArray<T>::operator[](size_t i) const {
+  return data_[i];
+}
+
+template <class T>
+NDARRAY_INLINE T* MappedNDArray<T>::data() {
+  return data_;
+}
+
+template <class T>
+NDARRAY_INLINE const T* MappedNDArray<T>::data() const {
+  return data_;
+}
+
+template <class T>
+NDARRAY_INLINE T* MappedNDArray<T>::begin() {
+  return data();
+}
+
+template <class T>
+NDARRAY_INLINE T* MappedNDArray<T>::end() {
+  return data() + size();
+}
+
+template <class T>
+NDARRAY_INLINE const T* MappedNDArray<T>::begin() const {
+  return data();
+}
+
+template <class T>
+NDARRAY_INLINE const T* MappedNDArray<T>::end() const {
+  return data() + size();
+}
+
+template <class T>
+NDARRAY_INLINE const T* MappedNDArray<T>::cbegin() const {
+  return data();
+}
+
+template <class T>
+NDARRAY_INLINE const T* MappedNDArray<T>::cend() const {
+  return data() + size();
+}
+
+template <class T>
+NDARRAY_INLINE const std::vector<size_t>& MappedNDArray<T>::shape() const {
+  return shape_;
+}
+
+template <class T>
+NDARRAY_INLINE size_t MappedNDArray<T>::size() const {
+  return size_;
+}
+
+template <class T>
+NDARRAY_INLINE size_t
+MappedNDArray<T>::linear_index(const std::vector<size_t>& indices) const {
+  return strided_index(indices);
+}
+
+template <class T>
+template <typename... INDS>
+NDARRAY_INLINE size_t MappedNDArray<T>::linear_index(INDS... inds) const {
+  std::array<size_t, sizeof...(inds)> indices{static_cast<size_t>(inds)...};
+  return strided_index(indices);
+}
+
+template <class T>
+NDARRAY_INLINE bool MappedNDArray<T>::c_continuous() const {
+  return c_continuous_;
+}
+
+template <class T>
+NDARRAY_INLINE MapMode MappedNDArray<T>::mode() const {
+  return mode_;
+}
+
+template <class T>
+NDARRAY_INLINE bool MappedNDArray<T>::zero_copy() const {
+  return copy_.empty();
+}
+
+template <class T>
+NDArray<typename MappedNDArray<T>::value_type> MappedNDArray<T>::copy() const {
+  NDArray<value_type> new_array(std::vector<value_type>(data_, data_ + size_),
+                                shape_, c_continuous_);
+  return new_array;
+}
+
+template <class T>
+void MappedNDArray<T>::unmap() {
+#if defined(NDARRAY_POSIX)
+  if (map_ptr_) {
+    ::munmap(map_ptr_, map_size_);
+  }
+#endif
+  map_ptr_ = nullptr;
+  map_size_ = 0;
+  data_ = nullptr;
+  size_ = 0;
+  copy_.clear();
+}
+
+template <class T>
+template <class IndexContainer>
+NDARRAY_INLINE size_t
+MappedNDArray<T>::strided_index(const IndexContainer& indices) const {
+#if !defined(NDARRAY_NO_BOUNDS_CHECK)
+  // Make sure proper number of indices
+  if (indices.size() != shape_.size()) {
+    std::string mssg = "Improper number of indicies provided to NDArray.";
+    throw std::runtime_error(mssg);
+  }
+
+  for (size_t i = 0; i < shape_.size(); i++) {
+    if (indices[i] >= shape_[i]) {
+      std::string mssg = "Index provided to NDArray out of range.";
+      throw std::out_of_range(mssg);
+    }
+  }
+#endif
+
+  size_t indx = 0;
+  for (size_t i = 0; i < indices.size(); i++) {
+    indx += strides_[i] * indices[i];
+  }
+
+  return indx;
+}
+
+//==============================================================================
+// NpyWriter Implementation
+template <class T>
+NpyWriter<T>::NpyWriter(const std::string& fname,
+                        const std::vector<size_t>& row_shape)
+    : file_{},
+      fname_{fname},
+      row_shape_{row_shape},
+      row_size_{1},
+      n_rows_{0},
+      header_length_{0},
+      dtype_{type_to_DType<T>()} {
+  for (const auto& e : row_shape_) row_size_ *= e;
+
+  // Reserve enough space in the header for the largest possible number of
+  // rows, so that it never needs to grow.
+  std::vector<size_t> max_shape{std::numeric_limits<size_t>::max()};
+  max_shape.insert(max_shape.end(), row_shape_.begin(), row_shape_.end());
+  header_length_ = make_npy_header(max_shape, dtype_, true).size();
+
+  file_.open(fname_, std::ios::binary);
+  if (!file_.is_open()) {
+    std::string mssg = "Could not open " + fname_ + " for writing.";
+    throw std::runtime_error(mssg);
+  }
+
+  write_header();
+}
+
+template <class T>
+NpyWriter<T>::~NpyWriter() {
+  // Exceptions can not be thrown from the destructor, so any error in
+  // writing the final header is lost. Call close() to be notified of errors.
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+template <class T>
+void NpyWriter<T>::append(const T* data, size_t n_rows) {
+  if (!file_.is_open()) {
+    std::string mssg = "Cannot append to closed NpyWriter for " + fname_ + ".";
+    throw std::runtime_error(mssg);
+  }
+
+  std::streamsize n_bytes =
+      static_cast<std::streamsize>(n_rows * row_size_ * sizeof(T));
+  file_.write(reinterpret_cast<const char*>(data), n_bytes);
+  if (!file_.good()) {
+    std::string mssg = "Could not write data to " + fname_ + ".";
+    throw std::runtime_error(mssg);
+  }
+
+  n_rows_ += n_rows;
+}
+
+template <class T>
+template <class A>
+void NpyWriter<T>::append(const NDArray<T, A>& array) {
+  const std::vector<size_t>& shape = array.shape();
+
+  // Array of a single row
+  if (shape == row_shape_) {
+    if (!array.c_continuous() && shape.size() > 1) {
+      std::string mssg = "Only c continuous arrays may be appended to .npy file.";
+      throw std::runtime_error(mssg);
+    }
+
+    append(array.data(), 1);
+    return;
+  }
+
+  // Array of many rows
+  if (shape.size() != row_shape_.size() + 1 ||
+      !std::equal(row_shape_.begin(), row_shape_.end(), shape.begin() + 1)) {
+    std::string mssg =
+        "Shape of NDArray is incompatible with rows of .npy file.";
+    throw std::runtime_error(mssg);
+  }
+
+  if (!array.c_continuous() && shape.size() > 1) {
+    std::string mssg = "Only c continuous arrays may be appended to .npy file.";
+    throw std::runtime_error(mssg);
+  }
+
+  append(array.data(), shape[0]);
+}
+
+template <class T>
+void NpyWriter<T>::flush() {
+  if (!file_.is_open()) return;
+
+  write_header();
+  file_.flush();
+}
+
+template <class T>
+void NpyWriter<T>::close() {
+  if (!file_.is_open()) return;
+
+  write_header();
+  file_.close();
+}
+
+template <class T>
+NDARRAY_INLINE size_t NpyWriter<T>::rows() const {
+  return n_rows_;
+}
+
+template <class T>
+NDARRAY_INLINE const std::vector<size_t>& NpyWriter<T>::row_shape() const {
+  return row_shape_;
+}
+
+template <class T>
+NDARRAY_INLINE bool NpyWriter<T>::is_open() const {
+  return file_.is_open();
+}
+
+template <class T>
+void NpyWriter<T>::write_header() {
+  std::vector<size_t> shape{n_rows_};
+  shape.insert(shape.end(), row_shape_.begin(), row_shape_.end());
+  std::string header = make_npy_header(shape, dtype_, true, header_length_);
+
+  // Write header at the beginning of the file, and return to the end
+  std::streampos end = file_.tellp();
+  file_.seekp(0);
+  file_.write(header.data(), static_cast<std::streamsize>(header.size()));
+  if (end > 0) file_.seekp(end);
+
+  if (!file_.good()) {
+    std::string mssg = "Could not write header to " + fname_ + ".";
+    throw std::runtime_error(mssg);
+  }
+}
+
+//==============================================================================
+// NPY Function Definitions
+inline void load_npy(const std::string& fname, char*& data_ptr,
+                     std::vector<size_t>& shape, DType& dtype,
+                     bool& c_contiguous) {
+  // Open file
+  std::ifstream file(fname, std::ios::binary);
+  if (!file.is_open()) {
+    std::string mssg = "Could not open " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+
+  bool data_is_little_endian = true;
+  read_npy_header(file, fname, shape, dtype, c_contiguous,
+                  data_is_little_endian);
+  uint64_t data_offset = static_cast<uint64_t>(file.tellg());
+
+  // Close file
+  file.close();
+
+  // Get number of elements to be read into system
+  size_t n_elements = shape[0];
+  for (size_t j = 1; j < shape.size(); j++) n_elements *= shape[j];
+  char* data = new char[n_elements * size_of_DType(dtype)];
+
+  try {
+    read_npy_data(fname, data_offset, data, n_elements, dtype,
+                  data_is_little_endian);
+  } catch (...) {
+    delete[] data;
+    throw;
+  }
+
+  // Set pointer reference
+  data_ptr = data;
+}
+
+inline void load_npy(std::istream& stream, char*& data_ptr,
+                     std::vector<size_t>& shape, DType& dtype,
+                     bool& c_contiguous) {
+  NpyInfo info = read_npy_info(stream, "stream");
+
+  // Get number of elements to be read into system
+  size_t n_elements = info.shape[0];
+  for (size_t j = 1; j < info.shape.size(); j++) n_elements *= info.shape[j];
+  char* data = new char[n_elements * size_of_DType(info.dtype)];
+
+  try {
+    read_npy_data(stream, "stream", data, n_elements, info.dtype,
+                  info.little_endian);
+  } catch (...) {
+    delete[] data;
+    throw;
+  }
+
+  // Set references
+  data_ptr = data;
+  shape = std::move(info.shape);
+  dtype = info.dtype;
+  c_contiguous = info.c_contiguous;
+}
+
+inline void read_npy_header(std::istream& file, const std::string& fname,
+                            std::vector<size_t>& shape, DType& dtype,
+                            bool& c_contiguous, bool& data_is_little_endian) {
+  NpyInfo info = read_npy_info(file, fname);
+  shape = std::move(info.shape);
+  dtype = info.dtype;
+  c_contiguous = info.c_contiguous;
+  data_is_little_endian = info.little_endian;
+}
+
+inline NpyInfo read_npy_info(std::istream& file, const std::string& fname) {
+  NpyInfo info;
+
+  // Read preamble. The magic string and version are followed by a header
+  // length of 2 bytes for version 1.0, and of 4 bytes for later versions.
+  // The stream is only read forwards, so that it may be a pipe.
+  char preamble[12];
+  file.read(preamble, 10);
+  size_t n_preamble = static_cast<size_t>(file.gcount());
+  if (n_preamble == 10 && preamble[6] >= 0x02) {
+    file.read(preamble + 10, 2);
+    n_preamble += static_cast<size_t>(file.gcount());
+  }
+  size_t header_offset =
+      read_npy_preamble(preamble, n_preamble, fname, info.header_length);
+
+  // Array for header, and read in
+  std::string header(info.header_length, '\0');
+  file.read(&header[0], info.header_length);
+  if (static_cast<size_t>(file.gcount()) != info.header_length) {
+    std::string mssg = fname + " is an invalid .npy file.";
+    throw std::runtime_error(mssg);
+  }
+
+  try {
+    parse_npy_header(header, info.shape, info.dtype, info.c_contiguous,
+                     info.little_endian);
+  } catch (const std::runtime_error& err) {
+    std::string mssg = fname + ": " + err.what();
+    throw std::runtime_error(mssg);
+  }
+
+  info.data_offset = header_offset + info.header_length;
+
+  return info;
+}
+
+inline NpyInfo read_npy_info(const char* bytes, size_t n_bytes,
+                             const std::string& name) {
+  NpyInfo info;
+
+  size_t header_offset =
+      read_npy_preamble(bytes, n_bytes, name, info.header_length);
+  if (header_offset + info.header_length > n_bytes) {
+    std::string mssg = name + " is an invalid .npy file.";
+    throw std::runtime_error(mssg);
+  }
+  std::string header(bytes + header_offset, info.header_length);
+
+  try {
+    parse_npy_header(header, info.shape, info.dtype, info.c_contiguous,
+                     info.little_endian);
+  } catch (const std::runtime_error& err) {
+    std::string mssg = name + ": " + err.what();
+    throw std::runtime_error(mssg);
+  }
+
+  info.data_offset = header_offset + info.header_length;
+
+  return info;
+}
+
+inline NpyInfo npy_info(const std::string& fname) {
+  std::ifstream file(fname, std::ios::binary);
+  if (!file.is_open()) {
+    std::string mssg = "Could not open " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+
+  return read_npy_info(file, fname);
+}
+
+inline std::vector<NpyInfo> npy_info(const std::vector<std::string>& fnames,
+                                     size_t n_threads) {
+  if (n_threads == 0) {
+    n_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  std::vector<NpyInfo> infos(fnames.size());
+  parallel_for(fnames.size(), n_threads,
+               [&](size_t i) { infos[i] = npy_info(fnames[i]); });
+
+  return infos;
+}
+
+inline void read_npy_data(std::istream& file, const std::string& fname,
+                          char* data_ptr, uint64_t n_elements, DType dtype,
+                          bool data_is_little_endian) {
+  size_t element_size = size_of_DType(dtype);
+  bool swap = system_is_little_endian() != data_is_little_endian;
+
+  // Data is read in chunks, so that it may be byte swapped while in cache
+  uint64_t chunk_elements =
+      std::max<uint64_t>(npy_io_settings().chunk_size / element_size, 1);
+  while (n_elements > 0) {
+    uint64_t n_chunk = std::min(chunk_elements, n_elements);
+    std::streamsize n_bytes_to_read =
+        static_cast<std::streamsize>(n_chunk * element_size);
+    file.read(data_ptr, n_bytes_to_read);
+    if (file.gcount() != n_bytes_to_read) {
+      std::string mssg = fname + " does not contain all of the array data.";
+      throw std::runtime_error(mssg);
+    }
+
+    // If byte order of data different from byte order of system, swap data
+    // bytes in place
+    if (swap) swap_bytes(data_ptr, n_chunk, dtype);
+
+    data_ptr += n_bytes_to_read;
+    n_elements -= n_chunk;
+  }
+}
+
+inline void read_npy_data(const std::string& fname, uint64_t data_offset,
+                          char* data_ptr, uint64_t n_elements, DType dtype,
+                          bool data_is_little_endian) {
+#if defined(NDARRAY_POSIX)
+  size_t element_size = size_of_DType(dtype);
+  uint64_t n_bytes = n_elements * element_size;
+
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::string mssg = "Could not open " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+
+  // If byte order of data different from byte order of system, swap data
+  // bytes in place. Chunks begin on multiples of the chunk size in the file,
+  // so each chunk may be swapped as soon as it is read, while it is still in
+  // cache, provided the data itself begins on an element boundary.
+  bool swap = system_is_little_endian() != data_is_little_endian;
+  bool swap_chunks = swap && data_offset % element_size == 0;
+
+  bool success = false;
+  try {
+    success = for_each_npy_chunk(
+        data_offset, data_offset + n_bytes,
+        [&](uint64_t offset, uint64_t chunk_bytes) {
+          char* dst = data_ptr + (offset - data_offset);
+          if (!pread_all(fd, dst, chunk_bytes, offset)) return false;
+          if (swap_chunks) swap_bytes(dst, chunk_bytes / element_size, dtype);
+          return true;
+        });
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+
+  if (!success) {
+    std::string mssg = fname + " does not contain all of the array data.";
+    throw std::runtime_error(mssg);
+  }
+
+  if (swap && !swap_chunks) {
+    swap_bytes(data_ptr, n_elements, dtype);
+  }
+#else
+  std::ifstream file(fname, std::ios::binary);
+  if (!file.is_open()) {
+    std::string mssg = "Could not open " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+  file.seekg(static_cast<std::streamoff>(data_offset));
+  read_npy_data(file, fname, data_ptr, n_elements, dtype,
+                data_is_little_endian);
+#endif
+}
+
+inline NpyIOSettings& npy_io_settings() {
+  static NpyIOSettings settings{1, 64 * 1024 * 1024};
+  return settings;
+}
+
+template <class F>
+bool for_each_npy_chunk(uint64_t begin, uint64_t end, F func) {
+  if (end <= begin) return true;
+
+  // Chunks are aligned to multiples of the chunk size (and of the page
+  // size) in the file.
+  const NpyIOSettings& settings = npy_io_settings();
+  uint64_t chunk_size = std::max<uint64_t>(settings.chunk_size, 4096);
+  chunk_size = ((chunk_size + 4095) / 4096) * 4096;
+  uint64_t first_chunk = begin / chunk_size;
+  uint64_t n_chunks = (end - 1) / chunk_size - first_chunk + 1;
+  size_t n_threads = static_cast<size_t>(
+      std::min<uint64_t>(std::max<size_t>(settings.n_threads, 1), n_chunks));
+
+  // Once any chunk fails, the remaining chunks are skipped
+  std::atomic<bool> success{true};
+  parallel_for(static_cast<size_t>(n_chunks), n_threads, [&](size_t c) {
+    if (!success) return;
+    uint64_t offset = std::max(begin, (first_chunk + c) * chunk_size);
+    uint64_t chunk_end = std::min(end, (first_chunk + c + 1) * chunk_size);
+    if (!func(offset, chunk_end - offset)) success = false;
+  });
+
+  return success;
+}
+
+#if defined(NDARRAY_POSIX)
+inline bool pread_all(int fd, char* data_ptr, uint64_t n_bytes,
+                      uint64_t offset) {
+  while (n_bytes > 0) {
+    ssize_t n_read = ::pread(fd, data_ptr, static_cast<size_t>(n_bytes),
+                             static_cast<off_t>(offset));
+    if (n_read < 0 && errno == EINTR) continue;
+    if (n_read <= 0) return false;
+
+    data_ptr += n_read;
+    offset += static_cast<uint64_t>(n_read);
+    n_bytes -= static_cast<uint64_t>(n_read);
+  }
+
+  return true;
+}
+
+inline bool pwrite_all(int fd, const char* data_ptr, uint64_t n_bytes,
+                       uint64_t offset) {
+  while (n_bytes > 0) {
+    ssize_t n_written = ::pwrite(fd, data_ptr, static_cast<size_t>(n_bytes),
+                                 static_cast<off_t>(offset));
+    if (n_written < 0 && errno == EINTR) continue;
+    if (n_written <= 0) return false;
+
+    data_ptr += n_written;
+    offset += static_cast<uint64_t>(n_written);
+    n_bytes -= static_cast<uint64_t>(n_written);
+  }
+
+  return true;
+}
+
+inline bool write_npy_contents(int fd, const std::string& header,
+                               const char* data_ptr, uint64_t n_bytes,
+                               bool direct) {
+  const uint64_t header_size = header.size();
+  const uint64_t total_size = header_size + n_bytes;
+
+  if (direct) {
+    // Direct I/O requires the buffer, offset, and length of every write to be
+    // aligned to the logical block size of the device. Each chunk is copied
+    // to an aligned buffer, with the end of the last chunk padded out, and
+    // the file is truncated to the correct size afterwards.
+    const uint64_t block = 4096;
+    bool success = for_each_npy_chunk(
+        0, total_size, [&](uint64_t offset, uint64_t chunk_bytes) {
+          uint64_t padded_bytes = ((chunk_bytes + block - 1) / block) * block;
+          void* buffer = nullptr;
+          if (::posix_memalign(&buffer, block, padded_bytes) != 0) {
+            return false;
+          }
+
+          char* dst = static_cast<char*>(buffer);
+          uint64_t pos = offset;
+          uint64_t end = offset + chunk_bytes;
+          if (pos < header_size) {
+            uint64_t n = std::min(end, header_size) - pos;
+            std::memcpy(dst, header.data() + pos, n);
+            dst += n;
+            pos += n;
+          }
+          if (pos < end) {
+            std::memcpy(dst, data_ptr + (pos - header_size), end - pos);
+          }
+          std::memset(static_cast<char*>(buffer) + chunk_bytes, 0,
+                      padded_bytes - chunk_bytes);
+
+          bool written = pwrite_all(fd, static_cast<const char*>(buffer),
+                                    padded_bytes, offset);
+          std::free(buffer);
+          return written;
+        });
+
+    return success && ::ftruncate(fd, static_cast<off_t>(total_size)) == 0;
+  }
+
+  if (npy_io_settings().n_threads > 1) {
+    // Header is written on its own, and the data is split into chunks which
+    // are written concurrently.
+    if (!pwrite_all(fd, header.data(), header_size, 0)) return false;
+
+    return for_each_npy_chunk(
+        header_size, total_size, [&](uint64_t offset, uint64_t chunk_bytes) {
+          return pwrite_all(fd, data_ptr + (offset - header_size),
+                            chunk_bytes, offset);
+        });
+  }
+
+  // Header and data are written together with a single gathering write,
+  // which is only repeated if the write is incomplete.
+  const char* parts[2] = {header.data(), data_ptr};
+  uint64_t remaining[2] = {header_size, n_bytes};
+  const uint64_t max_write = uint64_t(1) << 30;
+  while (remaining[0] + remaining[1] > 0) {
+    struct iovec iov[2];
+    int n_iov = 0;
+    for (int i = 0; i < 2; i++) {
+      if (remaining[i] == 0) continue;
+      iov[n_iov].iov_base = const_cast<char*>(parts[i]);
+      iov[n_iov].iov_len = static_cast<size_t>(std::min(remaining[i], max_write));
+      n_iov++;
+    }
+
+    ssize_t n_written = ::writev(fd, iov, n_iov);
+    if (n_written < 0 && errno == EINTR) continue;
+    if (n_written <= 0) return false;
+
+    uint64_t n = static_cast<uint64_t>(n_written);
+    for (int i = 0; i < 2; i++) {
+      uint64_t n_part = std::min(n, remaining[i]);
+      parts[i] += n_part;
+      remaining[i] -= n_part;
+      n -= n_part;
+    }
+  }
+
+  return true;
+}
+#endif
+
+inline void read_npy_slice(
+    const std::string& fname, uint64_t data_offset,
+    const std::vector<size_t>& shape, bool c_contiguous,
+    const std::vector<std::pair<size_t, size_t>>& ranges,
+    size_t element_size, char* data_ptr) {
+  size_t n_dims = shape.size();
+
+  // Put the axes in memory order, from slowest to fastest varying
+  std::vector<size_t> mem_shape(shape);
+  std::vector<std::pair<size_t, size_t>> mem_ranges(ranges);
+  if (!c_contiguous) {
+    std::reverse(mem_shape.begin(), mem_shape.end());
+    std::reverse(mem_ranges.begin(), mem_ranges.end());
+  }
+
+  // Number of elements in the block. Nothing to read for an empty block.
+  size_t n_elements = 1;
+  for (const auto& r : mem_ranges) n_elements *= r.second - r.first;
+  if (n_elements == 0) return;
+
+  // Strides of each axis in the file, in bytes
+  std::vector<uint64_t> strides(n_dims);
+  uint64_t coeff = element_size;
+  for (size_t i = n_dims; i > 0; i--) {
+    strides[i - 1] = coeff;
+    coeff *= mem_shape[i - 1];
+  }
+
+  // Trailing axes which are loaded in full are merged into a single
+  // contiguous run with the first axis (from the end) which is not.
+  size_t run_axis = n_dims - 1;
+  while (run_axis > 0 && mem_ranges[run_axis].first == 0 &&
+         mem_ranges[run_axis].second == mem_shape[run_axis]) {
+    run_axis--;
+  }
+  uint64_t run_bytes =
+      (mem_ranges[run_axis].second - mem_ranges[run_axis].first) *
+      strides[run_axis];
+
+#if defined(NDARRAY_POSIX)
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::string mssg = "Could not open " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+#else
+  std::ifstream file(fname, std::ios::binary);
+#endif
+
+  // Reads n_bytes at the offset in the file into dst
+  auto read_run = [&](uint64_t offset, uint64_t n_bytes, char* dst) {
+#if defined(NDARRAY_POSIX)
+    bool success = pread_all(fd, dst, n_bytes, offset);
+#else
+    bool success = true;
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(dst, static_cast<std::streamsize>(n_bytes));
+    success = file.gcount() == static_cast<std::streamsize>(n_bytes);
+#endif
+    if (!success) {
+#if defined(NDARRAY_POSIX)
+      ::close(fd);
+#endif
+      std::string mssg = fname + " does not contain all of the array data.";
+      throw std::runtime_error(mssg);
+    }
+  };
+
+  // Iterate over the indices of the axes before the run axis. Runs which
+  // directly follow one another in the file are read together.
+  std::vector<size_t> index(run_axis);
+  for (size_t i = 0; i < run_axis; i++) index[i] = mem_ranges[i].first;
+
+  uint64_t pending_offset = 0;
+  uint64_t pending_bytes = 0;
+  char* pending_dst = data_ptr;
+  char* dst = data_ptr;
+  while (true) {
+    uint64_t offset =
+        data_offset + mem_ranges[run_axis].first * strides[run_axis];
+    for (size_t i = 0; i < run_axis; i++) offset += index[i] * strides[i];
+
+    if (pending_bytes > 0 && pending_offset + pending_bytes == offset) {
+      pending_bytes += run_bytes;
+    } else {
+      if (pending_bytes > 0) {
+        read_run(pending_offset, pending_bytes, pending_dst);
+      }
+      pending_offset = offset;
+      pending_bytes = run_bytes;
+      pending_dst = dst;
+    }
+    dst += run_bytes;
+
+    // Increment index, with the last axis varying fastest
+    bool done = true;
+    for (size_t axis = run_axis; axis > 0; axis--) {
+      if (++index[axis - 1] < mem_ranges[axis - 1].second) {
+        done = false;
+        break;
+      }
+      index[axis - 1] = mem_ranges[axis - 1].first;
+    }
+    if (done) break;
+  }
+  read_run(pending_offset, pending_bytes, pending_dst);
+
+#if defined(NDARRAY_POSIX)
+  ::close(fd);
+#endif
+}
+
+inline size_t read_npy_preamble(const char* bytes, size_t n_bytes,
+                                const std::string& fname,
+                                uint32_t& length_of_header) {
+  // Ensure magic string has right value
+  if (n_bytes < 10 || bytes[0] != '\x93' || bytes[1] != 'N' ||
+      bytes[2] != 'U' || bytes[3] != 'M' || bytes[4] != 'P' ||
+      bytes[5] != 'Y') {
+    std::string mssg = fname + " is an invalid .npy file.";
+    throw std::runtime_error(mssg);
+  }
+
+  char major_verison = bytes[6];
+
+  // Do any version checks here if required
+  if (major_verison == 0x01) {
+    uint16_t length_temp = 0;
+    std::memcpy(&length_temp, bytes + 8, 2);
+
+    // Value is stored as little endian. If system is big-endian, swap bytes
+    if (!system_is_little_endian()) {
+      swap_bytes((char*)&length_temp, 1, 2);
+    }
+
+    // Cast to main variable
+    length_of_header = static_cast<uint32_t>(length_temp);
+    return 10;
+  } else if (major_verison >= 0x02 && n_bytes >= 12) {
+    uint32_t length_temp = 0;
+    std::memcpy(&length_temp, bytes + 8, 4);
+
+    // Value is stored as little endian. If system is big-endian, swap bytes
+    if (!system_is_little_endian()) {
+      swap_bytes((char*)&length_temp, 1, 4);
+    }
+
+    // Set to main variable
+    length_of_header = length_temp;
+    return 12;
+  }
+
+  std::string mssg = fname + " is an invalid .npy file.";
+  throw std::runtime_error(mssg);
+}
+
+inline void parse_npy_header(const std::string& header,
+                             std::vector<size_t>& shape, DType& dtype,
+                             bool& c_contiguous,
+                             bool& data_is_little_endian) {
+  NpyHeaderParser parser(header);
+  parser.parse(shape, dtype, c_contiguous, data_is_little_endian);
+}
+
+inline NpyHeaderParser::NpyHeaderParser(const std::string& header)
+    : header_{header}, pos_{0} {}
+
+inline void NpyHeaderParser::parse(std::vector<size_t>& shape, DType& dtype,
+                                   bool& c_contiguous,
+                                   bool& data_is_little_endian) {
+  bool found_descr = false;
+  bool found_fortran_order = false;
+  bool found_shape = false;
+
+  skip_whitespace();
+  expect('{');
+  while (true) {
+    skip_whitespace();
+    if (accept('}')) break;
+
+    std::string key = parse_string();
+    skip_whitespace();
+    expect(':');
+    skip_whitespace();
+
+    if (key == "descr") {
+      std::string descr = parse_string();
+
+      // Get byte order from the first character, if present
+      data_is_little_endian = system_is_little_endian();
+      if (!descr.empty() && (descr[0] == '<' || descr[0] == '>' ||
+                             descr[0] == '|' || descr[0] == '=')) {
+        if (descr[0] == '<')
+          data_is_little_endian = true;
+        else if (descr[0] == '>')
+          data_is_little_endian = false;
+        descr.erase(0, 1);
+      }
+
+      dtype = descr_to_DType(descr);
+      found_descr = true;
+    } else if (key == "fortran_order") {
+      c_contiguous = !parse_bool();
+      found_fortran_order = true;
+    } else if (key == "shape") {
+      shape = parse_shape();
+      found_shape = true;
+    } else {
+      error("unknown key '" + key + "'");
+    }
+
+    skip_whitespace();
+    if (accept(',')) continue;
+    expect('}');
+    break;
+  }
+
+  // Only padding may follow the dict
+  skip_whitespace();
+  if (pos_ != header_.size() && header_[pos_] != '\0') {
+    error("unexpected characters after dict");
+  }
+
+  if (!found_descr || !found_fortran_order || !found_shape) {
+    error("missing one of 'descr', 'fortran_order', or 'shape'");
+  }
+
+  // The number of bytes of the data must fit in a size_t, so that no reader
+  // of the header has to check for overflow.
+  size_t n_bytes = size_of_DType(dtype);
+  for (const auto& e : shape) {
+    if (!checked_multiply(n_bytes, e, n_bytes)) {
+      error("shape with too many elements");
+    }
+  }
+}
+
+inline void NpyHeaderParser::skip_whitespace() {
+  while (pos_ < header_.size() &&
+         (header_[pos_] == ' ' || header_[pos_] == '\t' ||
+          header_[pos_] == '\n' || header_[pos_] == '\r')) {
+    pos_++;
+  }
+}
+
+inline bool NpyHeaderParser::accept(char c) {
+  if (pos_ < header_.size() && header_[pos_] == c) {
+    pos_++;
+    return true;
+  }
+  return false;
+}
+
+inline void NpyHeaderParser::expect(char c) {
+  if (!accept(c)) error(std::string("expected '") + c + "'");
+}
+
+inline std::string NpyHeaderParser::parse_string() {
+  if (pos_ >= header_.size() ||
+      (header_[pos_] != '\'' && header_[pos_] != '"')) {
+    error("expected string");
+  }
+  char quote = header_[pos_++];
+
+  size_t end = header_.find(quote, pos_);
+  if (end == std::string::npos) error("unterminated string");
+
+  std::string str = header_.substr(pos_, end - pos_);
+  pos_ = end + 1;
+  return str;
+}
+
+inline bool NpyHeaderParser::parse_bool() {
+  if (header_.compare(pos_, 4, "True") == 0) {
+    pos_ += 4;
+    return true;
+  } else if (header_.compare(pos_, 5, "False") == 0) {
+    pos_ += 5;
+    return false;
+  }
+
+  error("expected True or False");
+  return false;
+}
+
+inline std::vector<size_t> NpyHeaderParser::parse_shape() {
+  std::vector<size_t> shape;
+
+  expect('(');
+  while (true) {
+    skip_whitespace();
+    if (accept(')')) break;
+
+    size_t begin = pos_;
+    size_t value = 0;
+    while (pos_ < header_.size() && header_[pos_] >= '0' &&
+           header_[pos_] <= '9') {
+      if (!checked_multiply(value, 10, value) ||
+          !checked_add(value, static_cast<size_t>(header_[pos_] - '0'),
+                       value)) {
+        error("integer in shape too large");
+      }
+      pos_++;
+    }
+    if (pos_ == begin) error("expected integer in shape");
+    shape.push_back(value);
+
+    // Python 2 may write long integers with a suffix
+    accept('L');
+
+    skip_whitespace();
+    if (accept(',')) continue;
+    expect(')');
+    break;
+  }
+
+  // Scalars are treated as arrays with a single element
+  if (shape.empty()) shape.push_back(1);
+
+  return shape;
+}
+
+inline void NpyHeaderParser::error(const std::string& what) const {
+  std::string mssg = "Invalid .npy header, " + what + " at position " +
+                     std::to_string(pos_) + ".";
+  throw std::runtime_error(mssg);
+}
+
+template <class T>
+DType type_to_DType() {
+  if (std::is_same<T, char>::value)
+    return DType::CHAR;
+  else if (std::is_same<T, unsigned char>::value)
+    return DType::UCHAR;
+  else if (std::is_same<T, uint16_t>::value)
+    return DType::UINT16;
+  else if (std::is_same<T, uint32_t>::value)
+    return DType::UINT32;
+  else if (std::is_same<T, uint64_t>::value)
+    return DType::UINT64;
+  else if (std::is_same<T, int16_t>::value)
+    return DType::INT16;
+  else if (std::is_same<T, int32_t>::value)
+    return DType::INT32;
+  else if (std::is_same<T, int64_t>::value)
+    return DType::INT64;
+  else if (std::is_same<T, float>::value)
+    return DType::FLOAT32;
+  else if (std::is_same<T, double>::value)
+    return DType::DOUBLE64;
+  else if (std::is_same<T, std::complex<float>>::value)
+    return DType::COMPLEX64;
+  else if (std::is_same<T, std::complex<double>>::value)
+    return DType::COMPLEX128;
+  else {
+    std::string mssg = "The datatype is not supported for NDArray.";
+    throw std::runtime_error(mssg);
+  }
+}
+
+inline void write_npy(const std::string& fname, const char* data_ptr,
+                      const std::vector<size_t>& shape, DType dtype,
+                      bool c_contiguous, const NpyWriteOptions& options) {
+  // Calculate number of elements from the shape
+  size_t n_elements = shape[0];
+  for (size_t j = 1; j < shape.size(); j++) {
+    n_elements *= shape[j];
+  }
+  uint64_t n_bytes = n_elements * size_of_DType(dtype);
+
+  // Make magic string and header
+  std::string header = make_npy_header(shape, dtype, c_contiguous);
+
+#if defined(NDARRAY_POSIX)
+  // For atomic writes, a new temporary file with a unique name is written
+  std::string write_fname = fname;
+  int open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+  if (options.atomic) {
+    static std::atomic<unsigned long> n_temp_files{0};
+    write_fname += ".tmp" + std::to_string(::getpid()) + "." +
+                   std::to_string(n_temp_files++);
+    open_flags = O_WRONLY | O_CREAT | O_EXCL;
+  }
+
+  // Open file. If direct I/O is not supported by the file system, the page
+  // cache is used after all.
+  int fd = -1;
+  bool direct = false;
+  if (options.direct) {
+#if defined(O_DIRECT)
+    fd = ::open(write_fname.c_str(), open_flags | O_DIRECT, 0644);
+    direct = fd >= 0;
+#elif defined(F_NOCACHE)
+    fd = ::open(write_fname.c_str(), open_flags, 0644);
+    if (fd >= 0) ::fcntl(fd, F_NOCACHE, 1);
+#endif
+  }
+  if (fd < 0) fd = ::open(write_fname.c_str(), open_flags, 0644);
+  if (fd < 0) {
+    std::string mssg = "Could not open " + write_fname + " for writing.";
+    throw std::runtime_error(mssg);
+  }
+
+  // Write header, and then all data to file
+  bool success = false;
+  try {
+    success = write_npy_contents(fd, header, data_ptr, n_bytes, direct);
+  } catch (...) {
+    ::close(fd);
+    if (options.atomic) ::unlink(write_fname.c_str());
+    throw;
+  }
+
+  if (success && options.sync) success = ::fsync(fd) == 0;
+
+  // Close file
+  if (::close(fd) != 0) success = false;
+
+  if (success && options.atomic) {
+    success = ::rename(write_fname.c_str(), fname.c_str()) == 0;
+
+    // The directory entry must also be flushed for the rename to be durable.
+    // Not all file systems support this, so errors are ignored.
+    if (success && options.sync) {
+      size_t loc = fname.find_last_of('/');
+      std::string dir = ".";
+      if (loc == 0)
+        dir = "/";
+      else if (loc != std::string::npos)
+        dir = fname.substr(0, loc);
+
+      int dir_fd = ::open(dir.c_str(), O_RDONLY);
+      if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+      }
+    }
+  }
+
+  if (!success) {
+    if (options.atomic) ::unlink(write_fname.c_str());
+    std::string mssg = "Could not write data to " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+#else
+  // Open file. For atomic writes, a temporary file is written first. There
+  // is no portable process id, so a random number keeps its name apart from
+  // those of other processes.
+  std::string write_fname = fname;
+  if (options.atomic) {
+    static std::atomic<unsigned long> n_temp_files{0};
+    write_fname += ".tmp" + std::to_string(std::random_device()()) + "." +
+                   std::to_string(n_temp_files++);
+  }
+  std::ofstream file(write_fname, std::ios::binary);
+
+  // Write header, and then all data to file
+  file.write(header.data(), static_cast<std::streamsize>(header.size()));
+  file.write(data_ptr, static_cast<std::streamsize>(n_bytes));
+
+  // Close file
+  file.close();
+  bool success = file.good();
+
+  // std::rename may not replace an existing file (as on Windows), so that
+  // file is removed first. Unlike on POSIX systems, the replacement is then
+  // not atomic, though the final file is still never torn.
+  if (success && options.atomic) {
+    std::remove(fname.c_str());
+    success = std::rename(write_fname.c_str(), fname.c_str()) == 0;
+  }
+
+  if (!success) {
+    if (options.atomic) std::remove(write_fname.c_str());
+    std::string mssg = "Could not write data to " + fname + ".";
+    throw std::runtime_error(mssg);
+  }
+#endif
+}
+
+inline void write_npy(std::ostream& stream, const char* data_ptr,
+                      const std::vector<size_t>& shape, DType dtype,
+                      bool c_contiguous) {
+  // Calculate number of elements from the shape
+  size_t n_elements = shape[0];
+  for (size_t j = 1; j < shape.size(); j++) {
+    n_elements *= shape[j];
+  }
+  uint64_t n_bytes = n_elements * size_of_DType(dtype);
+
+  // Write header, and then all data to stream
+  std::string header = make_npy_header(shape, dtype, c_contiguous);
+  stream.write(header.data(), static_cast<std::streamsize>(header.size()));
+  stream.write(data_ptr, static_cast<std::streamsize>(n_bytes));
+
+  if (!stream.good()) {
+    std::string mssg = "Could not write data to stream.";
+    throw std::runtime_error(mssg);
+  }
+}
+
+inline std::string make_npy_header(const std::vector<size_t>& shape,
+                                   DType dtype, bool c_contiguous,
+                                   size_t min_length) {
+  // First make the header dict. This is needed to know what version number
+  // to use
   std::string header = "{'descr': '";
   // Get system endianness
   if (system_is_little_endian())
     header += "<";
   else
-    header += ">";
-  header += DType_to_descr(dtype) + "', ";
+    header += ">";
+  header += DType_to_descr(dtype) + "', ";
+
+  // Fortran ordering
+  header += "'fortran_order': ";
+  if (c_contiguous)
+    header += "False, ";
+  else
+    header += "True, ";
+
+  // Shape
+  header += "'shape': (";
+  for (const auto& e : shape) {
+    header += std::to_string(e) + ",";
+  }
+  header += "), }";
+
+  // Based on header length, get version. The dict is terminated by a
+  // newline, and padded with spaces so that the data begins on a multiple of
+  // 64 bytes.
+  char major_version = 0x01;
+  size_t preamble_length = 6 + 2 + 2;
+  size_t total_length = 0;
+  while (true) {
+    total_length = std::max(preamble_length + header.size() + 1, min_length);
+    if (total_length % 64 != 0) total_length += 64 - (total_length % 64);
+
+    if (major_version == 0x01 && total_length - preamble_length > 65535) {
+      major_version = 0x02;
+      preamble_length += 2;
+    } else {
+      break;
+    }
+  }
+
+  // Add padding
+  header.append(total_length - preamble_length - header.size() - 1, '\x20');
+  header += '\n';
+
+  // Magic string and version
+  std::string preamble = "\x93NUMPY";
+  preamble += major_version;
+  preamble += '\x00';
+
+  // Info for len of header
+  if (major_version == 0x01) {
+    uint16_t len = static_cast<uint16_t>(header.size());
+    if (!system_is_little_endian()) {
+      swap_two_bytes((char*)&len);
+    }
+    preamble.append((char*)&len, 2);
+  } else {
+    uint32_t len = static_cast<uint32_t>(header.size());
+    if (!system_is_little_endian()) {
+      swap_four_bytes((char*)&len);
+    }
+    preamble.append((char*)&len, 4);
+  }
+
+  return preamble + header;
+}
+
+inline DType descr_to_DType(const std::string& dtype) {
+  if (dtype == "b1")
+    return DType::CHAR;
+  else if (dtype == "B1")
+    return DType::UCHAR;
+  else if (dtype == "i2")
+    return DType::INT16;
+  else if (dtype == "i4")
+    return DType::INT32;
+  else if (dtype == "i8")
+    return DType::INT64;
+  else if (dtype == "u2")
+    return DType::UINT16;
+  else if (dtype == "u4")
+    return DType::UINT32;
+  else if (dtype == "u8")
+    return DType::UINT64;
+  else if (dtype == "f4")
+    return DType::FLOAT32;
+  else if (dtype == "f8")
+    return DType::DOUBLE64;
+  else if (dtype == "c8")
+    return DType::COMPLEX64;
+  else if (dtype == "c16")
+    return DType::COMPLEX128;
+  else {
+    std::string mssg = "Data type " + dtype + " is unknown.";
+    throw std::runtime_error(mssg);
+  }
+}
+
+inline std::string DType_to_descr(DType dtype) {
+  switch (dtype) {
+    case DType::CHAR:
+      return "b1"; 
+      break;
+    case DType::UCHAR:
+      return "B1";
+      break;
+    case DType::INT16:
+      return "i2";
+      break;
+    case DType::INT32:
+      return "i4";
+      break;
+    case DType::INT64:
+      return "i8";
+      break;
+    case DType::UINT16:
+      return "u2";
+      break;
+    case DType::UINT32:
+      return "u4";
+      break;
+    case DType::UINT64:
+      return "u8";
+      break;
+    case DType::FLOAT32:
+      return "f4";
+      break;
+    case DType::DOUBLE64:
+      return "f8";
+      break;
+    case DType::COMPLEX64:
+      return "c8";
+      break;
+    case DType::COMPLEX128:
+      return "c16";
+      break;
+    default: {
+      std::string mssg = "Unknown DType identifier.";
+      throw std::runtime_error(mssg);        
+      break;
+    }
+  }
+}
+
+inline size_t size_of_DType(DType dtype) {
+  switch (dtype) {
+    case DType::CHAR:
+      return 1;
+      break;
+    case DType::UCHAR:
+      return 1;
+      break;
+    case DType::INT16:
+      return 2;
+      break;
+    case DType::INT32:
+      return 4;
+      break;
+    case DType::INT64:
+      return 8;
+      break;
+    case DType::UINT16:
+      return 2;
+      break;
+    case DType::UINT32:
+      return 4;
+      break;
+    case DType::UINT64:
+      return 8;
+      break;
+    case DType::FLOAT32:
+      return 4;
+      break;
+    case DType::DOUBLE64:
+      return 8;
+      break;
+    case DType::COMPLEX64:
+      return 8;
+      break;
+    case DType::COMPLEX128:
+      return 16;
+      break;
+    default: {
+      std::string mssg = "Unknown DType identifier.";
+      throw std::runtime_error(mssg);        
+      break;
+    }
+  }
+}
+
+inline bool system_is_little_endian() {
+  int x = 1;
+
+  if (((char*)&x)[0] == 0x01)
+    return true;
+  else
+    return false;
+}
+
+inline bool checked_multiply(size_t a, size_t b, size_t& result) {
+  if (a != 0 && b > std::numeric_limits<size_t>::max() / a) return false;
+  result = a * b;
+  return true;
+}
+
+inline bool checked_add(size_t a, size_t b, size_t& result) {
+  if (b > std::numeric_limits<size_t>::max() - a) return false;
+  result = a + b;
+  return true;
+}
+
+inline void swap_bytes(char* data, uint64_t n_elements, size_t element_size) {
+  // Select the kernel once, instead of for every element
+  switch (element_size) {
+    case 1:
+      // Nothing to do
+      break;
+    case 2:
+      swap_two_byte_elements(data, n_elements);
+      break;
+    case 4:
+      swap_four_byte_elements(data, n_elements);
+      break;
+    case 8:
+      swap_eight_byte_elements(data, n_elements);
+      break;
+    case 16:
+      for (uint64_t i = 0; i < n_elements; i++) {
+        swap_sixteen_bytes(data + 16 * i);
+      }
+      break;
+    default:
+      std::string mssg = "Cannot swap bytes for data types of size " +
+                         std::to_string(element_size);
+      throw std::runtime_error(mssg);
+      break;
+  }
+}
+
+inline void swap_bytes(char* data, uint64_t n_elements, DType dtype) {
+  switch (dtype) {
+    case DType::COMPLEX64:
+      swap_four_byte_elements(data, 2 * n_elements);
+      break;
+    case DType::COMPLEX128:
+      swap_eight_byte_elements(data, 2 * n_elements);
+      break;
+    default:
+      swap_bytes(data, n_elements, size_of_DType(dtype));
+      break;
+  }
+}
+
+#if defined(NDARRAY_X86_DISPATCH)
+// Returns true if the CPU supports SSSE3 instructions
+inline bool cpu_supports_ssse3() {
+  static const bool supported = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3") != 0;
+  }();
+  return supported;
+}
+
+// Returns true if the CPU supports AVX2 instructions
+inline bool cpu_supports_avx2() {
+  static const bool supported = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return supported;
+}
+
+// Reorders the bytes of every 16 byte block of data according to mask,
+// returning the number of bytes which were processed.
+NDARRAY_TARGET("ssse3")
+inline uint64_t shuffle_bytes_ssse3(char* data, uint64_t n_bytes,
+                                    const char* mask) {
+  __m128i m = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+  uint64_t i = 0;
+  for (; i + 16 <= n_bytes; i += 16) {
+    __m128i* p = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), m));
+  }
+  return i;
+}
+
+// Reorders the bytes of every 16 byte block of data according to mask,
+// returning the number of bytes which were processed.
+NDARRAY_TARGET("avx2")
+inline uint64_t shuffle_bytes_avx2(char* data, uint64_t n_bytes,
+                                   const char* mask) {
+  __m256i m = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask)));
+  uint64_t i = 0;
+  for (; i + 64 <= n_bytes; i += 64) {
+    __m256i* p0 = reinterpret_cast<__m256i*>(data + i);
+    __m256i* p1 = reinterpret_cast<__m256i*>(data + i + 32);
+    __m256i v0 = _mm256_loadu_si256(p0);
+    __m256i v1 = _mm256_loadu_si256(p1);
+    _mm256_storeu_si256(p0, _mm256_shuffle_epi8(v0, m));
+    _mm256_storeu_si256(p1, _mm256_shuffle_epi8(v1, m));
+  }
+  for (; i + 32 <= n_bytes; i += 32) {
+    __m256i* p = reinterpret_cast<__m256i*>(data + i);
+    _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), m));
+  }
+  return i;
+}
+
+// Reorders the bytes of as much of data as possible with the widest SIMD
+// shuffle available, returning the number of bytes which were processed.
+inline uint64_t shuffle_bytes_simd(char* data, uint64_t n_bytes,
+                                   const char* mask) {
+  if (cpu_supports_avx2()) return shuffle_bytes_avx2(data, n_bytes, mask);
+  if (cpu_supports_ssse3()) return shuffle_bytes_ssse3(data, n_bytes, mask);
+  return 0;
+}
+#endif
+
+// Returns the value with the order of its bytes reversed
+NDARRAY_INLINE uint16_t byteswap(uint16_t v) {
+  return static_cast<uint16_t>((v << 8) | (v >> 8));
+}
+
+NDARRAY_INLINE uint32_t byteswap(uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_bswap32(v);
+#else
+  return ((v & 0x000000FFu) << 24) | ((v & 0x0000FF00u) << 8) |
+         ((v & 0x00FF0000u) >> 8) | ((v & 0xFF000000u) >> 24);
+#endif
+}
+
+NDARRAY_INLINE uint64_t byteswap(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_bswap64(v);
+#else
+  return (static_cast<uint64_t>(byteswap(static_cast<uint32_t>(v))) << 32) |
+         byteswap(static_cast<uint32_t>(v >> 32));
+#endif
+}
+
+// Swaps the byte order of n_elements unsigned integers of type U in data,
+// which need not be aligned.
+template <class U>
+NDARRAY_INLINE void swap_elements_scalar(char* data, uint64_t n_elements) {
+  for (uint64_t i = 0; i < n_elements; i++) {
+    U v;
+    std::memcpy(&v, data + i * sizeof(U), sizeof(U));
+    v = byteswap(v);
+    std::memcpy(data + i * sizeof(U), &v, sizeof(U));
+  }
+}
+
+inline void swap_two_byte_elements(char* data, uint64_t n_elements) {
+  uint64_t n_done = 0;
+#if defined(NDARRAY_X86_DISPATCH)
+  static const char mask[16] = {1, 0, 3,  2,  5,  4,  7,  6,
+                                9, 8, 11, 10, 13, 12, 15, 14};
+  n_done = shuffle_bytes_simd(data, 2 * n_elements, mask) / 2;
+#endif
+  swap_elements_scalar<uint16_t>(data + 2 * n_done, n_elements - n_done);
+}
+
+inline void swap_four_byte_elements(char* data, uint64_t n_elements) {
+  uint64_t n_done = 0;
+#if defined(NDARRAY_X86_DISPATCH)
+  static const char mask[16] = {3,  2,  1,  0,  7,  6,  5,  4,
+                                11, 10, 9, 8, 15, 14, 13, 12};
+  n_done = shuffle_bytes_simd(data, 4 * n_elements, mask) / 4;
+#endif
+  swap_elements_scalar<uint32_t>(data + 4 * n_done, n_elements - n_done);
+}
+
+inline void swap_eight_byte_elements(char* data, uint64_t n_elements) {
+  uint64_t n_done = 0;
+#if defined(NDARRAY_X86_DISPATCH)
+  static const char mask[16] = {7,  6,  5,  4,  3,  2,  1, 0,
+                                15, 14, 13, 12, 11, 10, 9, 8};
+  n_done = shuffle_bytes_simd(data, 8 * n_elements, mask) / 8;
+#endif
+  swap_elements_scalar<uint64_t>(data + 8 * n_done, n_elements - n_done);
+}
+
+inline void swap_two_bytes(char* bytes) {
+  // Temporary array to store original bytes
+  char temp[2];
+
+  // Copyr original bytes into temp array
+  std::memcpy(&temp, bytes, 2);
+
+  // Set original bytes to new values
+  bytes[0] = temp[1];
+  bytes[1] = temp[0];
+}
+
+inline void swap_four_bytes(char* bytes) {
+  // Temporary array to store original bytes
+  char temp[4];
+
+  // Copyr original bytes into temp array
+  std::memcpy(&temp, bytes, 4);
+
+  // Set original bytes to new values
+  bytes[0] = temp[3];
+  bytes[1] = temp[2];
+  bytes[2] = temp[1];
+  bytes[3] = temp[0];
+}
+
+inline void swap_eight_bytes(char* bytes) {
+  // Temporary array to store original bytes
+  char temp[8];
+
+  // Copyr original bytes into temp array
+  std::memcpy(&temp, bytes, 8);
+
+  // Set original bytes to new values
+  bytes[0] = temp[7];
+  bytes[1] = temp[6];
+  bytes[2] = temp[5];
+  bytes[3] = temp[4];
+  bytes[4] = temp[3];
+  bytes[5] = temp[2];
+  bytes[6] = temp[1];
+  bytes[7] = temp[0];
+}
+
+inline void swap_sixteen_bytes(char* bytes) {
+  // Temporary array to store original bytes
+  char temp[16];
+
+  // Copyr original bytes into temp array
+  std::memcpy(&temp, bytes, 16);
+
+  // Set original bytes to new values
+  bytes[0] = temp[15];
+  bytes[1] = temp[14];
+  bytes[2] = temp[13];
+  bytes[3] = temp[12];
+  bytes[4] = temp[11];
+  bytes[5] = temp[10];
+  bytes[6] = temp[9];
+  bytes[7] = temp[8];
+  bytes[8] = temp[7];
+  bytes[9] = temp[6];
+  bytes[10] = temp[5];
+  bytes[11] = temp[4];
+  bytes[12] = temp[3];
+  bytes[13] = temp[2];
+  bytes[14] = temp[1];
+  bytes[15] = temp[0];
+}
+//==============================================================================
+// Thread Pool Implementation
+struct ThreadPool::Job {
+  Job(size_t n, const std::function<void(size_t)>& func)
+      : func{&func}, n{n}, next{0}, running{0}, failed{false}, error{} {}
+
+  // The function belongs to the thread which started the job. It is never
+  // called once every index has been taken, after which that thread may
+  // return, while stale copies of the job are still in the queue.
+  const std::function<void(size_t)>* func;
+  size_t n;
+  std::atomic<size_t> next;
+  std::atomic<size_t> running;
+  std::atomic<bool> failed;
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable finished;
+};
+
+inline ThreadPool::ThreadPool()
+    : threads_{}, queue_{}, mutex_{}, wake_{}, stop_{false} {}
+
+inline ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+inline ThreadPool& ThreadPool::instance() {
+  static ThreadPool pool;
+  return pool;
+}
+
+inline void ThreadPool::run(size_t n, size_t n_threads,
+                            const std::function<void(size_t)>& func) {
+  n_threads = std::min(std::max<size_t>(n_threads, 1), n);
+  if (n_threads <= 1) {
+    for (size_t i = 0; i < n; i++) func(i);
+    return;
+  }
+
+  // One copy of the job is queued for each helper. Workers are started if
+  // there are not enough, and if they can not be, the threads which exist
+  // (or the calling thread alone) do all of the work.
+  std::shared_ptr<Job> job = std::make_shared<Job>(n, func);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    try {
+      while (threads_.size() < n_threads - 1) {
+        threads_.emplace_back(&ThreadPool::work, this);
+      }
+    } catch (...) {
+    }
+
+    for (size_t t = 1; t < n_threads; t++) queue_.push_back(job);
+  }
+  wake_.notify_all();
+
+  execute(*job);
+
+  // Every index has been taken, so only the workers still running one of
+  // them need to be waited for.
+  {
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&job]() { return job->running == 0; });
+  }
+
+  if (job->error) std::rethrow_exception(job->error);
+}
+
+inline void ThreadPool::work() {
+  while (true) {
+    std::shared_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) return;
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    // running is raised before any index is taken, so the thread which
+    // started the job either waits for this worker, or has already taken
+    // every index, in which case execute returns immediately.
+    job->running++;
+    execute(*job);
+    {
+      std::lock_guard<std::mutex> lock(job->mutex);
+      job->running--;
+    }
+    job->finished.notify_all();
+  }
+}
+
+inline void ThreadPool::execute(Job& job) {
+  try {
+    size_t i = 0;
+    while (!job.failed && (i = job.next++) < job.n) (*job.func)(i);
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(job.mutex);
+    if (!job.error) job.error = std::current_exception();
+    job.failed = true;
+  }
+}
+
+//==============================================================================
+// AsyncWriter Implementation
+inline AsyncWriter::AsyncWriter()
+    : thread_{}, queue_{}, mutex_{}, wake_{}, stop_{false} {}
+
+inline AsyncWriter::~AsyncWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  if (thread_.joinable()) thread_.join();
+}
+
+inline AsyncWriter& AsyncWriter::instance() {
+  // The writes may use the ThreadPool, which must then be destroyed after
+  // the writer. Statics are destroyed in the reverse order of their
+  // construction, so the pool is constructed first.
+  ThreadPool::instance();
+  static AsyncWriter writer;
+  return writer;
+}
+
+inline std::future<void> AsyncWriter::submit(std::packaged_task<void()> task) {
+  std::future<void> future = task.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!thread_.joinable()) thread_ = std::thread(&AsyncWriter::work, this);
+    queue_.push_back(std::move(task));
+  }
+  wake_.notify_one();
+  return future;
+}
+
+inline void AsyncWriter::work() {
+  while (true) {
+    std::packaged_task<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) return;
+      task = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    // Any exception is stored in the future of the task
+    task();
+  }
+}
+
+template <class F>
+void parallel_for(size_t n, size_t n_threads, F func) {
+  ThreadPool::instance().run(n, n_threads, std::function<void(size_t)>(func));
+}
+
+inline ExecutionSettings& execution_settings() {
+  static ExecutionSettings settings{1, 64 * 1024};
+  return settings;
+}
+
+template <class F>
+void parallel_blocks(size_t n, size_t n_elements, F func) {
+  const ExecutionSettings& settings = execution_settings();
+  size_t n_threads = settings.n_threads;
+  if (n_threads == 0) {
+    n_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  n_elements = std::max<size_t>(n_elements, 1);
+  if (n_threads <= 1 || n < 2 ||
+      n < std::max<size_t>(settings.parallel_threshold, 1) / n_elements) {
+    func(size_t(0), n);
+    return;
+  }
+
+  // Blocks are made a multiple of 64 elements, so that no two threads write
+  // to the same cache line of an aligned array.
+  size_t grain = std::max<size_t>(64 / n_elements, 1);
+  size_t block = (n + n_threads - 1) / n_threads;
+  block = (block + grain - 1) / grain * grain;
+  size_t n_blocks = (n + block - 1) / block;
+
+  parallel_for(n_blocks, n_threads, [&](size_t b) {
+    size_t begin = b * block;
+    func(begin, std::min(n, begin + block));
+  });
+}
+
+template <class T, class Alloc>
+void zero_new_elements(std::vector<T, Alloc>& data, size_t begin) {
+  if (!is_uninitialized_allocator<Alloc>::value || begin >= data.size()) {
+    return;
+  }
+
+  T* new_data = data.data() + begin;
+  parallel_blocks(data.size() - begin, 1,
+                  [new_data](size_t first, size_t last) {
+                    std::fill(new_data + first, new_data + last, T());
+                  });
+}
+
+//==============================================================================
+// Aligned Allocator Implementation
+template <class T, size_t Alignment>
+T* AlignedAllocator<T, Alignment>::allocate(size_t n) {
+  if (n == 0) return nullptr;
+  if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+    throw std::bad_alloc();
+  }
+
+  void* p = nullptr;
+  size_t align = Alignment < sizeof(void*) ? sizeof(void*) : Alignment;
+#if defined(NDARRAY_POSIX)
+  if (posix_memalign(&p, align, n * sizeof(T)) != 0) p = nullptr;
+#else
+  // Over allocate, and keep the original pointer just before the block
+  void* raw = std::malloc(n * sizeof(T) + align + sizeof(void*));
+  if (raw) {
+    std::uintptr_t start =
+        reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + align - 1;
+    p = reinterpret_cast<void*>(start - start % align);
+    reinterpret_cast<void**>(p)[-1] = raw;
+  }
+#endif
+  if (!p) throw std::bad_alloc();
+
+  return static_cast<T*>(p);
+}
+
+template <class T, size_t Alignment>
+void AlignedAllocator<T, Alignment>::deallocate(T* p, size_t) noexcept {
+  if (!p) return;
+#if defined(NDARRAY_POSIX)
+  std::free(p);
+#else
+  std::free(reinterpret_cast<void**>(p)[-1]);
+#endif
+}
+
+//==============================================================================
+// Pool Allocator Implementation
+// Thread-local cache of freed blocks, with one free list per size class
+struct PoolCache {
+  static const size_t min_class = 6;   // 64 bytes
+  static const size_t max_class = 24;  // 16 MiB
+  static const size_t max_blocks = 8;  // Cached blocks per class
+
+  PoolCache() : lists{} {}
+  ~PoolCache();
+
+  static PoolCache* get();
+
+  std::vector<void*> lists[max_class - min_class + 1];
+};
+
+// Set once the cache of the thread has been destroyed, so that arrays which
+// outlive it (e.g. static arrays) free their memory directly. This must be
+// trivially destructible, so that it stays valid during thread exit.
+inline bool& pool_cache_destroyed() {
+  static thread_local bool destroyed = false;
+  return destroyed;
+}
+
+inline PoolCache::~PoolCache() {
+  AlignedAllocator<char> alloc;
+  for (auto& list : lists) {
+    for (void* block : list) alloc.deallocate(static_cast<char*>(block), 0);
+  }
+  pool_cache_destroyed() = true;
+}
+
+inline PoolCache* PoolCache::get() {
+  if (pool_cache_destroyed()) return nullptr;
+  static thread_local PoolCache cache;
+  return &cache;
+}
+
+// Returns the size class of a block of n_bytes, or 0 if it is too large
+inline size_t pool_size_class(size_t n_bytes) {
+  size_t c = PoolCache::min_class;
+  while ((size_t(1) << c) < n_bytes) {
+    if (++c > PoolCache::max_class) return 0;
+  }
+  return c;
+}
 
-  // Fortran ordering
-  header += "'fortran_order': ";
-  if (c_contiguous)
-    header += "False, ";
-  else
-    header += "True, ";
+template <class T>
+T* PoolAllocator<T>::allocate(size_t n) {
+  if (n == 0) return nullptr;
+  if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+    throw std::bad_alloc();
+  }
 
-  // Shape
-  header += "'shape': (";
-  for (const auto& e : shape) {
-    header += std::to_string(e) + ",";
+  AlignedAllocator<char> alloc;
+  size_t c = pool_size_class(n * sizeof(T));
+  if (c == 0) return reinterpret_cast<T*>(alloc.allocate(n * sizeof(T)));
+
+  PoolCache* cache = PoolCache::get();
+  if (cache) {
+    std::vector<void*>& list = cache->lists[c - PoolCache::min_class];
+    if (!list.empty()) {
+      void* block = list.back();
+      list.pop_back();
+      return static_cast<T*>(block);
+    }
+  }
+
+  return reinterpret_cast<T*>(alloc.allocate(size_t(1) << c));
+}
+
+template <class T>
+void PoolAllocator<T>::deallocate(T* p, size_t n) noexcept {
+  if (!p) return;
+
+  size_t c = pool_size_class(n * sizeof(T));
+  PoolCache* cache = c == 0 ? nullptr : PoolCache::get();
+  if (cache) {
+    std::vector<void*>& list = cache->lists[c - PoolCache::min_class];
+    if (list.size() < PoolCache::max_blocks) {
+      try {
+        list.push_back(p);
+        return;
+      } catch (...) {
+      }
+    }
+  }
+
+  AlignedAllocator<char>().deallocate(reinterpret_cast<char*>(p), 0);
+}
+
+//==============================================================================
+// Monotonic Allocator Implementation
+inline MonotonicArena::MonotonicArena(size_t block_size)
+    : block_size_(block_size), blocks_(), ptr_(nullptr), end_(nullptr) {}
+
+inline MonotonicArena::~MonotonicArena() {
+  AlignedAllocator<char> alloc;
+  for (auto& block : blocks_) alloc.deallocate(block.first, block.second);
+}
+
+inline void* MonotonicArena::allocate(size_t n_bytes) {
+  const size_t align = 64;
+  if (n_bytes > std::numeric_limits<size_t>::max() - align) {
+    throw std::bad_alloc();
+  }
+  n_bytes = (n_bytes + align - 1) / align * align;
+
+  if (static_cast<size_t>(end_ - ptr_) < n_bytes) {
+    // Blocks are allocated with an alignment of 64, and every allocation is
+    // a multiple of 64 bytes, so ptr_ always remains aligned. Each block is
+    // at least twice as large as the previous one, so that after a reset the
+    // arena quickly settles on a single block large enough for everything.
+    size_t block_bytes = std::max(n_bytes, block_size_);
+    if (!blocks_.empty()) {
+      block_bytes = std::max(block_bytes, 2 * blocks_.back().second);
+    }
+    char* block = AlignedAllocator<char>().allocate(block_bytes);
+    blocks_.push_back({block, block_bytes});
+    ptr_ = block;
+    end_ = block + block_bytes;
+  }
+
+  void* p = ptr_;
+  ptr_ += n_bytes;
+  return p;
+}
+
+inline void MonotonicArena::reset() {
+  if (blocks_.empty()) return;
+
+  // The last block is the largest one, so it is the one which is kept
+  AlignedAllocator<char> alloc;
+  for (size_t i = 0; i + 1 < blocks_.size(); i++) {
+    alloc.deallocate(blocks_[i].first, blocks_[i].second);
+  }
+  blocks_.erase(blocks_.begin(), blocks_.end() - 1);
+  ptr_ = blocks_[0].first;
+  end_ = ptr_ + blocks_[0].second;
+}
+
+inline size_t MonotonicArena::capacity() const {
+  size_t n_bytes = 0;
+  for (const auto& block : blocks_) n_bytes += block.second;
+  return n_bytes;
+}
+
+inline MonotonicArena& MonotonicArena::thread_default() {
+  static thread_local MonotonicArena arena;
+  return arena;
+}
+
+template <class T>
+MonotonicAllocator<T>::MonotonicAllocator() noexcept
+    : arena_(&MonotonicArena::thread_default()) {}
+
+template <class T>
+MonotonicAllocator<T>::MonotonicAllocator(MonotonicArena& arena) noexcept
+    : arena_(&arena) {}
+
+template <class T>
+template <class U>
+MonotonicAllocator<T>::MonotonicAllocator(
+    const MonotonicAllocator<U>& other) noexcept
+    : arena_(other.arena()) {}
+
+template <class T>
+T* MonotonicAllocator<T>::allocate(size_t n) {
+  if (n == 0) return nullptr;
+  if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+    throw std::bad_alloc();
+  }
+  return static_cast<T*>(arena_->allocate(n * sizeof(T)));
+}
+
+template <class T>
+NDARRAY_INLINE MonotonicArena* MonotonicAllocator<T>::arena() const noexcept {
+  return arena_;
+}
+
+//==============================================================================
+// Uninitialized Allocator Implementation
+template <class T, class Base>
+UninitializedAllocator<T, Base>::UninitializedAllocator(
+    const Base& base) noexcept
+    : Base(base) {}
+
+template <class T, class Base>
+template <class U, class B>
+UninitializedAllocator<T, Base>::UninitializedAllocator(
+    const UninitializedAllocator<U, B>& other) noexcept
+    : Base(static_cast<const B&>(other)) {}
+
+template <class T, class Base>
+template <class U>
+void UninitializedAllocator<T, Base>::construct(U* p) {
+  ::new (static_cast<void*>(p)) U;
+}
+
+template <class T, class Base>
+template <class U, class... Args>
+void UninitializedAllocator<T, Base>::construct(U* p, Args&&... args) {
+  std::allocator_traits<Base>::construct(*this, p,
+                                         std::forward<Args>(args)...);
+}
+
+//==============================================================================
+// Page Allocator Implementation
+template <class T>
+PageAllocator<T>::PageAllocator(const PageOptions& options) noexcept
+    : options_(options) {}
+
+template <class T>
+template <class U>
+PageAllocator<T>::PageAllocator(const PageAllocator<U>& other) noexcept
+    : options_(other.options()) {}
+
+template <class T>
+T* PageAllocator<T>::allocate(size_t n) {
+  if (n == 0) return nullptr;
+  if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+    throw std::bad_alloc();
+  }
+
+  void* p = map_pages(n * sizeof(T), options_);
+  if (!p) throw std::bad_alloc();
+
+  return static_cast<T*>(p);
+}
+
+template <class T>
+void PageAllocator<T>::deallocate(T* p, size_t n) noexcept {
+  if (p) unmap_pages(p, n * sizeof(T));
+}
+
+template <class T>
+const PageOptions& PageAllocator<T>::options() const noexcept {
+  return options_;
+}
+
+inline size_t huge_page_size() {
+  static const size_t size = []() {
+    size_t kb = 2048;
+    std::ifstream meminfo("/proc/meminfo");
+    std::string line;
+    while (std::getline(meminfo, line)) {
+      if (line.compare(0, 13, "Hugepagesize:") == 0) {
+        size_t value = std::strtoul(line.c_str() + 13, nullptr, 10);
+        if (value > 0) kb = value;
+        break;
+      }
+    }
+    return kb * 1024;
+  }();
+  return size;
+}
+
+inline uint64_t numa_node_mask() {
+  // The online nodes are listed as ranges, such as 0-3,6
+  static const uint64_t mask = []() {
+    uint64_t nodes = 0;
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string range;
+    while (std::getline(online, range, ',')) {
+      char* end = nullptr;
+      unsigned long first = std::strtoul(range.c_str(), &end, 10);
+      unsigned long last = first;
+      if (*end == '-') last = std::strtoul(end + 1, nullptr, 10);
+      for (unsigned long n = first; n <= last && n < 64; n++) {
+        nodes |= uint64_t(1) << n;
+      }
+    }
+    return nodes != 0 ? nodes : uint64_t(1);
+  }();
+  return mask;
+}
+
+inline void* map_pages(size_t n_bytes, const PageOptions& options) {
+  const size_t huge = huge_page_size();
+  if (n_bytes > std::numeric_limits<size_t>::max() - 2 * huge) return nullptr;
+  size_t length = (n_bytes + huge - 1) / huge * huge;
+
+#if defined(NDARRAY_POSIX)
+  const int prot = PROT_READ | PROT_WRITE;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  void* p = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+  if (options.hugetlb) {
+    p = mmap(nullptr, length, prot, flags | MAP_HUGETLB, -1, 0);
+  }
+#endif
+
+  if (p == MAP_FAILED) {
+    // An extra huge page is mapped, and the unaligned ends are released, so
+    // that the memory may be backed by transparent huge pages throughout.
+    char* raw = static_cast<char*>(
+        mmap(nullptr, length + huge, prot, flags, -1, 0));
+    if (raw == MAP_FAILED) return nullptr;
+    std::uintptr_t start = reinterpret_cast<std::uintptr_t>(raw);
+    size_t head = (huge - start % huge) % huge;
+    if (head > 0) munmap(raw, head);
+    munmap(raw + head + length, huge - head);
+    p = raw + head;
+
+#if defined(MADV_HUGEPAGE)
+    if (options.huge_pages) madvise(p, length, MADV_HUGEPAGE);
+#endif
+  }
+
+#if defined(__linux__) && defined(SYS_mbind)
+  // The policy must be set before any page is touched. The values of the
+  // modes are those of MPOL_BIND and MPOL_INTERLEAVE in linux/mempolicy.h.
+  if (options.numa != NumaPolicy::DEFAULT) {
+    const int mode = options.numa == NumaPolicy::BIND ? 2 : 3;
+    unsigned long nodes = static_cast<unsigned long>(
+        options.node_mask != 0 ? options.node_mask : numa_node_mask());
+    syscall(SYS_mbind, p, length, mode, &nodes, sizeof(nodes) * 8 + 1, 0);
+  }
+#endif
+
+  return p;
+#else
+  (void)options;
+  return AlignedAllocator<char, 4096>().allocate(length);
+#endif
+}
+
+inline void unmap_pages(void* p, size_t n_bytes) {
+#if defined(NDARRAY_POSIX)
+  const size_t huge = huge_page_size();
+  munmap(p, (n_bytes + huge - 1) / huge * huge);
+#else
+  AlignedAllocator<char, 4096>().deallocate(static_cast<char*>(p), n_bytes);
+#endif
+}
+
+//==============================================================================
+// SIMD Arithmetic Kernels
+#if defined(NDARRAY_X86_DISPATCH)
+// Returns true if the CPU supports SSE2 instructions
+inline bool cpu_supports_sse2() {
+  static const bool supported = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") != 0;
+  }();
+  return supported;
+}
+
+// Returns true if the CPU supports fused multiply-add instructions
+inline bool cpu_supports_fma() {
+  static const bool supported = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("fma") != 0;
+  }();
+  return supported;
+}
+
+// Returns true if the CPU supports AVX-512 Foundation instructions
+inline bool cpu_supports_avx512f() {
+  static const bool supported = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") != 0;
+  }();
+  return supported;
+}
+
+// Type in which a op b is computed for the elements of arrays of T and C
+template <class T, class C>
+using simd_type = decltype(std::declval<T>() + std::declval<C>());
+
+template <class T>
+struct is_simd_element
+    : std::integral_constant<bool, std::is_same<T, float>::value ||
+                                       std::is_same<T, double>::value ||
+                                       std::is_same<T, int32_t>::value> {};
+
+template <class Op>
+struct is_simd_op
+    : std::integral_constant<bool, std::is_same<Op, ExprAdd>::value ||
+                                       std::is_same<Op, ExprSubtract>::value ||
+                                       std::is_same<Op, ExprMultiply>::value ||
+                                       std::is_same<Op, ExprDivide>::value> {};
+
+// Trait which is true if there is a SIMD kernel for a op= b, for elements of
+// T and C, which is computed in lanes of float or double.
+template <class Op, class T, class C, class = void>
+struct has_simd_kernel : std::false_type {};
+
+template <class Op, class T, class C>
+struct has_simd_kernel<
+    Op, T, C,
+    typename std::enable_if<is_simd_op<Op>::value &&
+                            is_simd_element<T>::value &&
+                            is_simd_element<C>::value>::type>
+    : std::integral_constant<
+          bool, std::is_same<simd_type<T, C>, float>::value ||
+                    std::is_same<simd_type<T, C>, double>::value> {};
+
+template <class Op, class R>
+struct has_simd_kernel<Op, std::complex<R>, std::complex<R>,
+                       typename std::enable_if<is_simd_op<Op>::value>::type>
+    : std::integral_constant<bool, std::is_same<R, float>::value ||
+                                       std::is_same<R, double>::value> {};
+
+// Trait which is true if there is a SIMD kernel for a = b, for elements of T
+// and C which are not complex.
+template <class T, class C>
+struct has_simd_convert
+    : std::integral_constant<bool, has_simd_kernel<ExprAdd, T, C>::value &&
+                                       is_simd_element<T>::value> {};
+
+// Wrappers for the instructions of each instruction set, for registers of
+// float or double lanes. Elements of other types are converted to the type
+// of the lanes as they are loaded, and back as they are stored.
+template <class W>
+struct SimdSSE2;
+
+template <>
+struct SimdSSE2<float> {
+  using reg = __m128;
+  static constexpr size_t width = 4;
+
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg load(const float* p) { return _mm_loadu_ps(p); }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg load(const int32_t* p) {
+    return _mm_cvtepi32_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg set1(float c) { return _mm_set1_ps(c); }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE void store(float* p, reg v) { _mm_storeu_ps(p, v); }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE void store(int32_t* p, reg v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_cvttps_epi32(v));
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg op(ExprAdd, reg a, reg b) {
+    return _mm_add_ps(a, b);
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg op(ExprSubtract, reg a, reg b) {
+    return _mm_sub_ps(a, b);
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg op(ExprMultiply, reg a, reg b) {
+    return _mm_mul_ps(a, b);
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg op(ExprDivide, reg a, reg b) {
+    return _mm_div_ps(a, b);
+  }
+};
+
+template <>
+struct SimdSSE2<double> {
+  using reg = __m128d;
+  static constexpr size_t width = 2;
+
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg load(const double* p) { return _mm_loadu_pd(p); }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg load(const float* p) {
+    return _mm_cvtps_pd(_mm_castsi128_ps(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))));
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg load(const int32_t* p) {
+    return _mm_cvtepi32_pd(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg set1(double c) { return _mm_set1_pd(c); }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE void store(double* p, reg v) { _mm_storeu_pd(p, v); }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE void store(float* p, reg v) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p),
+                     _mm_castps_si128(_mm_cvtpd_ps(v)));
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE void store(int32_t* p, reg v) {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_cvttpd_epi32(v));
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg op(ExprAdd, reg a, reg b) {
+    return _mm_add_pd(a, b);
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg op(ExprSubtract, reg a, reg b) {
+    return _mm_sub_pd(a, b);
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg op(ExprMultiply, reg a, reg b) {
+    return _mm_mul_pd(a, b);
+  }
+  NDARRAY_TARGET("sse2")
+  static NDARRAY_INLINE reg op(ExprDivide, reg a, reg b) {
+    return _mm_div_pd(a, b);
+  }
+};
+
+template <class W>
+struct SimdAVX2;
+
+template <>
+struct SimdAVX2<double> {
+  using reg = __m256d;
+  static constexpr size_t width = 4;
+
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg load(const double* p) { return _mm256_loadu_pd(p); }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg load(const float* p) {
+    return _mm256_cvtps_pd(_mm_loadu_ps(p));
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg load(const int32_t* p) {
+    return _mm256_cvtepi32_pd(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg set1(double c) { return _mm256_set1_pd(c); }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE void store(double* p, reg v) { _mm256_storeu_pd(p, v); }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE void store(float* p, reg v) {
+    _mm_storeu_ps(p, _mm256_cvtpd_ps(v));
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE void store(int32_t* p, reg v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvttpd_epi32(v));
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg op(ExprAdd, reg a, reg b) {
+    return _mm256_add_pd(a, b);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg op(ExprSubtract, reg a, reg b) {
+    return _mm256_sub_pd(a, b);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg op(ExprMultiply, reg a, reg b) {
+    return _mm256_mul_pd(a, b);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg op(ExprDivide, reg a, reg b) {
+    return _mm256_div_pd(a, b);
+  }
+
+  // Returns a * b + c, rounded once
+  NDARRAY_TARGET("avx2,fma")
+  static NDARRAY_INLINE reg fmadd(reg a, reg b, reg c) {
+    return _mm256_fmadd_pd(a, b, c);
+  }
+
+  // Operations on complex numbers, with interleaved real and imaginary parts
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg complex_op(ExprAdd, reg x, reg y) {
+    return _mm256_add_pd(x, y);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg complex_op(ExprSubtract, reg x, reg y) {
+    return _mm256_sub_pd(x, y);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg complex_op(ExprMultiply, reg x, reg y) {
+    reg yr = _mm256_movedup_pd(y);
+    reg yi = _mm256_permute_pd(y, 0xF);
+    reg xs = _mm256_permute_pd(x, 0x5);
+    return _mm256_addsub_pd(_mm256_mul_pd(x, yr), _mm256_mul_pd(xs, yi));
+  }
+  // The divisor is scaled by the larger magnitude of its parts, so that its
+  // squared magnitude does not overflow or underflow.
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg complex_op(ExprDivide, reg x, reg y) {
+    reg ay = _mm256_andnot_pd(_mm256_set1_pd(-0.0), y);
+    reg s = _mm256_max_pd(_mm256_movedup_pd(ay), _mm256_permute_pd(ay, 0xF));
+    y = _mm256_div_pd(y, s);
+    reg yr = _mm256_movedup_pd(y);
+    reg yi = _mm256_permute_pd(y, 0xF);
+    reg xs = _mm256_permute_pd(x, 0x5);
+    reg a = _mm256_mul_pd(x, yr);
+    reg b = _mm256_mul_pd(xs, yi);
+    // x * conj(y) = (xr yr + xi yi, xi yr - xr yi)
+    reg num = _mm256_blend_pd(_mm256_add_pd(a, b), _mm256_sub_pd(a, b), 0xA);
+    reg den = _mm256_mul_pd(
+        _mm256_add_pd(_mm256_mul_pd(yr, yr), _mm256_mul_pd(yi, yi)), s);
+    return _mm256_div_pd(num, den);
+  }
+};
+
+template <>
+struct SimdAVX2<float> {
+  using reg = __m256;
+  static constexpr size_t width = 8;
+
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg load(const float* p) { return _mm256_loadu_ps(p); }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg load(const int32_t* p) {
+    return _mm256_cvtepi32_ps(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg set1(float c) { return _mm256_set1_ps(c); }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE void store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE void store(int32_t* p, reg v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_cvttps_epi32(v));
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg op(ExprAdd, reg a, reg b) {
+    return _mm256_add_ps(a, b);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg op(ExprSubtract, reg a, reg b) {
+    return _mm256_sub_ps(a, b);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg op(ExprMultiply, reg a, reg b) {
+    return _mm256_mul_ps(a, b);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg op(ExprDivide, reg a, reg b) {
+    return _mm256_div_ps(a, b);
+  }
+
+  // Returns a * b + c, rounded once
+  NDARRAY_TARGET("avx2,fma")
+  static NDARRAY_INLINE reg fmadd(reg a, reg b, reg c) {
+    return _mm256_fmadd_ps(a, b, c);
+  }
+
+  // Operations on complex numbers, with interleaved real and imaginary parts
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg complex_op(ExprAdd, reg x, reg y) {
+    return _mm256_add_ps(x, y);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg complex_op(ExprSubtract, reg x, reg y) {
+    return _mm256_sub_ps(x, y);
+  }
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg complex_op(ExprMultiply, reg x, reg y) {
+    reg yr = _mm256_moveldup_ps(y);
+    reg yi = _mm256_movehdup_ps(y);
+    reg xs = _mm256_permute_ps(x, 0xB1);
+    return _mm256_addsub_ps(_mm256_mul_ps(x, yr), _mm256_mul_ps(xs, yi));
+  }
+  // Division is done in double precision
+  NDARRAY_TARGET("avx2")
+  static NDARRAY_INLINE reg complex_op(ExprDivide, reg x, reg y) {
+    using D = SimdAVX2<double>;
+    D::reg lo = D::complex_op(ExprDivide(),
+                              _mm256_cvtps_pd(_mm256_castps256_ps128(x)),
+                              _mm256_cvtps_pd(_mm256_castps256_ps128(y)));
+    D::reg hi = D::complex_op(ExprDivide(),
+                              _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)),
+                              _mm256_cvtps_pd(_mm256_extractf128_ps(y, 1)));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)),
+                                _mm256_cvtpd_ps(hi), 1);
+  }
+};
+
+// The AVX-512 intrinsics of some versions of GCC initialize undefined
+// registers from themselves, which triggers false warnings once inlined.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+
+template <class W>
+struct SimdAVX512;
+
+template <>
+struct SimdAVX512<double> {
+  using reg = __m512d;
+  static constexpr size_t width = 8;
+
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg load(const double* p) { return _mm512_loadu_pd(p); }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg load(const float* p) {
+    return _mm512_cvtps_pd(_mm256_loadu_ps(p));
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg load(const int32_t* p) {
+    return _mm512_cvtepi32_pd(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg set1(double c) { return _mm512_set1_pd(c); }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE void store(double* p, reg v) { _mm512_storeu_pd(p, v); }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE void store(float* p, reg v) {
+    _mm256_storeu_ps(p, _mm512_cvtpd_ps(v));
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE void store(int32_t* p, reg v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvttpd_epi32(v));
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg op(ExprAdd, reg a, reg b) {
+    return _mm512_add_pd(a, b);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg op(ExprSubtract, reg a, reg b) {
+    return _mm512_sub_pd(a, b);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg op(ExprMultiply, reg a, reg b) {
+    return _mm512_mul_pd(a, b);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg op(ExprDivide, reg a, reg b) {
+    return _mm512_div_pd(a, b);
+  }
+
+  // Returns a * b + c, rounded once
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg fmadd(reg a, reg b, reg c) {
+    return _mm512_fmadd_pd(a, b, c);
+  }
+
+  // Operations on complex numbers, with interleaved real and imaginary parts
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg complex_op(ExprAdd, reg x, reg y) {
+    return _mm512_add_pd(x, y);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg complex_op(ExprSubtract, reg x, reg y) {
+    return _mm512_sub_pd(x, y);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg complex_op(ExprMultiply, reg x, reg y) {
+    reg a = _mm512_mul_pd(x, _mm512_movedup_pd(y));
+    reg b = _mm512_mul_pd(_mm512_permute_pd(x, 0x55), _mm512_permute_pd(y, 0xFF));
+    return _mm512_mask_blend_pd(0xAA, _mm512_sub_pd(a, b), _mm512_add_pd(a, b));
+  }
+  // The divisor is scaled by the larger magnitude of its parts, so that its
+  // squared magnitude does not overflow or underflow.
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg complex_op(ExprDivide, reg x, reg y) {
+    reg ay = _mm512_abs_pd(y);
+    reg s = _mm512_max_pd(_mm512_movedup_pd(ay), _mm512_permute_pd(ay, 0xFF));
+    y = _mm512_div_pd(y, s);
+    reg yr = _mm512_movedup_pd(y);
+    reg yi = _mm512_permute_pd(y, 0xFF);
+    reg a = _mm512_mul_pd(x, yr);
+    reg b = _mm512_mul_pd(_mm512_permute_pd(x, 0x55), yi);
+    // x * conj(y) = (xr yr + xi yi, xi yr - xr yi)
+    reg num =
+        _mm512_mask_blend_pd(0xAA, _mm512_add_pd(a, b), _mm512_sub_pd(a, b));
+    reg den = _mm512_mul_pd(
+        _mm512_add_pd(_mm512_mul_pd(yr, yr), _mm512_mul_pd(yi, yi)), s);
+    return _mm512_div_pd(num, den);
+  }
+};
+
+template <>
+struct SimdAVX512<float> {
+  using reg = __m512;
+  static constexpr size_t width = 16;
+
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg load(const float* p) { return _mm512_loadu_ps(p); }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg load(const int32_t* p) {
+    return _mm512_cvtepi32_ps(_mm512_loadu_si512(p));
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg set1(float c) { return _mm512_set1_ps(c); }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE void store(float* p, reg v) { _mm512_storeu_ps(p, v); }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE void store(int32_t* p, reg v) {
+    _mm512_storeu_si512(p, _mm512_cvttps_epi32(v));
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg op(ExprAdd, reg a, reg b) {
+    return _mm512_add_ps(a, b);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg op(ExprSubtract, reg a, reg b) {
+    return _mm512_sub_ps(a, b);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg op(ExprMultiply, reg a, reg b) {
+    return _mm512_mul_ps(a, b);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg op(ExprDivide, reg a, reg b) {
+    return _mm512_div_ps(a, b);
+  }
+
+  // Returns a * b + c, rounded once
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg fmadd(reg a, reg b, reg c) {
+    return _mm512_fmadd_ps(a, b, c);
+  }
+
+  // Operations on complex numbers, with interleaved real and imaginary parts
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg complex_op(ExprAdd, reg x, reg y) {
+    return _mm512_add_ps(x, y);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg complex_op(ExprSubtract, reg x, reg y) {
+    return _mm512_sub_ps(x, y);
+  }
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg complex_op(ExprMultiply, reg x, reg y) {
+    reg a = _mm512_mul_ps(x, _mm512_moveldup_ps(y));
+    reg b = _mm512_mul_ps(_mm512_permute_ps(x, 0xB1), _mm512_movehdup_ps(y));
+    return _mm512_mask_blend_ps(0xAAAA, _mm512_sub_ps(a, b),
+                                _mm512_add_ps(a, b));
+  }
+  // Division is done in double precision
+  NDARRAY_TARGET("avx512f")
+  static NDARRAY_INLINE reg complex_op(ExprDivide, reg x, reg y) {
+    using D = SimdAVX512<double>;
+    __m512d xd = _mm512_castps_pd(x);
+    __m512d yd = _mm512_castps_pd(y);
+    D::reg lo = D::complex_op(
+        ExprDivide(), _mm512_cvtps_pd(_mm512_castps512_ps256(x)),
+        _mm512_cvtps_pd(_mm512_castps512_ps256(y)));
+    D::reg hi = D::complex_op(
+        ExprDivide(),
+        _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(xd, 1))),
+        _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(yd, 1))));
+    __m512d r = _mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(lo)));
+    r = _mm512_insertf64x4(r, _mm256_castps_pd(_mm512_cvtpd_ps(hi)), 1);
+    return _mm512_castpd_ps(r);
+  }
+};
+
+// Operation for simd_peel which converts the elements of b
+struct SimdConvert {
+  template <class A, class B>
+  static void assign(A& a, const B& b) {
+    a = b;
+  }
+};
+
+// Applies the operation to the leading elements of a, until a is aligned to
+// a cache line, so that the vector stores which follow are aligned. Returns
+// the number of elements which were processed.
+template <class Op, class T, class C>
+NDARRAY_INLINE size_t simd_peel(T* a, const C* b, size_t n) {
+  size_t i = 0;
+  if (reinterpret_cast<std::uintptr_t>(a) % sizeof(T) != 0) return i;
+  while (i < n && reinterpret_cast<std::uintptr_t>(a + i) % 64 != 0) {
+    Op::assign(a[i], b[i]);
+    i++;
+  }
+  return i;
+}
+
+template <class Op, class T, class C>
+NDARRAY_INLINE size_t simd_peel_scalar(T* a, const C& c, size_t n) {
+  size_t i = 0;
+  if (reinterpret_cast<std::uintptr_t>(a) % sizeof(T) != 0) return i;
+  while (i < n && reinterpret_cast<std::uintptr_t>(a + i) % 64 != 0) {
+    Op::assign(a[i], c);
+    i++;
+  }
+  return i;
+}
+
+// Computes a[i] op= b[i] for as many elements as possible with the
+// instruction set, returning the number of elements which were processed.
+template <class Op, class T, class C>
+NDARRAY_TARGET("sse2")
+size_t simd_kernel_sse2(T* a, const C* b, size_t n) {
+  using V = SimdSSE2<simd_type<T, C>>;
+  size_t i = simd_peel<Op>(a, b, n);
+  for (; i + V::width <= n; i += V::width) {
+    V::store(a + i, V::op(Op(), V::load(a + i), V::load(b + i)));
+  }
+  return i;
+}
+
+template <class Op, class T, class C>
+NDARRAY_TARGET("avx2")
+size_t simd_kernel_avx2(T* a, const C* b, size_t n) {
+  using V = SimdAVX2<simd_type<T, C>>;
+  size_t i = simd_peel<Op>(a, b, n);
+  for (; i + V::width <= n; i += V::width) {
+    V::store(a + i, V::op(Op(), V::load(a + i), V::load(b + i)));
+  }
+  return i;
+}
+
+template <class Op, class T, class C>
+NDARRAY_TARGET("avx512f")
+size_t simd_kernel_avx512(T* a, const C* b, size_t n) {
+  using V = SimdAVX512<simd_type<T, C>>;
+  size_t i = simd_peel<Op>(a, b, n);
+  for (; i + V::width <= n; i += V::width) {
+    V::store(a + i, V::op(Op(), V::load(a + i), V::load(b + i)));
+  }
+  return i;
+}
+
+// Computes a[i] op= c for as many elements as possible with the instruction
+// set, returning the number of elements which were processed.
+template <class Op, class T, class C>
+NDARRAY_TARGET("sse2")
+size_t simd_kernel_scalar_sse2(T* a, const C& c, size_t n) {
+  using V = SimdSSE2<simd_type<T, C>>;
+  size_t i = simd_peel_scalar<Op>(a, c, n);
+  const typename V::reg vc = V::set1(static_cast<simd_type<T, C>>(c));
+  for (; i + V::width <= n; i += V::width) {
+    V::store(a + i, V::op(Op(), V::load(a + i), vc));
+  }
+  return i;
+}
+
+template <class Op, class T, class C>
+NDARRAY_TARGET("avx2")
+size_t simd_kernel_scalar_avx2(T* a, const C& c, size_t n) {
+  using V = SimdAVX2<simd_type<T, C>>;
+  size_t i = simd_peel_scalar<Op>(a, c, n);
+  const typename V::reg vc = V::set1(static_cast<simd_type<T, C>>(c));
+  for (; i + V::width <= n; i += V::width) {
+    V::store(a + i, V::op(Op(), V::load(a + i), vc));
+  }
+  return i;
+}
+
+template <class Op, class T, class C>
+NDARRAY_TARGET("avx512f")
+size_t simd_kernel_scalar_avx512(T* a, const C& c, size_t n) {
+  using V = SimdAVX512<simd_type<T, C>>;
+  size_t i = simd_peel_scalar<Op>(a, c, n);
+  const typename V::reg vc = V::set1(static_cast<simd_type<T, C>>(c));
+  for (; i + V::width <= n; i += V::width) {
+    V::store(a + i, V::op(Op(), V::load(a + i), vc));
+  }
+  return i;
+}
+
+// Computes a[i] = b[i] for as many elements as possible with the instruction
+// set, returning the number of elements which were processed.
+template <class T, class C>
+NDARRAY_TARGET("sse2")
+size_t simd_convert_kernel_sse2(T* a, const C* b, size_t n) {
+  using V = SimdSSE2<simd_type<T, C>>;
+  size_t i = simd_peel<SimdConvert>(a, b, n);
+  for (; i + V::width <= n; i += V::width) V::store(a + i, V::load(b + i));
+  return i;
+}
+
+template <class T, class C>
+NDARRAY_TARGET("avx2")
+size_t simd_convert_kernel_avx2(T* a, const C* b, size_t n) {
+  using V = SimdAVX2<simd_type<T, C>>;
+  size_t i = simd_peel<SimdConvert>(a, b, n);
+  for (; i + V::width <= n; i += V::width) V::store(a + i, V::load(b + i));
+  return i;
+}
+
+template <class T, class C>
+NDARRAY_TARGET("avx512f")
+size_t simd_convert_kernel_avx512(T* a, const C* b, size_t n) {
+  using V = SimdAVX512<simd_type<T, C>>;
+  size_t i = simd_peel<SimdConvert>(a, b, n);
+  for (; i + V::width <= n; i += V::width) V::store(a + i, V::load(b + i));
+  return i;
+}
+
+// Computes a[i] op= b[i] for arrays of complex numbers, returning the number
+// of elements which were processed.
+template <class Op, class R>
+NDARRAY_TARGET("avx2")
+size_t simd_complex_kernel_avx2(std::complex<R>* a, const std::complex<R>* b,
+                                size_t n) {
+  using V = SimdAVX2<R>;
+  R* pa = reinterpret_cast<R*>(a);
+  const R* pb = reinterpret_cast<const R*>(b);
+  size_t i = simd_peel<Op>(a, b, n);
+  for (; i + V::width / 2 <= n; i += V::width / 2) {
+    V::store(pa + 2 * i,
+             V::complex_op(Op(), V::load(pa + 2 * i), V::load(pb + 2 * i)));
+  }
+  return i;
+}
+
+template <class Op, class R>
+NDARRAY_TARGET("avx512f")
+size_t simd_complex_kernel_avx512(std::complex<R>* a,
+                                  const std::complex<R>* b, size_t n) {
+  using V = SimdAVX512<R>;
+  R* pa = reinterpret_cast<R*>(a);
+  const R* pb = reinterpret_cast<const R*>(b);
+  size_t i = simd_peel<Op>(a, b, n);
+  for (; i + V::width / 2 <= n; i += V::width / 2) {
+    V::store(pa + 2 * i,
+             V::complex_op(Op(), V::load(pa + 2 * i), V::load(pb + 2 * i)));
+  }
+  return i;
+}
+
+// GEMM micro-kernels, computing an (MV * width) x NR block of c as for
+// GemmKernel::kernel, with the block held in MV x NR registers. Every step
+// loads MV registers from the panel of a, and multiplies them by each of the
+// NR broadcast elements of the panel of b. The steps are fully unrolled, so
+// that the accumulators are never spilled to the stack.
+template <class T, size_t MV, size_t NR>
+NDARRAY_TARGET("avx2,fma")
+void gemm_kernel_avx2(size_t kc, const T* a, const T* b, T* tile) {
+  using V = SimdAVX2<T>;
+  typename V::reg acc[MV][NR];
+  for (size_t v = 0; v < MV; v++) {
+    for (size_t j = 0; j < NR; j++) acc[v][j] = V::set1(T(0));
+  }
+  for (size_t p = 0; p < kc; p++) {
+    typename V::reg av[MV];
+#pragma GCC unroll 4
+    for (size_t v = 0; v < MV; v++) av[v] = V::load(a + v * V::width);
+#pragma GCC unroll 16
+    for (size_t j = 0; j < NR; j++) {
+      typename V::reg bj = V::set1(b[j]);
+#pragma GCC unroll 4
+      for (size_t v = 0; v < MV; v++) {
+        acc[v][j] = V::fmadd(av[v], bj, acc[v][j]);
+      }
+    }
+    a += MV * V::width;
+    b += NR;
+  }
+  for (size_t j = 0; j < NR; j++) {
+    for (size_t v = 0; v < MV; v++) {
+      V::store(tile + (j * MV + v) * V::width, acc[v][j]);
+    }
+  }
+}
+
+template <class T, size_t MV, size_t NR>
+NDARRAY_TARGET("avx512f")
+void gemm_kernel_avx512(size_t kc, const T* a, const T* b, T* tile) {
+  using V = SimdAVX512<T>;
+  typename V::reg acc[MV][NR];
+  for (size_t v = 0; v < MV; v++) {
+    for (size_t j = 0; j < NR; j++) acc[v][j] = V::set1(T(0));
+  }
+  for (size_t p = 0; p < kc; p++) {
+    typename V::reg av[MV];
+#pragma GCC unroll 4
+    for (size_t v = 0; v < MV; v++) av[v] = V::load(a + v * V::width);
+#pragma GCC unroll 16
+    for (size_t j = 0; j < NR; j++) {
+      typename V::reg bj = V::set1(b[j]);
+#pragma GCC unroll 4
+      for (size_t v = 0; v < MV; v++) {
+        acc[v][j] = V::fmadd(av[v], bj, acc[v][j]);
+      }
+    }
+    a += MV * V::width;
+    b += NR;
   }
-  header += "), }";
+  for (size_t j = 0; j < NR; j++) {
+    for (size_t v = 0; v < MV; v++) {
+      V::store(tile + (j * MV + v) * V::width, acc[v][j]);
+    }
+  }
+}
 
-  // Based on header length, get version
-  char major_version;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
 
-  uint64_t beginning_length = 6 + 2 + 2 + header.size();
-  uint8_t padding_needed = 64 - (beginning_length % 64);
-  if (beginning_length + padding_needed > 65535) {
-    major_version = 0x02;
-    beginning_length += 2;
-  } else
-    major_version = 0x01;
-  // Add padding
-  for (uint8_t p = 0; p < padding_needed - 1; p++) header += '\x20';
-  header += '\n';
+// Runs the kernel for the widest instruction set supported by the CPU,
+// returning the number of elements which were processed.
+template <class Op, class T, class C>
+inline typename std::enable_if<!has_simd_kernel<Op, T, C>::value, size_t>::type
+simd_kernel(T*, const C*, size_t) {
+  return 0;
+}
 
-  char minor_version = 0x00;
-  file << major_version << minor_version;
+template <class Op, class T, class C>
+inline typename std::enable_if<
+    has_simd_kernel<Op, T, C>::value && is_simd_element<T>::value, size_t>::type
+simd_kernel(T* a, const C* b, size_t n) {
+  if (cpu_supports_avx512f()) return simd_kernel_avx512<Op>(a, b, n);
+  if (cpu_supports_avx2()) return simd_kernel_avx2<Op>(a, b, n);
+  if (cpu_supports_sse2()) return simd_kernel_sse2<Op>(a, b, n);
+  return 0;
+}
 
-  // Inf for len of header
-  if (major_version == 0x01) {
-    uint16_t len = static_cast<uint16_t>(header.size());
-    if (!system_is_little_endian()) {
-      swap_two_bytes((char*)&len);
-    }
-    file << ((char*)&len)[0] << ((char*)&len)[1];
-  } else {
-    uint32_t len = static_cast<uint32_t>(header.size());
-    if (!system_is_little_endian()) {
-      swap_four_bytes((char*)&len);
-    }
-    file << ((char*)&len)[0] << ((char*)&len)[1] << ((char*)&len)[2]
-         << ((char*)&len)[3];
-  }
+template <class Op, class R>
+inline typename std::enable_if<
+    has_simd_kernel<Op, std::complex<R>, std::complex<R>>::value, size_t>::type
+simd_kernel(std::complex<R>* a, const std::complex<R>* b, size_t n) {
+  if (cpu_supports_avx512f()) return simd_complex_kernel_avx512<Op>(a, b, n);
+  if (cpu_supports_avx2()) return simd_complex_kernel_avx2<Op>(a, b, n);
+  return 0;
+}
 
-  // Write header to file
-  file << header.c_str();
+template <class Op, class T, class C>
+inline typename std::enable_if<
+    !(has_simd_kernel<Op, T, C>::value && is_simd_element<T>::value),
+    size_t>::type
+simd_kernel_scalar(T*, const C&, size_t) {
+  return 0;
+}
 
-  // Write all data to file
-  std::streamsize n_bytes = static_cast<std::streamsize>(n_elements * size_of_DType(dtype));
-  file.write(data_ptr, n_bytes);
+template <class Op, class T, class C>
+inline typename std::enable_if<
+    has_simd_kernel<Op, T, C>::value && is_simd_element<T>::value, size_t>::type
+simd_kernel_scalar(T* a, const C& c, size_t n) {
+  if (cpu_supports_avx512f()) return simd_kernel_scalar_avx512<Op>(a, c, n);
+  if (cpu_supports_avx2()) return simd_kernel_scalar_avx2<Op>(a, c, n);
+  if (cpu_supports_sse2()) return simd_kernel_scalar_sse2<Op>(a, c, n);
+  return 0;
+}
+// Runs the conversion kernel for the widest instruction set supported by the
+// CPU, returning the number of elements which were processed.
+template <class T, class C>
+inline typename std::enable_if<!has_simd_convert<T, C>::value, size_t>::type
+simd_convert_kernel(T*, const C*, size_t) {
+  return 0;
+}
 
-  // Close file
-  file.close();
+template <class T, class C>
+inline typename std::enable_if<has_simd_convert<T, C>::value, size_t>::type
+simd_convert_kernel(T* a, const C* b, size_t n) {
+  if (cpu_supports_avx512f()) return simd_convert_kernel_avx512(a, b, n);
+  if (cpu_supports_avx2()) return simd_convert_kernel_avx2(a, b, n);
+  if (cpu_supports_sse2()) return simd_convert_kernel_sse2(a, b, n);
+  return 0;
 }
 
-inline DType descr_to_DType(const std::string& dtype) {
-  if (dtype == "b1")
-    return DType::CHAR;
-  else if (dtype == "B1")
-    return DType::UCHAR;
-  else if (dtype == "i2")
-    return DType::INT16;
-  else if (dtype == "i4")
-    return DType::INT32;
-  else if (dtype == "i8")
-    return DType::INT64;
-  else if (dtype == "u2")
-    return DType::UINT16;
-  else if (dtype == "u4")
-    return DType::UINT32;
-  else if (dtype == "u8")
-    return DType::UINT64;
-  else if (dtype == "f4")
-    return DType::FLOAT32;
-  else if (dtype == "f8")
-    return DType::DOUBLE64;
-  else if (dtype == "c8")
-    return DType::COMPLEX64;
-  else if (dtype == "c16")
-    return DType::COMPLEX128;
-  else {
-    std::string mssg = "Data type " + dtype + " is unknown.";
-    throw std::runtime_error(mssg);
+// Micro-kernels for float and double, which use 15 of the 16 (AVX2) or 27 of
+// the 32 (AVX-512) vector registers.
+template <class T>
+struct GemmKernelAVX2 {
+  static const size_t mr = 2 * SimdAVX2<T>::width;
+  static const size_t nr = 6;
+  static void kernel(size_t kc, const T* a, const T* b, T* tile) {
+    gemm_kernel_avx2<T, 2, 6>(kc, a, b, tile);
   }
-}
+};
 
-inline std::string DType_to_descr(DType dtype) {
-  switch (dtype) {
-    case DType::CHAR:
-      return "b1"; 
-      break;
-    case DType::UCHAR:
-      return "B1";
-      break;
-    case DType::INT16:
-      return "i2";
-      break;
-    case DType::INT32:
-      return "i4";
-      break;
-    case DType::INT64:
-      return "i8";
-      break;
-    case DType::UINT16:
-      return "u2";
-      break;
-    case DType::UINT32:
-      return "u4";
-      break;
-    case DType::UINT64:
-      return "u8";
-      break;
-    case DType::FLOAT32:
-      return "f4";
-      break;
-    case DType::DOUBLE64:
-      return "f8";
-      break;
-    case DType::COMPLEX64:
-      return "c8";
-      break;
-    case DType::COMPLEX128:
-      return "c16";
-      break;
-    default: {
-      std::string mssg = "Unknown DType identifier.";
-      throw std::runtime_error(mssg);        
-      break;
-    }
+template <class T>
+struct GemmKernelAVX512 {
+  static const size_t mr = 2 * SimdAVX512<T>::width;
+  static const size_t nr = 12;
+  static void kernel(size_t kc, const T* a, const T* b, T* tile) {
+    gemm_kernel_avx512<T, 2, 12>(kc, a, b, tile);
   }
+};
+
+template <class T>
+using if_gemm_simd = typename std::enable_if<
+    std::is_same<T, float>::value || std::is_same<T, double>::value,
+    bool>::type;
+
+template <class T>
+using if_not_gemm_simd = typename std::enable_if<
+    !(std::is_same<T, float>::value || std::is_same<T, double>::value),
+    bool>::type;
+
+// Computes gemm with the micro-kernel for the widest instruction set
+// supported by the CPU, returning false if there is none for T.
+template <class T>
+inline if_not_gemm_simd<T> gemm_simd(size_t, size_t, size_t, const T*,
+                                     std::ptrdiff_t, std::ptrdiff_t, const T*,
+                                     std::ptrdiff_t, std::ptrdiff_t, T*,
+                                     std::ptrdiff_t, std::ptrdiff_t) {
+  return false;
 }
 
-inline size_t size_of_DType(DType dtype) {
-  switch (dtype) {
-    case DType::CHAR:
-      return 1;
-      break;
-    case DType::UCHAR:
-      return 1;
-      break;
-    case DType::INT16:
-      return 2;
-      break;
-    case DType::INT32:
-      return 4;
-      break;
-    case DType::INT64:
-      return 8;
-      break;
-    case DType::UINT16:
-      return 2;
-      break;
-    case DType::UINT32:
-      return 4;
-      break;
-    case DType::UINT64:
-      return 8;
-      break;
-    case DType::FLOAT32:
-      return 4;
-      break;
-    case DType::DOUBLE64:
-      return 8;
-      break;
-    case DType::COMPLEX64:
-      return 8;
-      break;
-    case DType::COMPLEX128:
-      return 16;
-      break;
-    default: {
-      std::string mssg = "Unknown DType identifier.";
-      throw std::runtime_error(mssg);        
-      break;
-    }
+template <class T>
+inline if_gemm_simd<T> gemm_simd(size_t m, size_t n, size_t k, const T* a,
+                                 std::ptrdiff_t a_rs, std::ptrdiff_t a_cs,
+                                 const T* b, std::ptrdiff_t b_rs,
+                                 std::ptrdiff_t b_cs, T* c, std::ptrdiff_t c_rs,
+                                 std::ptrdiff_t c_cs) {
+  if (cpu_supports_avx512f()) {
+    gemm_blocked<GemmKernelAVX512<T>>(m, n, k, a, a_rs, a_cs, b, b_rs, b_cs, c,
+                                      c_rs, c_cs);
+    return true;
+  }
+  if (cpu_supports_avx2() && cpu_supports_fma()) {
+    gemm_blocked<GemmKernelAVX2<T>>(m, n, k, a, a_rs, a_cs, b, b_rs, b_cs, c,
+                                    c_rs, c_cs);
+    return true;
   }
+  return false;
 }
+#endif
 
-inline bool system_is_little_endian() {
-  int x = 1;
+template <class Op, class T, class C>
+void simd_apply(T* a, const C* b, size_t n) {
+  parallel_blocks(n, 1, [a, b](size_t begin, size_t end) {
+    T* a_block = a + begin;
+    const C* b_block = b + begin;
+    size_t n_block = end - begin;
+    size_t i = 0;
+#if defined(NDARRAY_X86_DISPATCH)
+    i = simd_kernel<Op>(a_block, b_block, n_block);
+#endif
+    for (; i < n_block; i++) Op::assign(a_block[i], b_block[i]);
+  });
+}
 
-  if (((char*)&x)[0] == 0x01)
-    return true;
-  else
-    return false;
+template <class Op, class T, class C>
+void simd_apply_scalar(T* a, const C& c, size_t n) {
+  parallel_blocks(n, 1, [a, &c](size_t begin, size_t end) {
+    T* a_block = a + begin;
+    size_t n_block = end - begin;
+    size_t i = 0;
+#if defined(NDARRAY_X86_DISPATCH)
+    i = simd_kernel_scalar<Op>(a_block, c, n_block);
+#endif
+    for (; i < n_block; i++) Op::assign(a_block[i], c);
+  });
 }
 
-inline void swap_bytes(char* data, uint64_t n_elements, size_t element_size) {
-  // Calculate number of total bytes
-  uint64_t number_of_bytes = n_elements * element_size;
-
-  // Iterate through all elements, and swap their bytes
-  for (uint64_t i = 0; i < number_of_bytes; i += element_size) {
-    switch (element_size) {
-      case 1:
-        // Nothing to do
-        break;
-      case 2:
-        swap_two_bytes(data + i);  
-        break;
-      case 4:
-        swap_four_bytes(data + i);
-        break;
-      case 8:
-        swap_eight_bytes(data + i);
-        break;
-      case 16:
-        swap_sixteen_bytes(data + i);
-        break;
-      default:
-        std::string mssg = "Cannot swap bytes for data types of size " +
-                           std::to_string(element_size);
-        throw std::runtime_error(mssg);
-        break;
-    }
-  }
+template <class T, class C>
+void simd_convert(T* a, const C* b, size_t n) {
+  parallel_blocks(n, 1, [a, b](size_t begin, size_t end) {
+    T* a_block = a + begin;
+    const C* b_block = b + begin;
+    size_t n_block = end - begin;
+    size_t i = 0;
+#if defined(NDARRAY_X86_DISPATCH)
+    i = simd_convert_kernel(a_block, b_block, n_block);
+#endif
+    for (; i < n_block; i++) a_block[i] = b_block[i];
+  });
 }
 
-inline void swap_two_bytes(char* bytes) {
-  // Temporary array to store original bytes
-  char temp[2];
+//==============================================================================
+// Matrix Product Implementation
+template <class T, class A, class B>
+NDArray<T, A> matmul(const NDArray<T, A>& a, const NDArray<T, B>& b) {
+  size_t a_ndim = a.shape().size();
+  size_t b_ndim = b.shape().size();
+  if (a_ndim < 1 || a_ndim > 2 || b_ndim < 1 || b_ndim > 2) {
+    std::string mssg = "matmul only supports NDArrays with 1 or 2 dimensions.";
+    throw std::runtime_error(mssg);
+  }
 
-  // Copyr original bytes into temp array
-  std::memcpy(&temp, bytes, 2);
+  // A vector on the left is a matrix with a single row, and a vector on the
+  // right a matrix with a single column.
+  size_t m = a_ndim == 2 ? a.shape()[0] : 1;
+  size_t k = a.shape()[a_ndim - 1];
+  size_t n = b_ndim == 2 ? b.shape()[1] : 1;
+  if (b.shape()[0] != k) {
+    std::string mssg = "Cannot matmul NDArrays with shapes which are not ";
+    mssg += "aligned.";
+    throw std::runtime_error(mssg);
+  }
 
-  // Set original bytes to new values
-  bytes[0] = temp[1];
-  bytes[1] = temp[0];
-}
+  std::ptrdiff_t a_rs = a_ndim == 2 ? a.strides()[0] : 0;
+  std::ptrdiff_t a_cs = a.strides()[a_ndim - 1];
+  std::ptrdiff_t b_rs = b.strides()[0];
+  std::ptrdiff_t b_cs = b_ndim == 2 ? b.strides()[1] : 0;
+
+  std::vector<size_t> shape;
+  if (a_ndim == 2) shape.push_back(m);
+  if (b_ndim == 2) shape.push_back(n);
+  if (shape.empty()) shape.push_back(1);
+
+  bool c_continuous = a.c_continuous() || b.c_continuous();
+  NDArray<T, A> result(shape, c_continuous, a.get_allocator());
+  std::ptrdiff_t c_rs = 0;
+  std::ptrdiff_t c_cs = 0;
+  if (shape.size() == 2) {
+    c_rs = result.strides()[0];
+    c_cs = result.strides()[1];
+  } else if (a_ndim == 2) {
+    c_rs = 1;
+  } else {
+    c_cs = 1;
+  }
 
-inline void swap_four_bytes(char* bytes) {
-  // Temporary array to store original bytes
-  char temp[4];
+  gemm(m, n, k, a.data(), a_rs, a_cs, b.data(), b_rs, b_cs, result.data(),
+       c_rs, c_cs);
+  return result;
+}
 
-  // Copyr original bytes into temp array
-  std::memcpy(&temp, bytes, 4);
+template <class T, class A, class B>
+T dot(const NDArray<T, A>& a, const NDArray<T, B>& b) {
+  if (a.shape().size() != 1 || b.shape().size() != 1 ||
+      a.size() != b.size()) {
+    std::string mssg = "dot only supports two NDArrays with 1 dimension of ";
+    mssg += "the same length.";
+    throw std::runtime_error(mssg);
+  }
 
-  // Set original bytes to new values
-  bytes[0] = temp[3];
-  bytes[1] = temp[2];
-  bytes[2] = temp[1];
-  bytes[3] = temp[0];
+  // As for sum(), the partial sums of the blocks are added in order
+  std::vector<std::pair<size_t, T>> partials;
+  std::mutex partials_mutex;
+  const T* x = a.data();
+  const T* y = b.data();
+  parallel_blocks(a.size(), 1, [&](size_t begin, size_t end) {
+    T partial = pairwise_dot(x + begin, y + begin, end - begin);
+    std::lock_guard<std::mutex> lock(partials_mutex);
+    partials.push_back({begin, partial});
+  });
+
+  std::sort(partials.begin(), partials.end(),
+            [](const std::pair<size_t, T>& l, const std::pair<size_t, T>& r) {
+              return l.first < r.first;
+            });
+
+  T total = T();
+  for (const auto& partial : partials) total += partial.second;
+  return total;
 }
 
-inline void swap_eight_bytes(char* bytes) {
-  // Temporary array to store original bytes
-  char temp[8];
+template <class T, class A, class B>
+NDArray<T, A> outer(const NDArray<T, A>& a, const NDArray<T, B>& b) {
+  if (a.shape().size() != 1 || b.shape().size() != 1) {
+    std::string mssg = "outer only supports NDArrays with 1 dimension.";
+    throw std::runtime_error(mssg);
+  }
 
-  // Copyr original bytes into temp array
-  std::memcpy(&temp, bytes, 8);
+  size_t m = a.size();
+  size_t n = b.size();
+  auto result = NDArray<T, A>::uninitialized({m, n}, true, a.get_allocator());
+  const T* x = a.data();
+  const T* y = b.data();
+  T* out = result.data();
+  parallel_blocks(m, n, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const T xi = x[i];
+      T* row = out + i * n;
+      for (size_t j = 0; j < n; j++) row[j] = xi * y[j];
+    }
+  });
+  return result;
+}
 
-  // Set original bytes to new values
-  bytes[0] = temp[7];
-  bytes[1] = temp[6];
-  bytes[2] = temp[5];
-  bytes[3] = temp[4];
-  bytes[4] = temp[3];
-  bytes[5] = temp[2];
-  bytes[6] = temp[1];
-  bytes[7] = temp[0];
+template <class T>
+void gemm(size_t m, size_t n, size_t k, const T* a, std::ptrdiff_t a_rs,
+          std::ptrdiff_t a_cs, const T* b, std::ptrdiff_t b_rs,
+          std::ptrdiff_t b_cs, T* c, std::ptrdiff_t c_rs, std::ptrdiff_t c_cs) {
+  if (m == 0 || n == 0 || k == 0) return;
+#if defined(NDARRAY_X86_DISPATCH)
+  if (gemm_simd(m, n, k, a, a_rs, a_cs, b, b_rs, b_cs, c, c_rs, c_cs)) return;
+#endif
+  gemm_blocked<GemmKernel<T>>(m, n, k, a, a_rs, a_cs, b, b_rs, b_cs, c, c_rs,
+                              c_cs);
 }
 
-inline void swap_sixteen_bytes(char* bytes) {
-  // Temporary array to store original bytes
-  char temp[16];
+template <class T>
+void GemmKernel<T>::kernel(size_t kc, const T* a, const T* b, T* tile) {
+  T acc[mr * nr] = {};
+  for (size_t p = 0; p < kc; p++) {
+    for (size_t j = 0; j < nr; j++) {
+      for (size_t i = 0; i < mr; i++) acc[j * mr + i] += a[i] * b[j];
+    }
+    a += mr;
+    b += nr;
+  }
+  std::copy(acc, acc + mr * nr, tile);
+}
 
-  // Copyr original bytes into temp array
-  std::memcpy(&temp, bytes, 16);
+template <class K, class T>
+void gemm_blocked(size_t m, size_t n, size_t k, const T* a,
+                  std::ptrdiff_t a_rs, std::ptrdiff_t a_cs, const T* b,
+                  std::ptrdiff_t b_rs, std::ptrdiff_t b_cs, T* c,
+                  std::ptrdiff_t c_rs, std::ptrdiff_t c_cs) {
+  const size_t mr = K::mr;
+  const size_t nr = K::nr;
+  // A packed kc x nr panel of b stays in the L1 cache while it is multiplied
+  // by the mc x kc block of a in the L2 cache. The kc x nc block of b is
+  // shared by all threads in the L3 cache.
+  const size_t kc_max = 256;
+  const size_t mc_max = std::max(mr, 128 / mr * mr);
+  const size_t nc_max = std::max(nr, 2048 / nr * nr);
+  std::vector<T, AlignedAllocator<T>> b_pack(kc_max * nc_max);
+
+  for (size_t jc = 0; jc < n; jc += nc_max) {
+    size_t nc = std::min(nc_max, n - jc);
+    for (size_t pc = 0; pc < k; pc += kc_max) {
+      size_t kc = std::min(kc_max, k - pc);
+
+      // Columns past the edge of b are padded with zeros
+      const T* b_block = b + pc * b_rs + jc * b_cs;
+      for (size_t jr = 0; jr < nc; jr += nr) {
+        T* panel = b_pack.data() + jr * kc;
+        size_t n_cols = std::min(nr, nc - jr);
+        for (size_t p = 0; p < kc; p++) {
+          const T* row = b_block + p * b_rs + jr * b_cs;
+          for (size_t j = 0; j < n_cols; j++) panel[j] = row[j * b_cs];
+          for (size_t j = n_cols; j < nr; j++) panel[j] = T();
+          panel += nr;
+        }
+      }
 
-  // Set original bytes to new values
-  bytes[0] = temp[15];
-  bytes[1] = temp[14];
-  bytes[2] = temp[13];
-  bytes[3] = temp[12];
-  bytes[4] = temp[11];
-  bytes[5] = temp[10];
-  bytes[6] = temp[9];
-  bytes[7] = temp[8];
-  bytes[8] = temp[7];
-  bytes[9] = temp[6];
-  bytes[10] = temp[5];
-  bytes[11] = temp[4];
-  bytes[12] = temp[3];
-  bytes[13] = temp[2];
-  bytes[14] = temp[1];
-  bytes[15] = temp[0];
+      size_t n_blocks = (m + mc_max - 1) / mc_max;
+      parallel_blocks(n_blocks, mc_max * nc, [&](size_t begin, size_t end) {
+        std::vector<T, AlignedAllocator<T>> a_pack(mc_max * kc);
+        alignas(64) T tile[K::mr * K::nr];
+        for (size_t block = begin; block < end; block++) {
+          size_t ic = block * mc_max;
+          size_t mc = std::min(mc_max, m - ic);
+
+          // Rows past the edge of a are padded with zeros
+          const T* a_block = a + ic * a_rs + pc * a_cs;
+          for (size_t ir = 0; ir < mc; ir += mr) {
+            T* panel = a_pack.data() + ir * kc;
+            size_t n_rows = std::min(mr, mc - ir);
+            for (size_t p = 0; p < kc; p++) {
+              const T* col = a_block + ir * a_rs + p * a_cs;
+              for (size_t i = 0; i < n_rows; i++) panel[i] = col[i * a_rs];
+              for (size_t i = n_rows; i < mr; i++) panel[i] = T();
+              panel += mr;
+            }
+          }
+
+          for (size_t jr = 0; jr < nc; jr += nr) {
+            size_t n_cols = std::min(nr, nc - jr);
+            for (size_t ir = 0; ir < mc; ir += mr) {
+              size_t n_rows = std::min(mr, mc - ir);
+              K::kernel(kc, a_pack.data() + ir * kc, b_pack.data() + jr * kc,
+                        tile);
+              T* c_tile = c + (ic + ir) * c_rs + (jc + jr) * c_cs;
+              for (size_t j = 0; j < n_cols; j++) {
+                for (size_t i = 0; i < n_rows; i++) {
+                  c_tile[i * c_rs + j * c_cs] += tile[j * mr + i];
+                }
+              }
+            }
+          }
+        }
+      });
+    }
+  }
 }
+
 #endif  // NP_ARRAY_H
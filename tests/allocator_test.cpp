@@ -0,0 +1,193 @@
+#include <ndarray.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// AlignedAllocator, PoolAllocator and MonotonicAllocator must hand out
+// aligned, distinct blocks, reuse memory as documented, and work as the
+// allocator of NDArray, including in expressions evaluated on several
+// threads.
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+static bool aligned(const void* p, size_t alignment) {
+  return reinterpret_cast<std::uintptr_t>(p) % alignment == 0;
+}
+
+// Requests too large for size_t are refused
+template <class Alloc>
+static bool refuses_overflow(Alloc alloc) {
+  try {
+    alloc.allocate(std::numeric_limits<size_t>::max() / 2);
+  } catch (const std::bad_alloc&) {
+    return true;
+  }
+  return false;
+}
+
+static void test_aligned() {
+  AlignedAllocator<double> alloc;
+  bool ok = alloc.allocate(0) == nullptr;
+  for (size_t n : {1, 3, 17, 1000}) {
+    double* p = alloc.allocate(n);
+    std::fill(p, p + n, 1.);
+    ok = ok && aligned(p, 64);
+    alloc.deallocate(p, n);
+  }
+  check(ok, "AlignedAllocator aligns to 64 bytes");
+
+  AlignedAllocator<char, 4096> page_alloc;
+  char* p = page_alloc.allocate(5);
+  check(aligned(p, 4096), "AlignedAllocator aligns to 4096 bytes");
+  page_alloc.deallocate(p, 5);
+  alloc.deallocate(nullptr, 0);
+
+  check(refuses_overflow(alloc), "AlignedAllocator refuses overflow");
+}
+
+static void test_pool() {
+  PoolAllocator<double> alloc;
+  check(alloc.allocate(0) == nullptr, "PoolAllocator of nothing");
+
+  // A freed block is reused for a request of the same size class
+  double* p = alloc.allocate(100);
+  std::fill(p, p + 100, 1.);
+  alloc.deallocate(p, 100);
+  double* q = alloc.allocate(120);
+  check(q == p && aligned(q, 64), "PoolAllocator reuses a freed block");
+
+  // but not for another size class
+  double* r = alloc.allocate(1000);
+  check(r != q && aligned(r, 64), "PoolAllocator size classes");
+  alloc.deallocate(r, 1000);
+  alloc.deallocate(q, 120);
+
+  // Blocks larger than the largest class go straight to the heap
+  const size_t large = (size_t(1) << 24) / sizeof(double) + 1;
+  double* big = alloc.allocate(large);
+  big[large - 1] = 1.;
+  check(aligned(big, 64), "PoolAllocator of a large block");
+  alloc.deallocate(big, large);
+
+  // A block may be freed by another thread, which caches it
+  double* s = alloc.allocate(50);
+  std::thread([s]() { PoolAllocator<double>().deallocate(s, 50); }).join();
+
+  // Many blocks of one class are held at once
+  std::vector<double*> blocks;
+  for (size_t i = 0; i < 20; i++) blocks.push_back(alloc.allocate(64));
+  std::vector<double*> sorted = blocks;
+  std::sort(sorted.begin(), sorted.end());
+  check(std::unique(sorted.begin(), sorted.end()) == sorted.end(),
+        "PoolAllocator blocks are distinct");
+  for (double* b : blocks) alloc.deallocate(b, 64);
+
+  check(refuses_overflow(alloc), "PoolAllocator refuses overflow");
+}
+
+static void test_monotonic() {
+  MonotonicArena arena(4096);
+  MonotonicAllocator<double> alloc(arena);
+  check(alloc.arena() == &arena && alloc.allocate(0) == nullptr,
+        "MonotonicAllocator of nothing");
+
+  // Allocations are aligned and do not overlap, and grow the arena
+  std::vector<std::pair<double*, size_t>> blocks;
+  bool ok = true;
+  for (size_t n : {1, 7, 100, 600, 3, 5000, 2}) {
+    double* p = alloc.allocate(n);
+    std::fill(p, p + n, static_cast<double>(n));
+    ok = ok && aligned(p, 64);
+    for (const auto& b : blocks) {
+      ok = ok && (p + n <= b.first || b.first + b.second <= p);
+    }
+    blocks.push_back({p, n});
+  }
+  for (const auto& b : blocks) {
+    ok = ok && std::all_of(b.first, b.first + b.second, [&b](double x) {
+           return x == static_cast<double>(b.second);
+         });
+  }
+  check(ok, "MonotonicArena allocations are aligned and distinct");
+  size_t capacity = arena.capacity();
+  check(capacity >= 5000 * sizeof(double), "MonotonicArena capacity");
+
+  // A reset keeps only the largest block, from which allocation restarts
+  arena.reset();
+  check(arena.capacity() < capacity && arena.capacity() >= 4096,
+        "MonotonicArena reset keeps the largest block");
+  double* first = alloc.allocate(10);
+  double* second = alloc.allocate(10);
+  check(second == first + 16, "MonotonicArena allocates after a reset");
+
+  // Allocators are equal when they share an arena
+  MonotonicArena other(4096);
+  MonotonicAllocator<float> rebound(alloc);
+  check(rebound == alloc && rebound.arena() == &arena &&
+            MonotonicAllocator<double>(other) != alloc,
+        "MonotonicAllocator equality");
+  check(MonotonicAllocator<int>().arena() == &MonotonicArena::thread_default(),
+        "MonotonicAllocator default arena");
+
+  check(refuses_overflow(alloc), "MonotonicAllocator refuses overflow");
+}
+
+// Arithmetic, conversions and reductions with arrays using Alloc
+template <class Alloc>
+static void test_ndarray(const Alloc& alloc, const std::string& name) {
+  using Array = NDArray<double, Alloc>;
+  for (size_t n_threads : {1, 4}) {
+    execution_settings() = ExecutionSettings{n_threads, 1};
+    const std::string what = name + " on " + std::to_string(n_threads);
+
+    Array a({301, 7}, true, alloc);
+    for (size_t i = 0; i < a.size(); i++) a[i] = static_cast<double>(i);
+    Array b = 2. * a + a;
+    Array f = a.as_fortran_contiguous();
+    b -= f;
+    b /= 2.;
+    NDArray<double> plain = b;
+
+    bool same = aligned(a.data(), 64) && a.get_allocator() == alloc &&
+                f.get_allocator() == alloc && !f.c_continuous();
+    for (size_t i = 0; same && i < a.size(); i++) same = plain[i] == a[i];
+    check(same, "NDArray with " + what);
+    check(b.sum() == a.sum(), "sum of NDArray with " + what);
+
+    a.reallocate({1000, 7});
+    check(a[301 * 7 - 1] == 301 * 7 - 1 && a[301 * 7] == 0.,
+          "reallocate of NDArray with " + what);
+  }
+  execution_settings() = ExecutionSettings{1, 1};
+}
+
+int main() {
+  ExecutionSettings saved = execution_settings();
+
+  test_aligned();
+  test_pool();
+  test_monotonic();
+
+  test_ndarray(AlignedAllocator<double>(), "AlignedAllocator");
+  test_ndarray(PoolAllocator<double>(), "PoolAllocator");
+  MonotonicArena arena;
+  test_ndarray(MonotonicAllocator<double>(arena), "MonotonicAllocator");
+
+  execution_settings() = saved;
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
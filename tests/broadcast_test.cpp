@@ -0,0 +1,173 @@
+#include <ndarray.hpp>
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Operands of different shapes are broadcast as in NumPy. Every result is
+// compared with elements looked up by a multi-index, for operands of both
+// layouts, on one and on several threads.
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+static std::string to_string(const std::vector<size_t>& shape) {
+  std::string s = "{";
+  for (size_t i = 0; i < shape.size(); i++) {
+    s += (i > 0 ? ", " : "") + std::to_string(shape[i]);
+  }
+  return s + "}";
+}
+
+static NDArray<double> iota(const std::vector<size_t>& shape,
+                            bool c_continuous, double start) {
+  NDArray<double> a(shape, c_continuous);
+  for (size_t i = 0; i < a.size(); i++) a[i] = start + static_cast<double>(i);
+  return a;
+}
+
+// The element of a which is broadcast to index, of a shape with more axes
+template <class A>
+static double element(const A& a, const std::vector<size_t>& index) {
+  std::vector<size_t> a_index(a.shape().size());
+  size_t lead = index.size() - a_index.size();
+  for (size_t i = 0; i < a_index.size(); i++) {
+    a_index[i] = a.shape()[i] == 1 ? 0 : index[lead + i];
+  }
+  return a(a_index);
+}
+
+// Whether res(index) == f(a(index), b(index)) for every index of shape
+template <class R, class A, class B, class F>
+static bool matches(const R& res, const std::vector<size_t>& shape,
+                    const A& a, const B& b, F f) {
+  if (res.shape() != shape) return false;
+  std::vector<size_t> index(shape.size(), 0);
+  for (size_t n = 0; n < res.size(); n++) {
+    if (res(index) != f(element(a, index), element(b, index))) return false;
+    for (size_t i = shape.size(); i-- > 0;) {
+      if (++index[i] < shape[i]) break;
+      index[i] = 0;
+    }
+  }
+  return true;
+}
+
+struct Case {
+  std::vector<size_t> a, b, result;
+};
+
+static void test_shapes() {
+  const std::vector<Case> cases = {
+      {{2, 3, 4}, {4}, {2, 3, 4}},       {{4}, {2, 3, 4}, {2, 3, 4}},
+      {{3, 1}, {1, 4}, {3, 4}},          {{2, 1, 4}, {3, 1}, {2, 3, 4}},
+      {{5, 1, 1}, {1, 6, 7}, {5, 6, 7}}, {{1}, {3, 3}, {3, 3}},
+      {{37, 1}, {1, 129}, {37, 129}},    {{0, 3}, {1, 3}, {0, 3}},
+      {{3, 2}, {3, 2}, {3, 2}}};
+
+  for (const Case& c : cases) {
+    const std::string shapes = to_string(c.a) + " and " + to_string(c.b);
+    check(broadcast_shape(c.a, c.b, "add") == c.result,
+          "broadcast_shape of " + shapes);
+
+    for (int layout = 0; layout < 4; layout++) {
+      bool a_c = layout & 1, b_c = layout & 2;
+      const std::string what = shapes + (a_c ? ", a c" : ", a f") +
+                               (b_c ? ", b c" : ", b f");
+      NDArray<double> a = iota(c.a, a_c, 1);
+      NDArray<double> b = iota(c.b, b_c, 100);
+
+      NDArray<double> sum = a + b;
+      check(matches(sum, c.result, a, b,
+                    [](double x, double y) { return x + y; }),
+            "a + b of " + what);
+
+      NDArray<double> expr = 2. * a - b / 4.;
+      check(matches(expr, c.result, a, b,
+                    [](double x, double y) { return 2. * x - y / 4.; }),
+            "2 * a - b / 4 of " + what);
+
+      // Through views, and with the operands of another type
+      NDArray<float> bf = b;
+      NDArray<double> mixed = a.view() * bf.view();
+      check(matches(mixed, c.result, a, b,
+                    [](double x, double y) { return x * y; }),
+            "a.view() * b.view() of " + what);
+
+      // Compound operators broadcast the operand to the destination
+      if (c.result == c.a) {
+        NDArray<double> res = a;
+        res += b;
+        check(matches(res, c.result, a, b,
+                      [](double x, double y) { return x + y; }),
+              "a += b of " + what);
+
+        res = a;
+        res.view() -= b.view();
+        check(matches(res, c.result, a, b,
+                      [](double x, double y) { return x - y; }),
+              "a.view() -= b.view() of " + what);
+
+        res = a;
+        res *= b + 1.;
+        check(matches(res, c.result, a, b,
+                      [](double x, double y) { return x * (y + 1.); }),
+              "a *= b + 1 of " + what);
+      } else {
+        // The destination is never broadcast
+        NDArray<double> res = a;
+        bool threw = false;
+        try {
+          res += b;
+        } catch (const std::runtime_error&) {
+          threw = true;
+        }
+        check(threw, "a += b of " + what + " throws");
+      }
+    }
+  }
+
+  // Shapes which cannot be broadcast
+  const std::vector<std::pair<std::vector<size_t>, std::vector<size_t>>>
+      bad = {{{3}, {4}}, {{2, 3}, {3, 2}}, {{2, 3, 4}, {3, 1, 4}}};
+  for (const auto& p : bad) {
+    const std::string shapes = to_string(p.first) + " and " +
+                               to_string(p.second);
+    bool threw = false;
+    try {
+      broadcast_shape(p.first, p.second, "add");
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    check(threw, "broadcast_shape of " + shapes + " throws");
+
+    threw = false;
+    try {
+      NDArray<double> r = iota(p.first, true, 0) + iota(p.second, true, 0);
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    check(threw, "a + b of " + shapes + " throws");
+  }
+}
+
+int main() {
+  ExecutionSettings saved = execution_settings();
+
+  for (size_t n_threads : {1, 4}) {
+    execution_settings() = ExecutionSettings{n_threads, 1};
+    test_shapes();
+  }
+
+  execution_settings() = saved;
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
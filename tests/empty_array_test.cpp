@@ -0,0 +1,52 @@
+#include <ndarray.hpp>
+
+#include <iostream>
+#include <string>
+
+// Operations on a default constructed array, which has no axes and no data,
+// must visit no elements.
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+int main() {
+  NDArray<double> a;
+  const NDArray<double>& ca = a;
+
+  a.view().fill(1.);
+  a.view() += 1.;
+  a.view() *= 2.;
+  a.view() += a.view();
+  a.view() -= a.transpose();
+  a.view() += a + 1.;
+  a += a;
+  a += a.transpose();
+  a += 1.;
+  a = a * 2.;
+  check(a.size() == 0 && a.shape().empty(), "default array stays empty");
+
+  size_t n_visited = 0;
+  for (auto it = a.nditer(); !it.done(); ++it) n_visited++;
+  for (auto it = ca.nditer(); !it.done(); ++it) n_visited++;
+  for (auto it = a.view().nditer(); !it.done(); ++it) n_visited++;
+  for (double x : a) n_visited += x == 0. ? 1 : 2;
+  check(n_visited == 0, "no elements visited");
+
+  check(a.sum() == 0., "sum of no elements");
+
+  // Arrays with an axis of length 0 are empty too
+  NDArray<double> b({0, 3});
+  b.view().fill(1.);
+  b += b.transpose().transpose();
+  b.view() += 1.;
+  check(b.size() == 0, "array with an empty axis");
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#include <ndarray.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Expressions which read the array they are assigned to through other
+// strides must give the same result as if they were evaluated into a new
+// array first.
+
+static int n_failures = 0;
+
+template <class A>
+static void check(const A& arr, const std::vector<double>& expected,
+                  const std::string& what) {
+  bool same = arr.size() == expected.size();
+  for (size_t i = 0; same && i < expected.size(); i++) {
+    same = arr[i] == expected[i];
+  }
+  if (!same) {
+    std::cerr << "FAILED: " << what << ":";
+    for (size_t i = 0; i < arr.size(); i++) std::cerr << " " << arr[i];
+    std::cerr << "\n";
+    n_failures++;
+  }
+}
+
+static NDArray<double> iota(const std::vector<size_t>& shape,
+                            bool c_continuous = true) {
+  NDArray<double> a(shape, c_continuous);
+  for (size_t i = 0; i < a.size(); i++) a[i] = static_cast<double>(i);
+  return a;
+}
+
+int main() {
+  const std::vector<double> t = {0, 3, 6, 1, 4, 7, 2, 5, 8};
+  const std::vector<double> sum_t = {0, 4, 8, 4, 8, 12, 8, 12, 16};
+
+  NDArray<double> a = iota({3, 3});
+  a = a.transpose();
+  check(a, t, "a = a.transpose()");
+
+  a = iota({3, 3});
+  a += a.transpose();
+  check(a, sum_t, "a += a.transpose()");
+
+  a = iota({3, 3});
+  a = a + a.transpose();
+  check(a, sum_t, "a = a + a.transpose()");
+
+  a = iota({3, 3});
+  a -= 2. * a.transpose();
+  check(a, {0, -5, -10, 1, -4, -9, 2, -3, -8}, "a -= 2 * a.transpose()");
+
+  // Fortran layout, and a result of another type
+  a = iota({3, 3}, false);
+  a = a.transpose();
+  check(a, t, "fortran a = a.transpose()");
+
+  a = iota({3, 3});
+  NDArray<float> f = iota({3, 3});
+  a = f.transpose() + a.transpose();
+  check(a, {0, 6, 12, 2, 8, 14, 4, 10, 16}, "mixed types");
+
+  // Shifted views of the same row, read and written in opposite directions
+  NDArray<double> b = iota({6});
+  b(Range(1, 6)) += b(Range(0, 5));
+  check(b, {0, 1, 3, 5, 7, 9}, "shift up");
+
+  b = iota({6});
+  b(Range(0, 5)) += b(Range(1, 6));
+  check(b, {1, 3, 5, 7, 9, 5}, "shift down");
+
+  b = iota({6});
+  b(Range(1, 6)) += b(Range(0, 5)) * 1.;
+  check(b, {0, 1, 3, 5, 7, 9}, "shift up expression");
+
+  // Broadcasting a row of the array over the whole array
+  a = iota({3, 3});
+  a.view() *= a(Range(1), Range(0, 3));
+  check(a, {0, 4, 10, 9, 16, 25, 18, 28, 40}, "broadcast row");
+
+  // Compound operators of views
+  a = iota({3, 3});
+  a.view() += a.transpose();
+  check(a, sum_t, "view += transpose view");
+
+  a = iota({3, 3});
+  a.view() += a.transpose() + 0.;
+  check(a, sum_t, "view += transpose expression");
+
+  FixedNDArray<double, 2> x({3, 3});
+  for (size_t i = 0; i < x.size(); i++) x[i] = static_cast<double>(i);
+  x = x.view().transpose();
+  check(x, t, "FixedNDArray x = x.transpose()");
+
+  // Reading the same elements as are written needs no temporary
+  a = iota({3, 3});
+  a = a * a + 1.;
+  check(a, {1, 2, 5, 10, 17, 26, 37, 50, 65}, "a = a * a + 1");
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+#include <ndarray.hpp>
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A FixedNDArray must index, slice, convert and take part in expressions
+// exactly as an NDArray of the same shape and layout does.
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+template <class T>
+static bool same_elements(const FixedNDArray<T, 3>& f, const NDArray<T>& a) {
+  if (f.size() != a.size()) return false;
+  for (size_t i = 0; i < f.shape()[0]; i++) {
+    for (size_t j = 0; j < f.shape()[1]; j++) {
+      for (size_t k = 0; k < f.shape()[2]; k++) {
+        if (f(i, j, k) != a(i, j, k)) return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void test_layout(bool c_continuous) {
+  const std::string layout = c_continuous ? " c" : " f";
+  const std::array<size_t, 3> shape = {{4, 5, 6}};
+  FixedNDArray<double, 3> f(shape, c_continuous);
+  NDArray<double> a({4, 5, 6}, c_continuous);
+  std::iota(f.begin(), f.end(), 0.);
+  std::iota(a.begin(), a.end(), 0.);
+
+  // Layout, strides and indexing match those of NDArray
+  check(f.shape() == shape && f.size() == 120 &&
+            f.c_continuous() == c_continuous,
+        "shape" + layout);
+  check(std::vector<size_t>(f.strides().begin(), f.strides().end()) ==
+            a.strides(),
+        "strides" + layout);
+  bool same = true;
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t j = 0; j < 5; j++) {
+      for (size_t k = 0; k < 6; k++) {
+        std::array<size_t, 3> index = {{i, j, k}};
+        same = same && f.linear_index(i, j, k) == a.linear_index(i, j, k) &&
+               f(index) == f(i, j, k) &&
+               f.at_unchecked(i, j, k) == f(i, j, k);
+      }
+    }
+  }
+  check(same && same_elements(f, a), "indexing" + layout);
+
+  // Every index out of range is caught
+  int n_threw = 0;
+  for (const std::array<size_t, 3>& index :
+       {std::array<size_t, 3>{{4, 0, 0}}, std::array<size_t, 3>{{0, 5, 0}},
+        std::array<size_t, 3>{{0, 0, 6}}}) {
+    try {
+      f(index);
+    } catch (const std::out_of_range&) {
+      n_threw++;
+    }
+  }
+  check(n_threw == 3, "indices out of range throw" + layout);
+
+  // Slices and views are those of NDArray
+  NDArrayView<double> fs = f(Range(1, 3), Range(), Range(2, 6, 2));
+  NDArrayView<double> as = a(Range(1, 3), Range(), Range(2, 6, 2));
+  same = fs.shape() == as.shape();
+  for (size_t i = 0; same && i < fs.shape()[0]; i++) {
+    for (size_t j = 0; same && j < fs.shape()[1]; j++) {
+      for (size_t k = 0; same && k < fs.shape()[2]; k++) {
+        same = fs(i, j, k) == as(i, j, k);
+      }
+    }
+  }
+  check(same, "slicing" + layout);
+
+  // Expressions with NDArray in either position, and compound operators
+  NDArray<double> sum = f + a;
+  NDArray<double> expected = a + a;
+  check(sum.shape() == expected.shape() &&
+            std::equal(sum.begin(), sum.end(), expected.begin()),
+        "f + a" + layout);
+
+  FixedNDArray<double, 3> g = 2. * a - f;
+  check(same_elements(g, a), "g = 2 * a - f" + layout);
+  g += f;
+  g *= 0.5;
+  check(same_elements(g, a), "compound operators" + layout);
+  g -= a;
+  g /= 2.;
+  check(std::all_of(g.begin(), g.end(), [](double x) { return x == 0.; }),
+        "compound operators with NDArray" + layout);
+
+  // Broadcasting a row against the array
+  NDArray<double> row({6});
+  std::iota(row.begin(), row.end(), 100.);
+  g = f;
+  g += row;
+  same = true;
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t j = 0; j < 5; j++) {
+      for (size_t k = 0; k < 6; k++) {
+        same = same && g(i, j, k) == f(i, j, k) + row(k);
+      }
+    }
+  }
+  check(same, "broadcast row" + layout);
+
+  // Conversion both ways keeps the layout
+  NDArray<double> back = f.view();
+  FixedNDArray<double, 3> from(a);
+  check(back.c_continuous() == c_continuous &&
+            from.c_continuous() == c_continuous && same_elements(from, back),
+        "conversion" + layout);
+
+  // Assigning another shape reallocates
+  FixedNDArray<double, 3> h(std::array<size_t, 3>{{1, 1, 1}});
+  h = a;
+  check(h.shape() == shape && same_elements(h, a),
+        "assign other shape" + layout);
+
+  // Reshape keeps the elements in memory order, reallocate zeroes new ones
+  FixedNDArray<double, 3> r = f;
+  r.reshape({{2, 6, 10}});
+  check(r.shape()[2] == 10 && std::equal(r.begin(), r.end(), f.begin()),
+        "reshape" + layout);
+  n_threw = 0;
+  try {
+    r.reshape({{2, 6, 11}});
+  } catch (const std::runtime_error&) {
+    n_threw++;
+  }
+  check(n_threw == 1, "reshape to another size throws" + layout);
+  r.reallocate({{4, 5, 7}});
+  check(r.size() == 140 && std::equal(f.begin(), f.end(), r.begin()) &&
+            std::all_of(r.begin() + 120, r.end(),
+                        [](double x) { return x == 0.; }),
+        "reallocate" + layout);
+
+  r.fill(3.);
+  check(std::all_of(r.begin(), r.end(), [](double x) { return x == 3.; }),
+        "fill" + layout);
+}
+
+int main() {
+  test_layout(true);
+  test_layout(false);
+
+  // Arrays of another number of dimensions are refused
+  bool threw = false;
+  try {
+    FixedNDArray<double, 2> f(NDArray<double>({2, 3, 4}));
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  check(threw, "construction from another rank throws");
+
+  // A default array is empty
+  FixedNDArray<int, 2> empty;
+  check(empty.size() == 0 && empty.begin() == empty.end(), "default array");
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+#include <ndarray.hpp>
+
+#include <cstdint>
+#include <stdexcept>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+// The packed GEMM is compared with a naive triple loop, for every micro-kernel
+// the CPU supports, with sizes on either side of the register tiles and of
+// the cache blocks, and every combination of c and fortran layouts. Elements
+// are small integers, so that the sums of every type are exact.
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+struct Dims {
+  size_t m, n, k;
+};
+
+static const std::vector<Dims>& dims() {
+  static const std::vector<Dims> d = {
+      {0, 5, 3},   {4, 0, 3},    {4, 5, 0},   {1, 1, 1},    {3, 5, 7},
+      {17, 13, 9}, {33, 25, 31}, {129, 7, 5}, {5, 2050, 3}, {7, 9, 257},
+      {130, 13, 260}};
+  return d;
+}
+
+template <class T>
+static T value(size_t i, size_t j, size_t seed) {
+  return static_cast<T>(static_cast<int>((i * 7 + j * 13 + seed) % 9) - 4);
+}
+
+// Strides of a rows x cols matrix, with a leading dimension padded by pad
+static void strides(size_t rows, size_t cols, bool c_continuous, size_t pad,
+                    std::ptrdiff_t& rs, std::ptrdiff_t& cs) {
+  if (c_continuous) {
+    rs = static_cast<std::ptrdiff_t>(cols + pad);
+    cs = 1;
+  } else {
+    rs = 1;
+    cs = static_cast<std::ptrdiff_t>(rows + pad);
+  }
+}
+
+static std::string describe(const std::string& kernel, const Dims& d,
+                            bool a_c, bool b_c, bool c_c) {
+  return kernel + " m = " + std::to_string(d.m) +
+         ", n = " + std::to_string(d.n) + ", k = " + std::to_string(d.k) +
+         (a_c ? ", a c" : ", a f") + (b_c ? ", b c" : ", b f") +
+         (c_c ? ", c c" : ", c f");
+}
+
+// Runs gemm with the micro-kernel K on padded matrices of every layout. As
+// gemm adds to c, c starts with nonzero values.
+template <class K, class T>
+static void test_kernel(const std::string& name) {
+  const size_t pad = 3;
+  for (const Dims& d : dims()) {
+    for (int layout = 0; layout < 8; layout++) {
+      bool a_c = layout & 1, b_c = layout & 2, c_c = layout & 4;
+      std::ptrdiff_t a_rs, a_cs, b_rs, b_cs, c_rs, c_cs;
+      strides(d.m, d.k, a_c, pad, a_rs, a_cs);
+      strides(d.k, d.n, b_c, pad, b_rs, b_cs);
+      strides(d.m, d.n, c_c, pad, c_rs, c_cs);
+
+      std::vector<T> a((d.m + pad) * (d.k + pad));
+      std::vector<T> b((d.k + pad) * (d.n + pad));
+      std::vector<T> c((d.m + pad) * (d.n + pad));
+      for (size_t i = 0; i < d.m; i++) {
+        for (size_t p = 0; p < d.k; p++) {
+          a[i * a_rs + p * a_cs] = value<T>(i, p, 1);
+        }
+      }
+      for (size_t p = 0; p < d.k; p++) {
+        for (size_t j = 0; j < d.n; j++) {
+          b[p * b_rs + j * b_cs] = value<T>(p, j, 2);
+        }
+      }
+      for (size_t i = 0; i < c.size(); i++) c[i] = value<T>(i, 0, 3);
+      std::vector<T> expected = c;
+      for (size_t i = 0; i < d.m; i++) {
+        for (size_t j = 0; j < d.n; j++) {
+          T sum = T();
+          for (size_t p = 0; p < d.k; p++) {
+            sum += a[i * a_rs + p * a_cs] * b[p * b_rs + j * b_cs];
+          }
+          expected[i * c_rs + j * c_cs] += sum;
+        }
+      }
+
+      if (d.m > 0 && d.n > 0 && d.k > 0) {
+        gemm_blocked<K>(d.m, d.n, d.k, a.data(), a_rs, a_cs, b.data(), b_rs,
+                        b_cs, c.data(), c_rs, c_cs);
+      }
+      if (c != expected) {
+        check(false, describe(name, d, a_c, b_c, c_c));
+        return;
+      }
+    }
+  }
+}
+
+// The SIMD micro-kernels exist for float and double only
+template <class T>
+static void test_simd_kernels(const std::string&, std::false_type) {}
+
+template <class T>
+static void test_simd_kernels(const std::string& type, std::true_type) {
+#if defined(NDARRAY_X86_DISPATCH)
+  if (cpu_supports_avx2() && cpu_supports_fma()) {
+    test_kernel<GemmKernelAVX2<T>, T>("avx2 " + type);
+  }
+  if (cpu_supports_avx512f()) {
+    test_kernel<GemmKernelAVX512<T>, T>("avx512 " + type);
+  }
+#else
+  (void)type;
+#endif
+}
+
+template <class T>
+static void test_kernels() {
+  const std::string type = typeid(T).name();
+  test_kernel<GemmKernel<T>, T>("generic " + type);
+  test_simd_kernels<T>(type, std::is_floating_point<T>());
+}
+
+template <class T>
+static NDArray<T> matrix(size_t rows, size_t cols, bool c_continuous,
+                         size_t seed) {
+  NDArray<T> x({rows, cols}, c_continuous);
+  for (size_t i = 0; i < rows; i++) {
+    for (size_t j = 0; j < cols; j++) x(i, j) = value<T>(i, j, seed);
+  }
+  return x;
+}
+
+template <class T>
+static NDArray<T> vector(size_t n, size_t seed) {
+  NDArray<T> x({n});
+  for (size_t i = 0; i < n; i++) x[i] = value<T>(i, 0, seed);
+  return x;
+}
+
+// The public functions, which choose the kernel themselves
+template <class T>
+static void test_products() {
+  const std::string type = typeid(T).name();
+  for (const Dims& d : dims()) {
+    for (int layout = 0; layout < 4; layout++) {
+      bool a_c = layout & 1, b_c = layout & 2;
+      NDArray<T> a = matrix<T>(d.m, d.k, a_c, 1);
+      NDArray<T> b = matrix<T>(d.k, d.n, b_c, 2);
+      NDArray<T> c = matmul(a, b);
+
+      bool same = c.shape() == std::vector<size_t>({d.m, d.n}) &&
+                  c.c_continuous() == (a_c || b_c);
+      for (size_t i = 0; same && i < d.m; i++) {
+        for (size_t j = 0; same && j < d.n; j++) {
+          T sum = T();
+          for (size_t p = 0; p < d.k; p++) sum += a(i, p) * b(p, j);
+          same = c(i, j) == sum;
+        }
+      }
+      check(same, describe("matmul " + type, d, a_c, b_c, a_c || b_c));
+    }
+
+    // Vectors on either side
+    NDArray<T> a = matrix<T>(d.m, d.k, true, 1);
+    NDArray<T> x = vector<T>(d.k, 4);
+    NDArray<T> y = vector<T>(d.m, 5);
+    NDArray<T> ax = matmul(a, x);
+    NDArray<T> ya = matmul(y, a);
+    bool same = ax.shape() == std::vector<size_t>({d.m}) &&
+                ya.shape() == std::vector<size_t>({d.k});
+    for (size_t i = 0; same && i < d.m; i++) {
+      T sum = T();
+      for (size_t p = 0; p < d.k; p++) sum += a(i, p) * x[p];
+      same = ax[i] == sum;
+    }
+    for (size_t p = 0; same && p < d.k; p++) {
+      T sum = T();
+      for (size_t i = 0; i < d.m; i++) sum += y[i] * a(i, p);
+      same = ya[p] == sum;
+    }
+    check(same, describe("matmul vector " + type, d, true, true, true));
+  }
+
+  for (size_t n : {0, 1, 7, 100, 1000, 100003}) {
+    NDArray<T> x = vector<T>(n, 1);
+    NDArray<T> y = vector<T>(n, 2);
+    T sum = T();
+    for (size_t i = 0; i < n; i++) sum += x[i] * y[i];
+    check(dot(x, y) == sum, "dot " + type + " n = " + std::to_string(n));
+    NDArray<T> xy = matmul(x, y);
+    check(xy.shape() == std::vector<size_t>({1}) && xy[0] == sum,
+          "matmul of vectors " + type + " n = " + std::to_string(n));
+  }
+
+  for (size_t m : {0, 1, 5, 300}) {
+    NDArray<T> x = vector<T>(m, 1);
+    NDArray<T> y = vector<T>(37, 2);
+    NDArray<T> xy = outer(x, y);
+    bool same = xy.shape() == std::vector<size_t>({m, 37});
+    for (size_t i = 0; same && i < m; i++) {
+      for (size_t j = 0; same && j < 37; j++) same = xy(i, j) == x[i] * y[j];
+    }
+    check(same, "outer " + type + " m = " + std::to_string(m));
+  }
+
+  // Shapes which are not aligned are refused
+  bool threw = false;
+  try {
+    matmul(matrix<T>(3, 4, true, 1), matrix<T>(5, 2, true, 2));
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  check(threw, "matmul of unaligned shapes " + type);
+}
+
+template <class T>
+static void test_type() {
+  test_kernels<T>();
+  test_products<T>();
+}
+
+int main() {
+  ExecutionSettings saved = execution_settings();
+
+  // On the calling thread only, and then with blocks of rows on 4 threads
+  for (size_t n_threads : {1, 4}) {
+    execution_settings() = ExecutionSettings{n_threads, 1};
+    test_type<float>();
+    test_type<double>();
+    test_type<int>();
+  }
+
+  execution_settings() = saved;
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
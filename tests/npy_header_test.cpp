@@ -0,0 +1,69 @@
+#include <ndarray.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+static bool parses(const std::string& header, std::vector<size_t>& shape) {
+  DType dtype;
+  bool c_contiguous, little_endian;
+  try {
+    parse_npy_header(header, shape, dtype, c_contiguous, little_endian);
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+  return true;
+}
+
+static std::string header(const std::string& shape) {
+  return "{'descr': '<f8', 'fortran_order': False, 'shape': " + shape + ", }";
+}
+
+int main() {
+  std::vector<size_t> shape;
+  check(parses(header("(3, 4)"), shape) &&
+            shape == std::vector<size_t>({3, 4}),
+        "ordinary shape");
+  check(parses(header("()"), shape) && shape == std::vector<size_t>({1}),
+        "scalar shape");
+
+  // Each dimension, and the number of bytes of the data, must fit in a size_t
+  check(!parses(header("(99999999999999999999999,)"), shape),
+        "dimension which overflows");
+  check(!parses(header("(18446744073709551616,)"), shape),
+        "dimension of 2^64");
+  check(!parses(header("(2305843009213693952,)"), shape),
+        "2^61 elements of 8 bytes");
+  check(!parses(header("(4294967296, 4294967296)"), shape),
+        "product of dimensions which overflows");
+  check(parses(header("(0, 18446744073709551615)"), shape),
+        "empty array with a large dimension");
+
+  // Loading such a header reports an error instead of wrapping around
+  std::string bytes("\x93NUMPY\x01\x00", 8);
+  std::string dict = header("(2305843009213693952,)");
+  dict.resize(118, ' ');
+  dict += '\n';
+  bytes += static_cast<char>(dict.size() & 0xff);
+  bytes += static_cast<char>(dict.size() >> 8);
+  bytes += dict;
+  bool threw = false;
+  try {
+    NDArray<double>::load(bytes.data(), bytes.size());
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  check(threw, "load of a header which overflows");
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
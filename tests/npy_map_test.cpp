@@ -0,0 +1,95 @@
+#include <ndarray.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+int main() {
+  const std::string fname = "npy_map_test.npy";
+  NDArray<double> a({3, 4});
+  for (size_t i = 0; i < a.size(); i++) a[i] = 1.5 * static_cast<double>(i);
+  a.save(fname);
+
+  // A READ_ONLY mapping only gives const access to its elements
+  {
+    auto m = NDArray<double>::map(fname);
+    static_assert(std::is_same<decltype(m), MappedNDArray<const double>>::value,
+                  "map must return a mapping of const elements");
+    static_assert(std::is_same<decltype(m[0]), const double&>::value,
+                  "operator[] of a READ_ONLY mapping must be const");
+    static_assert(std::is_same<decltype(m(0, 0)), const double&>::value,
+                  "operator() of a READ_ONLY mapping must be const");
+    static_assert(std::is_same<decltype(m.data()), const double*>::value,
+                  "data() of a READ_ONLY mapping must be const");
+    static_assert(std::is_same<decltype(m.begin()), const double*>::value,
+                  "begin() of a READ_ONLY mapping must be const");
+    check(m.mode() == MapMode::READ_ONLY, "map mode");
+    check(m.shape() == a.shape() && m(2, 3) == a(2, 3), "map data");
+  }
+
+  // A COPY_ON_WRITE mapping may be modified, without changing the file
+  {
+    auto m = NDArray<double>::map_cow(fname);
+    check(m.mode() == MapMode::COPY_ON_WRITE, "map_cow mode");
+    m(1, 1) = -1.;
+    check(m(1, 1) == -1., "map_cow write");
+    check(m.copy()(1, 1) == -1., "map_cow copy");
+  }
+  check(NDArray<double>::load(fname)(1, 1) == a(1, 1), "file unchanged");
+
+  // A READ_ONLY mapping of elements which are not const is refused
+  bool threw = false;
+  try {
+    MappedNDArray<double> m(fname, MapMode::READ_ONLY);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  check(threw, "READ_ONLY mapping of non-const elements");
+
+  // A header whose number of bytes overflows must not pass the size check.
+  // 2^61 elements of 8 bytes wrap around to 0 bytes.
+  std::string header =
+      make_npy_header({static_cast<size_t>(1) << 61}, DType::DOUBLE64, true);
+  std::string bytes = header + std::string(128, '\0');
+  for (size_t shift : {61, 62}) {
+    std::string wrapped =
+        make_npy_header({static_cast<size_t>(1) << shift, 8}, DType::DOUBLE64,
+                        true) +
+        std::string(128, '\0');
+    threw = false;
+    try {
+      NDArray<double>::map(wrapped.data(), wrapped.size());
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    check(threw, "overflowing shape in buffer");
+  }
+
+  {
+    std::ofstream file(fname, std::ios::binary);
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+  threw = false;
+  try {
+    NDArray<double>::map(fname);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  check(threw, "overflowing shape in file");
+
+  std::remove(fname.c_str());
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+#include <ndarray.hpp>
+
+#include <complex>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+
+// A streambuf over a string which may only be read forwards, as is the case
+// for a pipe. Any attempt to seek or to ask for the position fails.
+class ForwardOnlyBuf : public std::streambuf {
+ public:
+  explicit ForwardOnlyBuf(const std::string& data) : data_(data), pos_(0) {}
+
+ protected:
+  int_type underflow() override {
+    if (pos_ >= data_.size()) return traits_type::eof();
+    // Hand out a few bytes at a time, so reads span several refills
+    size_t n = std::min<size_t>(7, data_.size() - pos_);
+    std::memcpy(buffer_, data_.data() + pos_, n);
+    pos_ += n;
+    setg(buffer_, buffer_, buffer_ + n);
+    return traits_type::to_int_type(buffer_[0]);
+  }
+
+  pos_type seekoff(off_type, std::ios_base::seekdir,
+                   std::ios_base::openmode) override {
+    return pos_type(off_type(-1));
+  }
+
+  pos_type seekpos(pos_type, std::ios_base::openmode) override {
+    return pos_type(off_type(-1));
+  }
+
+ private:
+  std::string data_;
+  size_t pos_;
+  char buffer_[7];
+};
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+template <class T>
+static void check_round_trip(const NDArray<T>& arr, const std::string& name,
+                             const std::string& prefix = "") {
+  std::ostringstream out;
+  arr.save(out);
+
+  ForwardOnlyBuf buf(prefix + out.str());
+  std::istream in(&buf);
+  if (!prefix.empty()) {
+    std::string skipped(prefix.size(), '\0');
+    in.read(&skipped[0], static_cast<std::streamsize>(prefix.size()));
+  }
+
+  try {
+    NDArray<T> loaded = NDArray<T>::load(in);
+    check(loaded.shape() == arr.shape(), name + ": shape");
+    check(loaded.c_continuous() == arr.c_continuous(), name + ": order");
+    bool same = loaded.size() == arr.size();
+    for (size_t i = 0; same && i < arr.size(); i++) {
+      same = loaded[i] == arr[i];
+    }
+    check(same, name + ": data");
+  } catch (const std::exception& err) {
+    check(false, name + ": " + err.what());
+  }
+}
+
+int main() {
+  NDArray<double> a({3, 4});
+  for (size_t i = 0; i < a.size(); i++) a[i] = 0.5 * static_cast<double>(i);
+  check_round_trip(a, "double");
+
+  NDArray<int32_t> b({2, 3, 5}, false);
+  for (size_t i = 0; i < b.size(); i++) b[i] = static_cast<int32_t>(i) - 7;
+  check_round_trip(b, "fortran int32");
+
+  NDArray<std::complex<float>> c({6});
+  for (size_t i = 0; i < c.size(); i++) {
+    c[i] = std::complex<float>(static_cast<float>(i), -1.f);
+  }
+  check_round_trip(c, "complex float");
+
+  // A stream which has already been partly consumed
+  check_round_trip(a, "partly read stream", "leading bytes");
+
+  // Truncated data must still be reported as an error
+  std::ostringstream out;
+  a.save(out);
+  std::string truncated = out.str();
+  truncated.resize(truncated.size() - 3);
+  ForwardOnlyBuf buf(truncated);
+  std::istream in(&buf);
+  bool threw = false;
+  try {
+    NDArray<double>::load(in);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  check(threw, "truncated stream");
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#include <ndarray.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+// PageAllocator must give huge page aligned memory under every combination
+// of options, whether or not the system supports them, and work as the
+// allocator of NDArray, alone and wrapped in UninitializedAllocator.
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+static std::string describe(const PageOptions& o) {
+  const char* numa[] = {"default", "interleave", "bind"};
+  return std::string(o.huge_pages ? "huge pages" : "small pages") +
+         (o.hugetlb ? ", hugetlb, " : ", ") +
+         numa[static_cast<int>(o.numa)];
+}
+
+static void test_options(const PageOptions& options) {
+  const std::string what = describe(options);
+  PageAllocator<double> alloc(options);
+  check(alloc.allocate(0) == nullptr, "allocate nothing with " + what);
+
+  // Sizes below, at and above a whole huge page
+  const size_t huge = huge_page_size() / sizeof(double);
+  bool ok = true;
+  for (size_t n : {size_t(1), huge - 1, huge, huge + 1, 3 * huge + 5}) {
+    double* p = alloc.allocate(n);
+#if defined(NDARRAY_POSIX)
+    ok = ok && reinterpret_cast<std::uintptr_t>(p) % huge_page_size() == 0;
+#endif
+    std::fill(p, p + n, 2.);
+    ok = ok && std::all_of(p, p + n, [](double x) { return x == 2.; });
+    alloc.deallocate(p, n);
+  }
+  check(ok, "allocations with " + what);
+
+  try {
+    alloc.allocate(std::numeric_limits<size_t>::max() / 4);
+    check(false, "overflow with " + what);
+  } catch (const std::bad_alloc&) {
+  }
+
+  // The options are kept by copies and rebinds
+  PageAllocator<float> rebound(alloc);
+  check(rebound.options().huge_pages == options.huge_pages &&
+            rebound.options().hugetlb == options.hugetlb &&
+            rebound.options().numa == options.numa &&
+            rebound.options().node_mask == options.node_mask,
+        "rebound options with " + what);
+
+  NDArray<double, PageAllocator<double>> a({513, 1025}, true, alloc);
+  bool zero = std::all_of(a.begin(), a.end(), [](double x) { return x == 0.; });
+  for (size_t i = 0; i < a.size(); i++) a[i] = static_cast<double>(i % 101);
+  NDArray<double, PageAllocator<double>> b = a * 2. - a;
+  check(zero && a.get_allocator().options().numa == options.numa &&
+            std::equal(a.begin(), a.end(), b.begin()),
+        "NDArray with " + what);
+}
+
+int main() {
+  ExecutionSettings saved = execution_settings();
+  execution_settings() = ExecutionSettings{4, 1};
+
+  // Every node of the machine, and only the first one
+  for (uint64_t mask : {uint64_t(0), uint64_t(1)}) {
+    for (NumaPolicy numa :
+         {NumaPolicy::DEFAULT, NumaPolicy::INTERLEAVE, NumaPolicy::BIND}) {
+      for (bool huge_pages : {true, false}) {
+        for (bool hugetlb : {false, true}) {
+          test_options(PageOptions(huge_pages, hugetlb, numa, mask));
+        }
+      }
+    }
+  }
+
+  // Uninitialized arrays over pages are zeroed by the constructors, and
+  // left untouched by uninitialized
+  using Alloc = UninitializedAllocator<double, PageAllocator<double>>;
+  Alloc alloc{PageAllocator<double>(PageOptions(true))};
+  NDArray<double, Alloc> z({1000, 1000}, true, alloc);
+  check(std::all_of(z.begin(), z.end(), [](double x) { return x == 0.; }),
+        "UninitializedAllocator over pages zeroes new arrays");
+  NDArray<double, Alloc> u =
+      NDArray<double, Alloc>::uninitialized({1000, 1000}, true, alloc);
+  u.fill(1.);
+  z += u;
+  check(z.sum() == 1e6 && z.get_allocator().options().huge_pages,
+        "UninitializedAllocator over pages in expressions");
+
+  execution_settings() = saved;
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
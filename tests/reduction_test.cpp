@@ -0,0 +1,299 @@
+#include <ndarray.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Whole-array and per-axis reductions are compared with loops over
+// multi-indices, for both layouts, on one and several threads. Elements are
+// small integers with many repeats, so that sums are exact and argmin and
+// argmax must choose the first of equal elements. NaN propagates as in
+// NumPy, wherever it is and however the work is split among threads.
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+static std::string to_string(const std::vector<size_t>& shape) {
+  std::string s = "{";
+  for (size_t i = 0; i < shape.size(); i++) {
+    s += (i > 0 ? ", " : "") + std::to_string(shape[i]);
+  }
+  return s + "}";
+}
+
+template <class T>
+static NDArray<T> values(const std::vector<size_t>& shape,
+                         bool c_continuous) {
+  NDArray<T> a(shape, c_continuous);
+  for (size_t i = 0; i < a.size(); i++) {
+    a[i] = static_cast<T>(static_cast<int>((i * 7919) % 61) - 30);
+  }
+  return a;
+}
+
+// Calls f(index) for every multi-index of shape, in c order
+template <class F>
+static void for_each_index(const std::vector<size_t>& shape, F f) {
+  size_t n = 1;
+  for (size_t s : shape) n *= s;
+  std::vector<size_t> index(shape.size(), 0);
+  for (size_t k = 0; k < n; k++) {
+    f(index);
+    for (size_t i = shape.size(); i-- > 0;) {
+      if (++index[i] < shape[i]) break;
+      index[i] = 0;
+    }
+  }
+}
+
+template <class T>
+static void test_whole(const NDArray<T>& a, const std::string& what) {
+  T sum = T();
+  size_t argmin = 0, argmax = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    sum += a[i];
+    if (a[i] < a[argmin]) argmin = i;
+    if (a[i] > a[argmax]) argmax = i;
+  }
+
+  check(a.sum() == sum, "sum of " + what);
+  check(a.mean() == sum / static_cast<T>(a.size()), "mean of " + what);
+  check(a.min() == a[argmin], "min of " + what);
+  check(a.max() == a[argmax], "max of " + what);
+  check(a.argmin() == argmin, "argmin of " + what);
+  check(a.argmax() == argmax, "argmax of " + what);
+}
+
+template <class T>
+static void test_axis(const NDArray<T>& a, size_t axis,
+                      const std::string& what) {
+  const std::vector<size_t>& shape = a.shape();
+  NDArray<T> sum = a.sum(axis);
+  NDArray<T> mean = a.mean(axis);
+  NDArray<T> min = a.min(axis);
+  NDArray<T> max = a.max(axis);
+  NDArray<size_t> argmin = a.argmin(axis);
+  NDArray<size_t> argmax = a.argmax(axis);
+
+  std::vector<size_t> reduced;
+  for (size_t i = 0; i < shape.size(); i++) {
+    if (i != axis) reduced.push_back(shape[i]);
+  }
+  if (reduced.empty()) reduced.push_back(1);
+  bool same = sum.shape() == reduced && argmax.shape() == reduced &&
+              sum.c_continuous() == a.c_continuous() &&
+              argmax.c_continuous() == a.c_continuous();
+  if (!same) {
+    check(false, "shape of reductions along " + std::to_string(axis) +
+                     " of " + what);
+    return;
+  }
+
+  bool sum_ok = true, min_ok = true, max_ok = true;
+  for_each_index(reduced, [&](const std::vector<size_t>& out) {
+    // Index of a with the reduced axis put back
+    std::vector<size_t> index;
+    for (size_t i = 0, j = 0; i < shape.size(); i++) {
+      index.push_back(i == axis ? 0 : out[j++]);
+    }
+
+    T s = T();
+    size_t lo = 0, hi = 0;
+    std::vector<size_t> at = index;
+    for (size_t r = 0; r < shape[axis]; r++) {
+      at[axis] = r;
+      T x = a(at);
+      s += x;
+      at[axis] = lo;
+      if (x < a(at)) lo = r;
+      at[axis] = hi;
+      if (x > a(at)) hi = r;
+    }
+    at[axis] = lo;
+    T lo_value = a(at);
+    at[axis] = hi;
+    T hi_value = a(at);
+
+    sum_ok = sum_ok && sum(out) == s &&
+             mean(out) == s / static_cast<T>(shape[axis]);
+    min_ok = min_ok && min(out) == lo_value && argmin(out) == lo;
+    max_ok = max_ok && max(out) == hi_value && argmax(out) == hi;
+  });
+
+  const std::string along = " along " + std::to_string(axis) + " of " + what;
+  check(sum_ok, "sum and mean" + along);
+  check(min_ok, "min and argmin" + along);
+  check(max_ok, "max and argmax" + along);
+}
+
+template <class T>
+static void test_type(const std::string& type) {
+  const std::vector<std::vector<size_t>> shapes = {
+      {1}, {7}, {1000003}, {3, 4}, {1, 9}, {9, 1}, {7, 300, 5}, {2, 3, 4, 5}};
+
+  for (const auto& shape : shapes) {
+    for (bool c_continuous : {true, false}) {
+      const std::string what = type + " " + to_string(shape) +
+                               (c_continuous ? " c" : " f");
+      NDArray<T> a = values<T>(shape, c_continuous);
+      test_whole(a, what);
+      for (size_t axis = 0; axis < shape.size(); axis++) {
+        test_axis(a, axis, what);
+      }
+    }
+  }
+
+  // Reductions of nothing are refused, as is an axis out of range
+  NDArray<T> empty({0, 3});
+  int n_threw = 0;
+  try {
+    empty.min();
+  } catch (const std::runtime_error&) {
+    n_threw++;
+  }
+  try {
+    empty.argmax();
+  } catch (const std::runtime_error&) {
+    n_threw++;
+  }
+  try {
+    empty.max(0);
+  } catch (const std::runtime_error&) {
+    n_threw++;
+  }
+  try {
+    empty.mean();
+  } catch (const std::runtime_error&) {
+    n_threw++;
+  }
+  try {
+    values<T>({3, 4}, true).sum(2);
+  } catch (const std::out_of_range&) {
+    n_threw++;
+  }
+  check(n_threw == 5, "empty reductions of " + type + " throw");
+
+  // Sums over an empty axis are zero
+  NDArray<T> sum = empty.sum(0);
+  check(sum.shape() == std::vector<size_t>({3}) && sum[0] == T() &&
+            sum[1] == T() && sum[2] == T(),
+        "sum along an empty axis of " + type);
+}
+
+// Whole-array reductions of a with NaN at the given positions
+static void test_nan_whole(size_t n, const std::vector<size_t>& nans) {
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  std::string what = std::to_string(n) + " elements with NaN at";
+  for (size_t i : nans) what += " " + std::to_string(i);
+
+  for (bool c_continuous : {true, false}) {
+    NDArray<double> a = values<double>({n}, c_continuous);
+    for (size_t i : nans) a[i] = nan;
+    size_t first = *std::min_element(nans.begin(), nans.end());
+    check(std::isnan(a.min()) && std::isnan(a.max()), "min and max of " + what);
+    check(a.argmin() == first && a.argmax() == first,
+          "argmin and argmax of " + what);
+  }
+}
+
+// Reductions along each axis of a {5, 300, 7} array, with NaN in some lanes
+static void test_nan_axis(bool c_continuous) {
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const std::vector<size_t> shape = {5, 300, 7};
+  NDArray<double> a = values<double>(shape, c_continuous);
+  a(0, 0, 0) = nan;
+  a(4, 150, 3) = nan;
+  a(2, 299, 6) = nan;
+  a(2, 10, 6) = nan;
+
+  const std::string layout = c_continuous ? " c" : " f";
+  for (size_t axis = 0; axis < 3; axis++) {
+    NDArray<double> min = a.min(axis);
+    NDArray<double> max = a.max(axis);
+    NDArray<size_t> argmin = a.argmin(axis);
+    NDArray<size_t> argmax = a.argmax(axis);
+
+    std::vector<size_t> reduced;
+    for (size_t i = 0; i < 3; i++) {
+      if (i != axis) reduced.push_back(shape[i]);
+    }
+    bool ok = true;
+    for_each_index(reduced, [&](const std::vector<size_t>& out) {
+      std::vector<size_t> at;
+      for (size_t i = 0, j = 0; i < 3; i++) {
+        at.push_back(i == axis ? 0 : out[j++]);
+      }
+
+      // The first NaN of the lane, if any
+      size_t first = shape[axis];
+      for (size_t r = shape[axis]; r-- > 0;) {
+        at[axis] = r;
+        if (std::isnan(a(at))) first = r;
+      }
+      if (first == shape[axis]) {
+        ok = ok && !std::isnan(min(out)) && !std::isnan(max(out));
+      } else {
+        ok = ok && std::isnan(min(out)) && std::isnan(max(out)) &&
+             argmin(out) == first && argmax(out) == first;
+      }
+    });
+    check(ok, "NaN along " + std::to_string(axis) + layout);
+  }
+}
+
+static void test_nan() {
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const double inf = std::numeric_limits<double>::infinity();
+
+  NDArray<double> a({4});
+  const double first[] = {nan, 1, 5, 2};
+  const double second[] = {1, nan, 5, 2};
+  std::copy(first, first + 4, a.begin());
+  check(std::isnan(a.max()) && a.argmax() == 0, "max of {NaN, 1, 5, 2}");
+  std::copy(second, second + 4, a.begin());
+  check(std::isnan(a.max()) && a.argmax() == 1, "max of {1, NaN, 5, 2}");
+  check(std::isnan(a.min()) && a.argmin() == 1, "min of {1, NaN, 5, 2}");
+
+  a.fill(-inf);
+  a[3] = nan;
+  check(std::isnan(a.min()) && a.argmin() == 3, "min of {-inf, ..., NaN}");
+
+  // In every block, at the edges, and more than once
+  const size_t n = 1000003;
+  for (const std::vector<size_t>& nans :
+       std::vector<std::vector<size_t>>{{0}, {n - 1}, {n / 2}, {7, 9},
+                                        {n - 1, 12345}, {999, 500000, 3}}) {
+    test_nan_whole(n, nans);
+  }
+  test_nan_whole(13, {12});
+
+  test_nan_axis(true);
+  test_nan_axis(false);
+}
+
+int main() {
+  ExecutionSettings saved = execution_settings();
+
+  // On the calling thread only, and then with blocks on 4 threads
+  for (size_t n_threads : {1, 4}) {
+    execution_settings() = ExecutionSettings{n_threads, 1};
+    test_type<double>("double");
+    test_type<int>("int");
+    test_nan();
+  }
+
+  execution_settings() = saved;
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#include <ndarray.hpp>
+
+#include <condition_variable>
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static int n_failures = 0;
+
+static void check(bool condition, const std::string& what) {
+  if (!condition) {
+    std::cerr << "FAILED: " << what << "\n";
+    n_failures++;
+  }
+}
+
+static bool equal(const NDArray<double>& a, const NDArray<double>& b) {
+  if (a.shape() != b.shape() || a.c_continuous() != b.c_continuous()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i] != b[i]) return false;
+  }
+  return true;
+}
+
+// Holds the writer thread until release is called, so that the writes
+// queued after it are known not to have run yet
+class Gate {
+ public:
+  Gate() : mutex_{}, opened_{}, open_{false} {}
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    opened_.wait(lock, [this]() { return open_; });
+  }
+
+  void release() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      open_ = true;
+    }
+    opened_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable opened_;
+  bool open_;
+};
+
+int main() {
+  const std::string fname = "save_async_test.npy";
+  const std::string other = "save_async_test_other.npy";
+
+  NDArray<double> a({3, 4});
+  for (size_t i = 0; i < a.size(); i++) a[i] = static_cast<double>(i);
+  const NDArray<double> original = a;
+
+  // Discarded futures must not wait for their write, or the gate, which is
+  // only released afterwards, would never open
+  Gate gate;
+  AsyncWriter::instance().submit(
+      std::packaged_task<void()>(std::bind(&Gate::wait, &gate)));
+  a.save_async(fname);
+  for (size_t i = 0; i < a.size(); i++) a[i] = -1.;
+  a.save_async(other);
+  NDArray<double> b({2, 2}, false);
+  b.fill(7.);
+  std::future<void> last = b.save_async(fname);
+  gate.release();
+
+  // Writes run in the order they were queued, so the last save to fname
+  // wins, and the earlier ones are done once it is
+  last.get();
+  check(equal(NDArray<double>::load(fname), b), "last write wins");
+  NDArray<double> modified = NDArray<double>::load(other);
+  check(modified.shape() == original.shape(), "snapshot shape");
+  bool all_modified = true;
+  for (size_t i = 0; i < modified.size(); i++) {
+    all_modified = all_modified && modified[i] == -1.;
+  }
+  check(all_modified, "snapshot taken at the call");
+
+  // The snapshot is independent of the array after the call
+  a = original;
+  std::future<void> saved = a.save_async(fname);
+  for (size_t i = 0; i < a.size(); i++) a[i] = 0.;
+  saved.get();
+  check(equal(NDArray<double>::load(fname), original), "snapshot kept");
+
+  // Borrowed data, left untouched until the future is ready
+  saved = b.save_async(other, false);
+  saved.get();
+  check(equal(NDArray<double>::load(other), b), "borrowed data");
+
+  // Many saves, all queued before any is waited for
+  std::vector<std::string> names;
+  std::vector<std::future<void>> futures;
+  for (size_t n = 0; n < 64; n++) {
+    NDArray<double> c({n + 1});
+    for (size_t i = 0; i < c.size(); i++) c[i] = static_cast<double>(n + i);
+    names.push_back("save_async_test_" + std::to_string(n) + ".npy");
+    futures.push_back(c.save_async(names.back()));
+  }
+  bool all_saved = true;
+  for (size_t n = 0; n < names.size(); n++) {
+    futures[n].get();
+    NDArray<double> c = NDArray<double>::load(names[n]);
+    all_saved = all_saved && c.size() == n + 1;
+    for (size_t i = 0; i < c.size(); i++) {
+      all_saved = all_saved && c[i] == static_cast<double>(n + i);
+    }
+    std::remove(names[n].c_str());
+  }
+  check(all_saved, "many saves");
+
+  // Errors are rethrown from get, and do not stop the writes after them
+  std::future<void> failed =
+      original.save_async("no_such_directory/save_async_test.npy");
+  saved = original.save_async(fname, false);
+  bool threw = false;
+  try {
+    failed.get();
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  check(threw, "error rethrown from get");
+  saved.get();
+  check(equal(NDArray<double>::load(fname), original), "write after error");
+
+  std::remove(fname.c_str());
+  std::remove(other.c_str());
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}
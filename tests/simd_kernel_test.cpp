@@ -0,0 +1,388 @@
+#include <ndarray.hpp>
+
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+// Every SIMD kernel of simd_apply, simd_apply_scalar, and simd_convert is
+// compared with the scalar loop which it replaces, for every length from 0
+// to 130 and every start from a cache line boundary to the next, so that all
+// combinations of peeled elements, full vectors, and tails are covered. The
+// elements around the range must never be touched.
+
+static int n_failures = 0;
+
+enum class Kernel { SSE2, AVX2, AVX512, DISPATCH };
+
+static const char* kernel_name(Kernel k) {
+  switch (k) {
+    case Kernel::SSE2:
+      return "sse2";
+    case Kernel::AVX2:
+      return "avx2";
+    case Kernel::AVX512:
+      return "avx512";
+    default:
+      return "dispatch";
+  }
+}
+
+static std::vector<Kernel> kernels() {
+  std::vector<Kernel> ks;
+#if defined(NDARRAY_X86_DISPATCH)
+  if (cpu_supports_sse2()) ks.push_back(Kernel::SSE2);
+  if (cpu_supports_avx2()) ks.push_back(Kernel::AVX2);
+  if (cpu_supports_avx512f()) ks.push_back(Kernel::AVX512);
+#endif
+  ks.push_back(Kernel::DISPATCH);
+  return ks;
+}
+
+//==============================================================================
+// Values, with divisors kept away from zero
+template <class T>
+struct Values {
+  static T get(size_t i, bool divisor) {
+    double x = static_cast<double>((i * 2654435761u) % 2001) / 10. - 100.;
+    if (divisor && std::abs(x) < 1.) x += 3.;
+    return static_cast<T>(x);
+  }
+};
+
+template <class R>
+struct Values<std::complex<R>> {
+  static std::complex<R> get(size_t i, bool divisor) {
+    return std::complex<R>(Values<R>::get(i, divisor),
+                           Values<R>::get(i + 7, false));
+  }
+};
+
+// Results of real kernels are exact, while complex products and quotients
+// may be rounded differently from std::complex
+template <class T>
+static bool same(const T& x, const T& y) {
+  return x == y;
+}
+
+template <class R>
+static bool same(const std::complex<R>& x, const std::complex<R>& y) {
+  R tol = std::is_same<R, float>::value ? R(1e-5) : R(1e-13);
+  return std::abs(x - y) <= tol * (R(1) + std::abs(y));
+}
+
+//==============================================================================
+// Runs of each kernel, returning the number of elements it processed. The
+// remaining elements are left to the scalar loop, as in simd_apply. Types
+// without a kernel process no elements.
+#if defined(NDARRAY_X86_DISPATCH)
+template <class Op, class T, class C>
+using if_kernel = typename std::enable_if<
+    has_simd_kernel<Op, T, C>::value && is_simd_element<T>::value,
+    size_t>::type;
+
+template <class Op, class T, class C>
+using if_no_kernel = typename std::enable_if<
+    !(has_simd_kernel<Op, T, C>::value && is_simd_element<T>::value),
+    size_t>::type;
+
+template <class Op, class T, class C>
+static if_kernel<Op, T, C> isa_apply(Kernel k, T* a, const C* b, size_t n) {
+  if (k == Kernel::SSE2) return simd_kernel_sse2<Op>(a, b, n);
+  if (k == Kernel::AVX2) return simd_kernel_avx2<Op>(a, b, n);
+  return simd_kernel_avx512<Op>(a, b, n);
+}
+
+template <class Op, class T, class C>
+static if_no_kernel<Op, T, C> isa_apply(Kernel, T*, const C*, size_t) {
+  return 0;
+}
+
+template <class Op, class R>
+static size_t isa_apply(Kernel k, std::complex<R>* a,
+                        const std::complex<R>* b, size_t n) {
+  if (k == Kernel::AVX2) return simd_complex_kernel_avx2<Op>(a, b, n);
+  if (k == Kernel::AVX512) return simd_complex_kernel_avx512<Op>(a, b, n);
+  return 0;
+}
+
+template <class Op, class T, class C>
+static if_kernel<Op, T, C> isa_apply_scalar(Kernel k, T* a, const C& c,
+                                            size_t n) {
+  if (k == Kernel::SSE2) return simd_kernel_scalar_sse2<Op>(a, c, n);
+  if (k == Kernel::AVX2) return simd_kernel_scalar_avx2<Op>(a, c, n);
+  return simd_kernel_scalar_avx512<Op>(a, c, n);
+}
+
+template <class Op, class T, class C>
+static if_no_kernel<Op, T, C> isa_apply_scalar(Kernel, T*, const C&,
+                                               size_t) {
+  return 0;
+}
+
+template <class T, class C>
+static typename std::enable_if<has_simd_convert<T, C>::value, size_t>::type
+isa_convert(Kernel k, T* a, const C* b, size_t n) {
+  if (k == Kernel::SSE2) return simd_convert_kernel_sse2(a, b, n);
+  if (k == Kernel::AVX2) return simd_convert_kernel_avx2(a, b, n);
+  return simd_convert_kernel_avx512(a, b, n);
+}
+
+template <class T, class C>
+static typename std::enable_if<!has_simd_convert<T, C>::value, size_t>::type
+isa_convert(Kernel, T*, const C*, size_t) {
+  return 0;
+}
+#else
+template <class Op, class T, class C>
+static size_t isa_apply(Kernel, T*, const C*, size_t) {
+  return 0;
+}
+
+template <class Op, class T, class C>
+static size_t isa_apply_scalar(Kernel, T*, const C&, size_t) {
+  return 0;
+}
+
+template <class T, class C>
+static size_t isa_convert(Kernel, T*, const C*, size_t) {
+  return 0;
+}
+#endif
+
+template <class Op, class T, class C>
+static size_t run_apply(Kernel k, T* a, const C* b, size_t n) {
+  if (k != Kernel::DISPATCH) return isa_apply<Op>(k, a, b, n);
+  simd_apply<Op>(a, b, n);
+  return n;
+}
+
+template <class Op, class T, class C>
+static size_t run_apply_scalar(Kernel k, T* a, const C& c, size_t n) {
+  if (k != Kernel::DISPATCH) return isa_apply_scalar<Op>(k, a, c, n);
+  simd_apply_scalar<Op>(a, c, n);
+  return n;
+}
+
+template <class T, class C>
+static size_t run_convert(Kernel k, T* a, const C* b, size_t n) {
+  if (k != Kernel::DISPATCH) return isa_convert(k, a, b, n);
+  simd_convert(a, b, n);
+  return n;
+}
+
+//==============================================================================
+// Buffers with guard elements on either side of the range, which starts the
+// given number of elements after a cache line boundary
+template <class T>
+class Buffer {
+ public:
+  static const size_t guard = 64;
+
+  Buffer(size_t n, size_t offset, size_t seed, bool divisor)
+      : storage_(n + offset + 3 * guard), size_(n + offset + 2 * guard) {
+    size_t start = 0;
+    while (reinterpret_cast<std::uintptr_t>(&storage_[start]) % 64 != 0) {
+      start++;
+    }
+    base_ = &storage_[start];
+    for (size_t i = 0; i < size_; i++) {
+      base_[i] = Values<T>::get(i + seed, divisor);
+    }
+  }
+
+  T* data(size_t offset) { return base_ + guard + offset; }
+  const T* base() const { return base_; }
+  size_t size() const { return size_; }
+
+ private:
+  std::vector<T> storage_;
+  size_t size_;
+  T* base_;
+};
+
+template <class T>
+static bool same_buffers(const Buffer<T>& x, const Buffer<T>& y) {
+  for (size_t i = 0; i < x.size(); i++) {
+    if (!same(x.base()[i], y.base()[i])) return false;
+  }
+  return true;
+}
+
+static void report(const std::string& what, Kernel k, size_t n,
+                   size_t a_offset, size_t b_offset) {
+  std::cerr << "FAILED: " << what << " with " << kernel_name(k)
+            << ", n = " << n << ", offsets " << a_offset << " and "
+            << b_offset << "\n";
+  n_failures++;
+}
+
+template <class T>
+static size_t n_offsets() {
+  return 64 / sizeof(T) + 1;
+}
+
+//==============================================================================
+template <class Op, class T, class C>
+static void test_apply() {
+  const std::string what = std::string("apply ") + Op::name() + " " +
+                           typeid(T).name() + " " + typeid(C).name();
+  bool divide = std::is_same<Op, ExprDivide>::value;
+  for (Kernel k : kernels()) {
+    for (size_t n = 0; n <= 130; n++) {
+      for (size_t a_off = 0; a_off < n_offsets<T>(); a_off++) {
+        for (size_t b_off = 0; b_off < 2; b_off++) {
+          Buffer<T> a(n, a_off, 0, false);
+          Buffer<T> expected(n, a_off, 0, false);
+          Buffer<C> b(n, b_off, 11, divide);
+
+          for (size_t i = 0; i < n; i++) {
+            Op::assign(expected.data(a_off)[i], b.data(b_off)[i]);
+          }
+          size_t i = run_apply<Op>(k, a.data(a_off), b.data(b_off), n);
+          for (; i < n; i++) Op::assign(a.data(a_off)[i], b.data(b_off)[i]);
+
+          if (!same_buffers(a, expected)) {
+            report(what, k, n, a_off, b_off);
+            return;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <class Op, class T, class C>
+static void test_apply_scalar() {
+  const std::string what = std::string("apply scalar ") + Op::name() + " " +
+                           typeid(T).name() + " " + typeid(C).name();
+  const C c = Values<C>::get(5, true);
+  for (Kernel k : kernels()) {
+    for (size_t n = 0; n <= 130; n++) {
+      for (size_t a_off = 0; a_off < n_offsets<T>(); a_off++) {
+        Buffer<T> a(n, a_off, 0, false);
+        Buffer<T> expected(n, a_off, 0, false);
+
+        for (size_t i = 0; i < n; i++) Op::assign(expected.data(a_off)[i], c);
+        size_t i = run_apply_scalar<Op>(k, a.data(a_off), c, n);
+        for (; i < n; i++) Op::assign(a.data(a_off)[i], c);
+
+        if (!same_buffers(a, expected)) {
+          report(what, k, n, a_off, 0);
+          return;
+        }
+      }
+    }
+  }
+}
+
+template <class T, class C>
+static void test_convert() {
+  const std::string what =
+      std::string("convert ") + typeid(T).name() + " " + typeid(C).name();
+  for (Kernel k : kernels()) {
+    for (size_t n = 0; n <= 130; n++) {
+      for (size_t a_off = 0; a_off < n_offsets<T>(); a_off++) {
+        for (size_t b_off = 0; b_off < 2; b_off++) {
+          Buffer<T> a(n, a_off, 0, false);
+          Buffer<T> expected(n, a_off, 0, false);
+          Buffer<C> b(n, b_off, 11, false);
+
+          for (size_t i = 0; i < n; i++) {
+            expected.data(a_off)[i] = static_cast<T>(b.data(b_off)[i]);
+          }
+          size_t i = run_convert(k, a.data(a_off), b.data(b_off), n);
+          for (; i < n; i++) {
+            a.data(a_off)[i] = static_cast<T>(b.data(b_off)[i]);
+          }
+
+          if (!same_buffers(a, expected)) {
+            report(what, k, n, a_off, b_off);
+            return;
+          }
+        }
+      }
+    }
+  }
+}
+
+template <class T, class C>
+static void test_pair() {
+  test_apply<ExprAdd, T, C>();
+  test_apply<ExprSubtract, T, C>();
+  test_apply<ExprMultiply, T, C>();
+  test_apply<ExprDivide, T, C>();
+  test_apply_scalar<ExprAdd, T, C>();
+  test_apply_scalar<ExprSubtract, T, C>();
+  test_apply_scalar<ExprMultiply, T, C>();
+  test_apply_scalar<ExprDivide, T, C>();
+  test_convert<T, C>();
+}
+
+template <class R>
+static void test_complex() {
+  using Z = std::complex<R>;
+  test_apply<ExprAdd, Z, Z>();
+  test_apply<ExprSubtract, Z, Z>();
+  test_apply<ExprMultiply, Z, Z>();
+  test_apply<ExprDivide, Z, Z>();
+}
+
+// The public functions split long arrays among threads, and each block of
+// a thread is peeled separately
+template <class T, class C>
+static void test_threaded() {
+  ExecutionSettings saved = execution_settings();
+  execution_settings() = ExecutionSettings{4, 1};
+
+  const size_t n = 100003;
+  Buffer<T> a(n, 1, 0, false);
+  Buffer<T> expected(n, 1, 0, false);
+  Buffer<C> b(n, 0, 11, true);
+  for (size_t i = 0; i < n; i++) {
+    ExprDivide::assign(expected.data(1)[i], b.data(0)[i]);
+    ExprMultiply::assign(expected.data(1)[i], b.data(0)[5]);
+  }
+  simd_apply<ExprDivide>(a.data(1), b.data(0), n);
+  simd_apply_scalar<ExprMultiply>(a.data(1), b.data(0)[5], n);
+  if (!same_buffers(a, expected)) {
+    report("threaded apply", Kernel::DISPATCH, n, 1, 0);
+  }
+
+  Buffer<T> converted(n, 3, 0, false);
+  simd_convert(converted.data(3), b.data(0), n);
+  bool same_values = true;
+  for (size_t i = 0; i < n; i++) {
+    same_values &= converted.data(3)[i] == static_cast<T>(b.data(0)[i]);
+  }
+  if (!same_values) report("threaded convert", Kernel::DISPATCH, n, 3, 0);
+
+  execution_settings() = saved;
+}
+
+int main() {
+  // Every pair of element types with a SIMD kernel
+  test_pair<float, float>();
+  test_pair<float, double>();
+  test_pair<float, int32_t>();
+  test_pair<double, float>();
+  test_pair<double, double>();
+  test_pair<double, int32_t>();
+  test_pair<int32_t, float>();
+  test_pair<int32_t, double>();
+  test_complex<float>();
+  test_complex<double>();
+
+  // Pairs without a kernel must still give the scalar result
+  test_pair<int32_t, int32_t>();
+  test_pair<int64_t, double>();
+
+  test_threaded<float, double>();
+  test_threaded<double, int32_t>();
+
+  if (n_failures == 0) std::cout << "all passed\n";
+  return n_failures == 0 ? 0 : 1;
+}